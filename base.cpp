@@ -7,6 +7,8 @@
 
 #include "base.hpp"
 
+#include <cstring>
+
 using namespace std;
 
 using namespace philips;
@@ -55,45 +57,8 @@ void philips::base64_encode(string & out, const std::vector<uint8_t> & buf)
 
 void philips::base64_encode(string & ret, uint8_t const* buf, size_t bufLen)
 {
-   // Calculate how many bytes that needs to be added to get a multiple of 3
-   size_t missing = 0;
-   size_t ret_size = bufLen;
-   while ((ret_size % 3) != 0)
-   {
-      ++ret_size;
-      ++missing;
-   }
-
-   // Expand the return string size to a multiple of 4
-   ret_size = 4*ret_size/3;
-
-   ret.clear();
-   ret.reserve(ret_size);
-
-   for (size_t i = 0; i < ret_size/4; ++i)
-   {
-      // Read a group of three bytes (avoid buffer overrun by replacing with 0)
-      const size_t index = i*3;
-      const uint8_t b3_0 = (index+0 < bufLen) ? buf[index+0] : 0;
-      const uint8_t b3_1 = (index+1 < bufLen) ? buf[index+1] : 0;
-      const uint8_t b3_2 = (index+2 < bufLen) ? buf[index+2] : 0;
-
-      // Transform into four base 64 characters
-      const uint8_t b4_0 =                        ((b3_0 & 0xfc) >> 2);
-      const uint8_t b4_1 = ((b3_0 & 0x03) << 4) + ((b3_1 & 0xf0) >> 4);
-      const uint8_t b4_2 = ((b3_1 & 0x0f) << 2) + ((b3_2 & 0xc0) >> 6);
-      const uint8_t b4_3 = ((b3_2 & 0x3f) << 0);
-
-      // Add the base 64 characters to the return value
-      ret.push_back(to_base64[b4_0]);
-      ret.push_back(to_base64[b4_1]);
-      ret.push_back(to_base64[b4_2]);
-      ret.push_back(to_base64[b4_3]);
-   }
-
-   // Replace data that is invalid (always as many as there are missing bytes)
-   for (size_t i = 0; i != missing; ++i)
-      ret[ret_size - i - 1] = '=';
+   ret.resize(base64_encoded_size(bufLen));
+   if (!ret.empty()) base64_encode(&ret[0], buf, bufLen);
 }
 
 
@@ -138,14 +103,358 @@ void base64_decode_any(Out& ret, const std::string& in)
    }
 }
 
+// padded standard input takes the fast path, anything else the tolerant loop above
 void philips::base64_decode(vector<uint8_t> & out, const string& encoded_string)
 {
-   base64_decode_any(out, encoded_string);
+   if (!base64_decode_strict(out, encoded_string))
+      base64_decode_any(out, encoded_string);
 }
 
 void philips::base64_decode(string& out, const string& encoded_string)
 {
-   base64_decode_any(out, encoded_string);
+   if (!base64_decode_strict(out, encoded_string))
+      base64_decode_any(out, encoded_string);
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * BASE 64 into caller buffers
+ * the kernels handle whole blocks & leave the tail to the scalar code, the vector
+ * algorithms are those of Mula & Lemire, "Faster Base64 Encoding and Decoding using
+ * AVX2 Instructions"
+ *-------------------------------------------------------------------------------------*/
+
+// strict decoding table, 0xff for everything outside the standard alphabet
+struct DecodeTable {
+   uint8_t v[256];
+   DecodeTable() {
+      memset(v, 0xff, sizeof(v));
+      for (uint8_t i = 0; i < 64; ++i) v[static_cast<uint8_t>(to_base64[i])] = i;
+   }
+};
+
+static const DecodeTable strict_base64;
+
+// encode whole groups of three, returns the number of bytes consumed
+static size_t EncodeScalar(char* out, uint8_t const* buf, size_t len)
+{
+   const size_t n = len - len % 3;
+   for (size_t i = 0; i < n; i += 3, out += 4)
+   {
+      const uint32_t w = (uint32_t) buf[i] << 16 | (uint32_t) buf[i+1] << 8 | buf[i+2];
+      out[0] = to_base64[(w >> 18) & 0x3f];
+      out[1] = to_base64[(w >> 12) & 0x3f];
+      out[2] = to_base64[(w >> 6) & 0x3f];
+      out[3] = to_base64[w & 0x3f];
+   }
+   return n;
+}
+
+// decode whole quads without padding, returns the number of characters consumed
+static size_t DecodeScalar(uint8_t* out, const char* in, size_t len, bool& valid)
+{
+   const uint8_t* d = strict_base64.v;
+   const size_t n = len - len % 4;
+   uint8_t bad = 0;
+   for (size_t i = 0; i < n; i += 4, out += 3)
+   {
+      const uint8_t a = d[static_cast<uint8_t>(in[i+0])];
+      const uint8_t b = d[static_cast<uint8_t>(in[i+1])];
+      const uint8_t c = d[static_cast<uint8_t>(in[i+2])];
+      const uint8_t e = d[static_cast<uint8_t>(in[i+3])];
+      bad |= a | b | c | e;
+      const uint32_t w = (uint32_t) a << 18 | (uint32_t) b << 12 | (uint32_t) c << 6 | e;
+      out[0] = (uint8_t) (w >> 16);
+      out[1] = (uint8_t) (w >> 8);
+      out[2] = (uint8_t) w;
+   }
+   valid = !(bad & 0x80);
+   return n;
+}
+
+typedef size_t (*EncodeKernel)(char* out, uint8_t const* buf, size_t len);
+typedef size_t (*DecodeKernel)(uint8_t* out, const char* in, size_t len, bool& valid);
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define BASE64_X86
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+
+// 12 bytes in the low 3/4 of every 16 byte lane to 16 sextets, one per byte
+SSSE3 static inline __m128i EncodeUnpack(__m128i in)
+{
+   in = _mm_shuffle_epi8(in, _mm_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1));
+   const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+   const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+   const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+   const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+   return _mm_or_si128(t1, t3);
+}
+
+// sextets to characters, the offset to add is looked up per range
+SSSE3 static inline __m128i EncodeLookup(__m128i idx)
+{
+   const __m128i shift = _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+      '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0);
+   __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+   const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+   r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+   return _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+}
+
+SSSE3 static size_t EncodeSSSE3(char* out, uint8_t const* buf, size_t len)
+{
+   size_t i = 0;
+   for (; i + 16 <= len; i += 12, out += 16)
+   {
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), EncodeLookup(EncodeUnpack(in)));
+   }
+   return i + EncodeScalar(out, buf + i, len - i);
+}
+
+// characters to sextets, returns a non zero mask for characters outside the alphabet
+SSSE3 static inline int DecodeLookup(__m128i in, __m128i& values)
+{
+   const __m128i shift = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71,
+      0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i mask = _mm_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8,
+      (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+      (char) 0xf8, (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+   const __m128i bitpos = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+      (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+   const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+   const __m128i bit = _mm_shuffle_epi8(bitpos, hi);
+   const __m128i ok = _mm_and_si128(_mm_shuffle_epi8(mask, lo), bit);
+   const int bad = _mm_movemask_epi8(_mm_cmpeq_epi8(ok, _mm_setzero_si128()));
+   // '+' and '/' share a high nibble, '/' needs 3 less
+   const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+   const __m128i sh = _mm_add_epi8(_mm_shuffle_epi8(shift, hi),
+      _mm_and_si128(slash, _mm_set1_epi8(-3)));
+   values = _mm_add_epi8(in, sh);
+   return bad;
+}
+
+// 16 sextets to 12 bytes in the low 3/4 of the lane
+SSSE3 static inline __m128i DecodePack(__m128i values)
+{
+   const __m128i ab = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+   const __m128i abc = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+   return _mm_shuffle_epi8(abc, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+      -1, -1, -1, -1));
+}
+
+// stores 16 bytes per 12 decoded, so the last 8 characters are left to the caller
+SSSE3 static size_t DecodeSSSE3(uint8_t* out, const char* in, size_t len, bool& valid)
+{
+   size_t i = 0;
+   int bad = 0;
+   for (; i + 24 <= len; i += 16, out += 12)
+   {
+      __m128i values;
+      bad |= DecodeLookup(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)),
+         values);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), DecodePack(values));
+   }
+   const size_t n = i + DecodeScalar(out, in + i, len - i, valid);
+   valid = valid && !bad;
+   return n;
+}
+
+AVX2 static inline __m256i EncodeUnpack(__m256i in)
+{
+   const __m256i order = _mm256_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1,
+      10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1);
+   in = _mm256_shuffle_epi8(in, order);
+   const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+   const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+   const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+   const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+   return _mm256_or_si256(t1, t3);
+}
+
+AVX2 static inline __m256i EncodeLookup(__m256i idx)
+{
+   const __m256i shift = _mm256_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52,
+      '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0,
+      'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+      '0'-52, '+'-62, '/'-63, 'A', 0, 0);
+   __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+   const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+   r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+   return _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), idx);
+}
+
+// two 12 byte groups per iteration, one per lane
+AVX2 static size_t EncodeAVX2(char* out, uint8_t const* buf, size_t len)
+{
+   size_t i = 0;
+   for (; i + 28 <= len; i += 24, out += 32)
+   {
+      const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+      const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 12));
+      const __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+         EncodeLookup(EncodeUnpack(in)));
+   }
+   return i + EncodeSSSE3(out, buf + i, len - i);
+}
+
+AVX2 static inline int DecodeLookup(__m256i in, __m256i& values)
+{
+   const __m256i shift = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+   const __m256i mask = _mm256_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8,
+      (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+      (char) 0xf8, (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+      (char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+      (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf0, 0x54, 0x50,
+      0x50, 0x50, 0x54);
+   const __m256i bitpos = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+      (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+      (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+   const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+   const __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+   const __m256i bit = _mm256_shuffle_epi8(bitpos, hi);
+   const __m256i ok = _mm256_and_si256(_mm256_shuffle_epi8(mask, lo), bit);
+   const int bad = _mm256_movemask_epi8(_mm256_cmpeq_epi8(ok, _mm256_setzero_si256()));
+   const __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+   const __m256i sh = _mm256_add_epi8(_mm256_shuffle_epi8(shift, hi),
+      _mm256_and_si256(slash, _mm256_set1_epi8(-3)));
+   values = _mm256_add_epi8(in, sh);
+   return bad;
+}
+
+AVX2 static inline __m256i DecodePack(__m256i values)
+{
+   const __m256i ab = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+   const __m256i abc = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+   const __m256i lanes = _mm256_shuffle_epi8(abc, _mm256_setr_epi8(2, 1, 0, 6, 5, 4,
+      10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+      -1, -1, -1, -1));
+   // close the gap between the two 12 byte halves
+   return _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+}
+
+AVX2 static size_t DecodeAVX2(uint8_t* out, const char* in, size_t len, bool& valid)
+{
+   size_t i = 0;
+   int bad = 0;
+   for (; i + 48 <= len; i += 32, out += 24)
+   {
+      __m256i values;
+      bad |= DecodeLookup(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)),
+         values);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), DecodePack(values));
+   }
+   const size_t n = i + DecodeSSSE3(out, in + i, len - i, valid);
+   valid = valid && !bad;
+   return n;
+}
+
+#undef SSSE3
+#undef AVX2
+#endif
+
+// pick the widest kernel the cpu supports, once
+struct Kernels {
+   EncodeKernel encode;
+   DecodeKernel decode;
+   Kernels() : encode(EncodeScalar), decode(DecodeScalar) {
+#ifdef BASE64_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+         encode = EncodeAVX2;
+         decode = DecodeAVX2;
+      } else if (__builtin_cpu_supports("ssse3")) {
+         encode = EncodeSSSE3;
+         decode = DecodeSSSE3;
+      }
+#endif
+   }
+};
+
+static const Kernels& Dispatch()
+{
+   static const Kernels k;
+   return k;
+}
+
+size_t philips::base64_encoded_size(size_t len)
+{
+   return 4 * ((len + 2) / 3);
+}
+
+size_t philips::base64_decoded_size(const char* in, size_t len)
+{
+   if (len == 0 || len % 4 != 0) return 0;
+   return 3 * (len / 4) - (in[len-1] == '=') - (in[len-2] == '=');
 }
 
+void philips::base64_encode(char* out, uint8_t const* buf, size_t len)
+{
+   const size_t n = Dispatch().encode(out, buf, len);
+   out += 4 * (n / 3);
+   if (n + 1 == len)
+   {
+      out[0] = to_base64[buf[n] >> 2];
+      out[1] = to_base64[(buf[n] & 0x03) << 4];
+      out[2] = out[3] = '=';
+   }
+   else if (n + 2 == len)
+   {
+      out[0] = to_base64[buf[n] >> 2];
+      out[1] = to_base64[(buf[n] & 0x03) << 4 | buf[n+1] >> 4];
+      out[2] = to_base64[(buf[n+1] & 0x0f) << 2];
+      out[3] = '=';
+   }
+}
 
+bool philips::base64_decode(uint8_t* out, const char* in, size_t len)
+{
+   if (len % 4 != 0) return false;
+   if (len == 0) return true;
+
+   // the last quad carries the padding
+   const size_t pad = (in[len-1] == '=') + (in[len-2] == '=');
+   if (pad == 1 && in[len-2] == '=') return false;
+   bool valid;
+   Dispatch().decode(out, in, len - 4, valid);
+   out += 3 * (len / 4 - 1);
+   in += len - 4;
+
+   const uint8_t* d = strict_base64.v;
+   const uint8_t a = d[static_cast<uint8_t>(in[0])];
+   const uint8_t b = d[static_cast<uint8_t>(in[1])];
+   const uint8_t c = pad > 1 ? 0 : d[static_cast<uint8_t>(in[2])];
+   const uint8_t e = pad > 0 ? 0 : d[static_cast<uint8_t>(in[3])];
+   if (!valid || ((a | b | c | e) & 0x80)) return false;
+   // the bits below the padding have to be zero for a canonical encoding
+   if ((pad == 2 && (b & 0x0f)) || (pad == 1 && (c & 0x03))) return false;
+   out[0] = (uint8_t) (a << 2 | b >> 4);
+   if (pad < 2) out[1] = (uint8_t) (b << 4 | c >> 2);
+   if (pad < 1) out[2] = (uint8_t) (c << 6 | e);
+   return true;
+}
+
+template <class Out>
+static bool base64_decode_strict_any(Out& out, const std::string& in)
+{
+   if (in.size() % 4 != 0) return false;
+   out.resize(base64_decoded_size(in.data(), in.size()));
+   if (in.empty()) return true;
+   return base64_decode(reinterpret_cast<uint8_t*>(&out[0]), in.data(), in.size());
+}
+
+bool philips::base64_decode_strict(vector<uint8_t>& out, const string& encoded_string)
+{
+   return base64_decode_strict_any(out, encoded_string);
+}
+
+bool philips::base64_decode_strict(string& out, const string& encoded_string)
+{
+   return base64_decode_strict_any(out, encoded_string);
+}
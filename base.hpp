@@ -6,6 +6,7 @@
  * written to be C++11 compliant, columnwidth = 90
  */
 
+#include<cstdint>
 #include<string>
 #include<vector>
 
@@ -23,5 +24,30 @@ void base64_encode(std::string& out, const std::string & buf);
 void base64_decode(std::vector<uint8_t>& out, const std::string& encoded_string);
 void base64_decode(std::string& out, const std::string& encoded_string);
 
+/*--------------------------------------------------------------------------------------
+ * BASE 64 into caller buffers
+ * vectorised with SSSE3 or AVX2 when the cpu has it, scalar otherwise
+ *-------------------------------------------------------------------------------------*/
+
+// exact length of the padded encoding of len bytes
+size_t base64_encoded_size(size_t len);
+
+// exact length of the decoding of a padded encoding, 0 if len is not a multiple of 4
+size_t base64_decoded_size(const char* in, size_t len);
+
+// writes exactly base64_encoded_size(len) characters, no terminator
+void base64_encode(char* out, uint8_t const * buf, size_t len);
+
+/**
+ * Strict decoding of padded standard base64, out holds base64_decoded_size(in,len)
+ * returns false on any character outside the alphabet or misplaced padding
+ * ------------------------------------------
+ */
+bool base64_decode(uint8_t* out, const char* in, size_t len);
+
+// strict decoding, resizes out & keeps its capacity for reuse
+bool base64_decode_strict(std::vector<uint8_t>& out, const std::string& encoded_string);
+bool base64_decode_strict(std::string& out, const std::string& encoded_string);
+
 }
 
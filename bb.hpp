@@ -6,14 +6,28 @@
  * written to be C++11 compliant, columnwidth = 90
  */
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 #include <mcl/bn256.hpp>
 
+#include "stats.hpp"
+#include "rng.hpp"
+
 namespace philips { namespace bb {
 
 using namespace mcl::bn256;
 
+// scalar multiplications are counted in the group they happen in
+#ifdef ZKDEID_STATS
+inline void CountMul(const G1&, uint64_t n) { STAT_COUNT(G1_MUL,n); }
+inline void CountMul(const G2&, uint64_t n) { STAT_COUNT(G2_MUL,n); }
+#define BB_COUNT_MUL(el,n) CountMul(el,n)
+#else
+#define BB_COUNT_MUL(el,n) ((void) 0)
+#endif
+
 // templated to enable use in either G1 or G2
 template <typename T, typename Z>
 struct KeyPair {
@@ -24,7 +38,8 @@ struct KeyPair {
 
     // Random pair for given base
     KeyPair(const T& pubgen, const Z& siggen) : pubgen(pubgen), siggen(siggen) {
-        priv.setRand();
+        rng::Rand(priv);
+        BB_COUNT_MUL(pub,1);
         T::mul(pub,pubgen,priv);
     }
 
@@ -43,11 +58,13 @@ struct KeyPair {
 template <typename T, typename Z>
 void Sign(const KeyPair<T,Z>& kp, const std::string& message, Z& sig)
 { 
+    STAT_COUNT(HASH,1);
     Fr inv,sum,hash;
     hash.setHashOf(message);
     Fr::add(sum,kp.priv,hash);
     Fr::inv(inv,sum);
 
+    BB_COUNT_MUL(sig,1);
     Z::mul(sig,kp.siggen,inv);
 }
 
@@ -62,6 +79,7 @@ void Sign(const KeyPair<T,Z>& kp, const Fr& num, Z& sig)
     Fr::add(sum,kp.priv,num);
     Fr::inv(inv,sum);
 
+    BB_COUNT_MUL(sig,1);
     Z::mul(sig,kp.siggen,inv);
 }
 
@@ -72,12 +90,14 @@ void Sign(const KeyPair<T,Z>& kp, const Fr& num, Z& sig)
 template <typename T, typename Z>
 void DoubleSign(const KeyPair<T,Z>& kp, const std::string& message, const Fr& sec, Z& sig)
 { 
+    STAT_COUNT(HASH,1);
     Fr inv,sum,hash;
     hash.setHashOf(message);
     Fr::add(sum,kp.priv,hash);
     Fr::add(sum,sum,sec);
     Fr::inv(inv,sum);
 
+    BB_COUNT_MUL(sig,1);
     Z::mul(sig,kp.siggen,inv);
 }
 
@@ -92,9 +112,12 @@ bool DoubleVerify(const T& pubgen, const Z& siggen, const T& pub,Fp12 (*p)(T,Z),
     T gm;
     Fr hash;
     Fp12 left,right;
+    STAT_COUNT(PAIRING,2);
+    STAT_COUNT(HASH,1);
     left = p(pubgen,siggen);
     hash.setHashOf(message);
     Fr::add(hash,hash,sec);
+    BB_COUNT_MUL(gm,1);
     T::mul(gm,pubgen,hash);
     T::add(gm,gm,pub);
     right = p(gm,sig);
@@ -112,13 +135,127 @@ bool Verify(const T& pubgen, const Z& siggen, const T& pub,Fp12 (*p)(T,Z), const
     T gm;
     Fr hash;
     Fp12 left,right;
+    STAT_COUNT(PAIRING,2);
+    STAT_COUNT(HASH,1);
     left = p(pubgen,siggen);
     hash.setHashOf(message);
+    BB_COUNT_MUL(gm,1);
     T::mul(gm,pubgen,hash);
     T::add(gm,gm,pub);
     right = p(gm,sig);
     return (right == left);
 }
 
+
+/*--------------------------------------------------------------------------------------
+ * Batch verification
+ *-------------------------------------------------------------------------------------*/
+
+// the miller loop with its arguments in either order
+inline void MillerLoop(Fp12& f, const G1& a, const G2& b) { millerLoop(f,a,b); }
+inline void MillerLoop(Fp12& f, const G2& a, const G1& b) { millerLoop(f,b,a); }
+
+// a random 64 bit batching exponent, a batch holding an invalid signature passes with
+// probability about 2^-64
+inline void BatchWeight(Fr& w)
+{
+    uint8_t b[8];
+    bool ok;
+    rng::Bytes(b,sizeof(b));
+    w.setArray(&ok,b,sizeof(b));
+}
+
+/**
+ * Verify many signatures under one key at once: each equation
+ * e(pub * pubgen^h, sig) = e(pubgen, siggen) is raised to a random weight w & their
+ * product is e(sum w sig, pub) e(sum w h sig - (sum w) siggen, pubgen) = 1, two miller
+ * loops & one final exponentiation for the whole batch
+ * ------------------------------------------
+ */
+template <typename T, typename Z>
+class BatchVerifier {
+public:
+    BatchVerifier(const T& pubgen, const Z& siggen, const T& pub) : pubgen(pubgen), 
+        siggen(siggen), pub(pub), count(0)
+    {
+        sum.clear();
+        shifted.clear();
+        weight.clear();
+    }
+
+    // queue what Verify checks
+    void Add(const Z& sig, const std::string& message) 
+    {
+        STAT_COUNT(HASH,1);
+        Fr hash;
+        hash.setHashOf(message);
+        AddNumber(sig,hash);
+    }
+
+    // queue what DoubleVerify checks
+    void AddDouble(const Z& sig, const std::string& message, const Fr& sec) 
+    {
+        STAT_COUNT(HASH,1);
+        Fr hash;
+        hash.setHashOf(message);
+        Fr::add(hash,hash,sec);
+        AddNumber(sig,hash);
+    }
+
+    // queue the signature of a number
+    void AddNumber(const Z& sig, const Fr& num) 
+    {
+        Fr w, wn;
+        Z tmp;
+        BatchWeight(w);
+        BB_COUNT_MUL(sig,2);
+        Z::mul(tmp,sig,w);
+        Z::add(sum,sum,tmp);
+        Fr::mul(wn,w,num);
+        Z::mul(tmp,sig,wn);
+        Z::add(shifted,shifted,tmp);
+        Fr::add(weight,weight,w);
+        count++;
+    }
+
+    // the product of the miller loops, one after the final exponentiation when the 
+    // batch holds, so batches under other keys can share that exponentiation
+    void Loops(Fp12& f) const 
+    {
+        if(count == 0) {
+            f = 1;
+            return;
+        }
+        STAT_COUNT(PAIRING,2);
+        BB_COUNT_MUL(sum,1);
+        Z rest;
+        Fp12 f2;
+        Z::mul(rest,siggen,weight);
+        Z::sub(rest,shifted,rest);
+        MillerLoop(f,pub,sum);
+        MillerLoop(f2,pubgen,rest);
+        Fp12::mul(f,f,f2);
+    }
+
+    bool Verify() const 
+    {
+        Fp12 f;
+        Loops(f);
+        finalExp(f,f);
+        return f.isOne();
+    }
+
+    size_t Size() const { return count; }
+
+private:
+    T pubgen;
+    Z siggen;
+    T pub;
+    Z sum;      // sum w sig
+    Z shifted;  // sum w h sig
+    Fr weight;  // sum w
+    size_t count;
+};
+
 }}
 
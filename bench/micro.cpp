@@ -0,0 +1,309 @@
+/**
+ * Micro benchmarks for every primitive of the implementation
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ *
+ * usage: micro_bench [--disclosed 0,1,5] [--snips 0,5,20] [--iters N]
+ *                    [--out results.json] [--baseline old.json] [--tolerance 0.1]
+ *                    [--seed phrase]
+ * MESSAGE_COUNT is a build parameter, configure with -DMESSAGE_COUNT=N to sweep it.
+ * A baseline is the json output of an earlier run, any benchmark whose median is
+ * slower than baseline * (1 + tolerance) is reported and fails the run.
+ * A seed makes the random secrets & therefore every proof reproducible.
+ */
+
+#include <mcl/bn256.hpp>
+
+#include <protocol.hpp>
+#include <deid.hpp>
+#include <schnorr.hpp>
+#include <base.hpp>
+#include <rng.hpp>
+#include <transcript.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+using namespace mcl::bn256;
+
+using namespace philips;
+
+struct Result {
+    std::string name;
+    size_t iters;
+    double mean;   // ns
+    double median; // ns
+    double min;    // ns
+};
+
+static std::vector<Result> results;
+static size_t iterations = 50;
+
+//---------------------------------------------------
+// timing
+//---------------------------------------------------
+template <typename F>
+static void Measure(const std::string& name, size_t iters, F fn)
+{
+    fn(); // warm up
+    std::vector<double> ns(iters);
+    for(size_t i = 0; i < iters; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        ns[i] = std::chrono::duration<double,std::nano>(
+            std::chrono::steady_clock::now() - begin).count();
+    }
+    std::sort(ns.begin(),ns.end());
+    double sum = 0;
+    for(double v : ns) sum += v;
+    Result r = { name, iters, sum / iters, ns[iters/2], ns[0] };
+    results.push_back(r);
+    std::cerr << name << ": " << r.median / 1000 << " us" << std::endl;
+}
+
+static std::string Label(const std::string& name, size_t disclosed, size_t snips)
+{
+    return name + "/d=" + std::to_string(disclosed) + "/s=" + std::to_string(snips);
+}
+
+//---------------------------------------------------
+// json in & out
+//---------------------------------------------------
+static std::string Json()
+{
+    std::ostringstream os;
+    os << "{\"message_count\":" << MESSAGE_COUNT << ",\"results\":[";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        os << (i ? "," : "") << "\n{\"name\":\"" << r.name << "\",\"iters\":" << r.iters
+           << ",\"mean_ns\":" << (uint64_t) r.mean
+           << ",\"median_ns\":" << (uint64_t) r.median
+           << ",\"min_ns\":" << (uint64_t) r.min << "}";
+    }
+    os << "\n]}\n";
+    return os.str();
+}
+
+// median per benchmark name from an earlier output of Json()
+static std::vector<std::pair<std::string,double>> ReadBaseline(const std::string& file)
+{
+    std::vector<std::pair<std::string,double>> base;
+    std::ifstream in(file);
+    std::string text((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    const std::string key = "\"name\":\"", med = "\"median_ns\":";
+    size_t pos = 0;
+    while((pos = text.find(key,pos)) != std::string::npos) {
+        pos += key.size();
+        size_t end = text.find('"',pos);
+        size_t m = text.find(med,end);
+        if(end == std::string::npos || m == std::string::npos) break;
+        base.push_back(std::make_pair(text.substr(pos,end-pos),
+            std::strtod(text.c_str()+m+med.size(),nullptr)));
+        pos = m;
+    }
+    return base;
+}
+
+static std::vector<size_t> ParseList(const char* arg)
+{
+    std::vector<size_t> v;
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss,item,',')) v.push_back(std::strtoul(item.c_str(),nullptr,10));
+    return v;
+}
+
+//---------------------------------------------------
+// starting point
+//---------------------------------------------------
+int main(int argc, char** argv)
+{
+    std::vector<size_t> disclosed = {0,1,5};
+    std::vector<size_t> snipcounts = {0,5,20};
+    std::string out, baseline;
+    double tolerance = 0.1;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--disclosed") disclosed = ParseList(argv[i+1]);
+        else if(arg == "--snips") snipcounts = ParseList(argv[i+1]);
+        else if(arg == "--iters") iterations = std::strtoul(argv[i+1],nullptr,10);
+        else if(arg == "--out") out = argv[i+1];
+        else if(arg == "--baseline") baseline = argv[i+1];
+        else if(arg == "--tolerance") tolerance = std::strtod(argv[i+1],nullptr);
+        else if(arg == "--seed") rng::Seed(argv[i+1]);
+    }
+    if(iterations == 0) iterations = 1;
+
+    // setup
+    initPairing();
+    auto p = std::make_shared<const Protocol>();
+    KeyPair kp, kp2;
+    BBKey bbk(p->crv.g2,p->crv.g1);
+    TrustLayer trust;
+    KeyGen(p->crv.g2,kp);
+    KeyGen(p->crv.g2,kp2);
+    trust.pub = kp.pub;
+    trust.bbkeys = {bbk.pub};
+
+    std::array<std::string,MESSAGE_COUNT> record;
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) record[i] = "ATTR" + std::to_string(i);
+    size_t maxsnips = *std::max_element(snipcounts.begin(),snipcounts.end());
+    std::vector<std::string> seq;
+    for(size_t i = 0; i < maxsnips; i++) {
+        seq.push_back("1       " + std::to_string(15850 + 1000*i) +
+            "   .       G       T       .       .       .");
+    }
+
+    // signatures
+    Signature sig;
+    Measure("Sign",iterations,[&]{ Sign(kp,p,record,sig); });
+    Measure("VerifySignature",iterations,[&]{
+        VerifySignature(p->crv.g2,trust.pub,sig,p,record); });
+    for(size_t s : snipcounts) {
+        std::vector<std::string> part(seq.begin(),seq.begin()+s);
+        std::vector<std::pair<std::string,G1>> signedsnips;
+        Measure(Label("SignSnips",0,s),iterations,[&]{
+            signedsnips.clear();
+            SignSnips(part,bbk,sig,signedsnips); });
+    }
+
+    // precomputation
+    DeidRecord drec(kp,bbk,record,p,seq);
+    std::vector<DeidRecord> records = { drec };
+    std::vector<DeidRecord> cohort(16,drec);
+    Measure("VerifyRecords/16",iterations,[&]{
+        VerifyRecords(trust,p,cohort.data(),cohort.size()); });
+    Measure("Prover::Prover",iterations,[&]{ Prover pr(records,trust,p); });
+    Measure("Verifier::Verifier",iterations,[&]{ Verifier v(trust,p); });
+    Prover prover(records,trust,p);
+    Verifier verifier(trust,p);
+    Measure("TableContext::TableContext",iterations,[&]{ TableContext c(*p,kp2.pub); });
+    const TableContext table(*p,kp2.pub);
+
+    // proofs, parameterised by disclosed attributes and snips
+    for(size_t d : disclosed) {
+        if(d > MESSAGE_COUNT) continue;
+        for(size_t s : snipcounts) {
+            std::vector<size_t> disclose, snip;
+            std::vector<std::pair<std::string,size_t>> attrs;
+            std::vector<std::string> snipvalues;
+            for(size_t i = 0; i < d; i++) {
+                disclose.push_back(i);
+                attrs.push_back(std::make_pair(record[i],i));
+            }
+            for(size_t i = 0; i < s; i++) {
+                snip.push_back(i);
+                snipvalues.push_back(seq[i]);
+            }
+            ZkProofKnowledge knowledge;
+            Measure(Label("NewZkProof",d,s),iterations,[&]{
+                knowledge = ZkProofKnowledge();
+                NewZkProof(disclose,snip,table,drec,knowledge,prover); });
+            ZkProof proof = (ZkProof) knowledge;
+            if(!VerifyProof(proof,table,snipvalues,attrs,verifier)) {
+                std::cerr << "invalid proof " << Label("",d,s) << std::endl;
+                return 1;
+            }
+            Measure(Label("VerifyProof",d,s),iterations,[&]{
+                VerifyProof(proof,table,snipvalues,attrs,verifier); });
+            ZkChallengeProof compact;
+            CompactProof(knowledge,compact);
+            Measure(Label("VerifyChallengeProof",d,s),iterations,[&]{
+                VerifyChallengeProof(compact,table,snipvalues,attrs,verifier); });
+            if(s == 0) continue;
+
+            // one snip proof for all snips
+            prover.aggregate_snips = true;
+            Measure(Label("NewZkProof/aggregated",d,s),iterations,[&]{
+                knowledge = ZkProofKnowledge();
+                NewZkProof(disclose,snip,table,drec,knowledge,prover); });
+            prover.aggregate_snips = false;
+            proof = (ZkProof) knowledge;
+            Measure(Label("VerifyProof/aggregated",d,s),iterations,[&]{
+                VerifyProof(proof,table,snipvalues,attrs,verifier); });
+        }
+    }
+
+    // random sampling
+    std::array<Fr,64> scalars;
+    Measure("Fr::setRand",iterations*10,[&]{ scalars[0].setRand(); });
+    Measure("rng::Rand",iterations*10,[&]{ rng::Rand(scalars[0]); });
+    Measure("rng::Rand/64",iterations*10,[&]{ rng::Rand(scalars); });
+
+    // fiat shamir & schnorr
+    Fr c, r1, r2;
+    G1 a, b;
+    Fp12 x, y;
+    rng::Rand(r1);
+    rng::Rand(r2);
+    G1::mul(a,p->crv.g1,r1);
+    G1::mul(b,p->iH,r2);
+    Fp12::pow(x,p->crv.e,r1);
+    Fp12::pow(y,p->crv.e,r2);
+    Measure("FiatShamir<G1>",iterations*10,[&]{ FiatShamir<G1>(a,b,p->iH,c); });
+    Measure("FiatShamir<Fp12>",iterations*10,[&]{ FiatShamir<Fp12>(x,y,p->crv.e,c); });
+    Measure("Transcript<Fp12>",iterations*10,[&]{
+        Transcript t("bench");
+        t.Absorb("x",x);
+        t.Absorb("y",y);
+        t.Absorb("e",p->crv.e);
+        t.Challenge("c",c); });
+    const std::array<Fr,2> resp = {r1, r2};
+    const std::array<G1,2> g1gens = {p->crv.g1, p->iH};
+    const std::array<Fp12,2> gtgens = {x, y};
+    Measure("VerifySchnorrProofG1<2,2>",iterations,[&]{
+        VerifySchnorrProofG1<2,2>(a,b,c,resp.begin(),g1gens.begin()); });
+    Measure("VerifySchnorrProofGt<2,2>",iterations,[&]{
+        VerifySchnorrProofGt<2,2>(x,y,c,resp.begin(),gtgens.begin()); });
+    const std::array<GtFixedBase,2> gttables = {GtFixedBase(x), GtFixedBase(y)};
+    Measure("VerifySchnorrProofGt<2,2>/tabled",iterations,[&]{
+        VerifySchnorrProofGt<2,2,GtFixedBase>(x,y,c,resp.begin(),gttables.begin()); });
+    Measure("Fp12::pow",iterations,[&]{ Fp12::pow(x,p->crv.e,r1); });
+    Measure("GtFixedBase::Pow",iterations,[&]{ gttables[1].Pow(x,r1); });
+
+    // base64
+    for(size_t n : {(size_t) Fp12_size, (size_t) 1 << 16}) {
+        std::vector<uint8_t> raw(n), back;
+        for(size_t i = 0; i < n; i++) raw[i] = (uint8_t) (i * 131 + 7);
+        std::string enc;
+        Measure("base64_encode/" + std::to_string(n),iterations*10,[&]{
+            base64_encode(enc,raw); });
+        Measure("base64_decode/" + std::to_string(n),iterations*10,[&]{
+            base64_decode(back,enc); });
+        std::vector<char> chars(base64_encoded_size(n));
+        Measure("base64_encode_buffer/" + std::to_string(n),iterations*10,[&]{
+            base64_encode(chars.data(),raw.data(),n); });
+        Measure("base64_decode_buffer/" + std::to_string(n),iterations*10,[&]{
+            base64_decode(back.data(),chars.data(),chars.size()); });
+    }
+
+    // report
+    const std::string json = Json();
+    if(out.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(out) << json;
+    }
+
+    int status = 0;
+    if(!baseline.empty()) {
+        for(const std::pair<std::string,double>& b : ReadBaseline(baseline)) {
+            for(const Result& r : results) {
+                if(r.name != b.first || b.second <= 0) continue;
+                double ratio = r.median / b.second;
+                std::cerr << "[baseline] " << r.name << " x" << ratio << std::endl;
+                if(ratio > 1 + tolerance) {
+                    std::cerr << "[regression] " << r.name << std::endl;
+                    status = 2;
+                }
+            }
+        }
+    }
+    return status;
+}
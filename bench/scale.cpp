@@ -0,0 +1,373 @@
+/**
+ * End to end scaling benchmark over a synthetic cohort
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ *
+ * usage: scale_bench [--rows 64,256] [--threads 1,2,4] [--snips 0,5] [--disclosed 0,2]
+ *                    [--variants 40] [--overlap 0.8] [--chunk 8] [--seed phrase]
+ *                    [--out results.json]
+ * The cohort has a categorical distribution per attribute & per patient a genome like
+ * set of variants, overlap of them drawn from a shared population pool & the rest
+ * private. Every rows x threads point issues & ingests the cohort, every snips x
+ * disclosed point under it proves & checks a table of it. Work is split in contiguous
+ * slices over the threads, each thread calls the library in chunks of rows & the
+ * latency percentiles are per chunk call. Peak RSS is that of the process so far.
+ * A seed makes the cohort & the proof randomness reproducible.
+ */
+
+#include <mcl/bn256.hpp>
+
+#include <protocol.hpp>
+#include <deid.hpp>
+#include <codec.hpp>
+#include <rng.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+
+using namespace mcl::bn256;
+
+using namespace philips;
+
+typedef std::pair<size_t,std::vector<size_t>> Request;
+
+struct Result {
+    std::string phase;
+    size_t rows, threads, snips, disclosed;
+    double seconds;             // wall clock of the phase
+    std::vector<double> ns;     // per chunk call, sorted
+    uint64_t bytes;             // output of the phase
+    long peak_rss_kb;
+};
+
+static std::vector<Result> results;
+
+//---------------------------------------------------
+// synthetic cohort
+//---------------------------------------------------
+
+// what the issuer signs for one patient
+struct Patient {
+    std::array<std::string,MESSAGE_COUNT> record;
+    std::vector<std::string> variants;
+};
+
+struct CohortSpec {
+    size_t variants;   // mean variants per patient
+    double overlap;    // fraction of them from the population pool
+    size_t minimum;    // variants every patient has at least
+};
+
+// a categorical attribute with zipf like weights over its categories
+struct Attribute {
+    std::string name;
+    std::vector<std::string> categories;
+    std::discrete_distribution<size_t> pick;
+};
+
+static std::vector<Attribute> Attributes(std::mt19937_64& gen)
+{
+    static const char* names[] = { "sex", "age", "ethnicity", "diagnosis", "site" };
+    std::vector<Attribute> attrs;
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+        Attribute a;
+        a.name = i < 5 ? names[i] : "attr" + std::to_string(i);
+        const size_t k = i == 0 ? 2 : 3 + gen() % 60;
+        std::vector<double> weights;
+        for(size_t c = 0; c < k; c++) {
+            a.categories.push_back(a.name + "_" + std::to_string(c));
+            weights.push_back(1.0 / (c + 1));
+        }
+        a.pick = std::discrete_distribution<size_t>(weights.begin(),weights.end());
+        attrs.push_back(a);
+    }
+    return attrs;
+}
+
+static std::string Variant(std::mt19937_64& gen)
+{
+    static const char bases[] = "ACGT";
+    const size_t ref = gen() % 4, alt = (ref + 1 + gen() % 3) % 4;
+    std::ostringstream os;
+    os << 1 + gen() % 22 << "       " << 10000 + gen() % 200000000 << "   .       "
+       << bases[ref] << "       " << bases[alt] << "       .       .       .";
+    return os.str();
+}
+
+static std::vector<Patient> Cohort(size_t rows, const CohortSpec& spec,
+    std::mt19937_64& gen)
+{
+    std::vector<Attribute> attrs = Attributes(gen);
+
+    // population variants with a skewed allele frequency
+    std::vector<std::string> pool;
+    std::vector<double> freq;
+    for(size_t i = 0; i < 4 * spec.variants + 16; i++) {
+        pool.push_back(Variant(gen));
+        freq.push_back(1.0 / (1 + i / 4));
+    }
+    std::discrete_distribution<size_t> common(freq.begin(),freq.end());
+    std::poisson_distribution<size_t> count((double) spec.variants);
+
+    std::vector<Patient> cohort(rows);
+    for(Patient& pt : cohort) {
+        for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+            pt.record[i] = attrs[i].categories[attrs[i].pick(gen)];
+        }
+        const size_t n = std::max(count(gen),spec.minimum);
+        std::vector<bool> taken(pool.size(),false);
+        size_t shared = 0;
+        while(pt.variants.size() < n) {
+            if(shared == pool.size() ||
+                std::generate_canonical<double,32>(gen) >= spec.overlap) {
+                pt.variants.push_back(Variant(gen));
+                continue;
+            }
+            const size_t v = common(gen);
+            if(taken[v]) continue;
+            taken[v] = true;
+            shared++;
+            pt.variants.push_back(pool[v]);
+        }
+    }
+    return cohort;
+}
+
+//---------------------------------------------------
+// timing
+//---------------------------------------------------
+static double Now()
+{
+    return std::chrono::duration<double,std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long PeakRss()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF,&ru);
+    return ru.ru_maxrss;
+}
+
+// run fn(thread, slice begin, begin, end) over chunks of [0, count) on threads
+// contiguous slices, false when any call fails
+template <typename F>
+static bool Run(Result& r, size_t count, size_t threads, size_t chunk, F fn)
+{
+    std::vector<std::vector<double>> ns(threads);
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> pool;
+    const double begin = Now();
+    for(size_t t = 0; t < threads; t++) {
+        pool.push_back(std::thread([&,t]{
+            const size_t first = count * t / threads, last = count * (t + 1) / threads;
+            for(size_t i = first; i < last; i += chunk) {
+                const size_t end = std::min(last,i + chunk);
+                const double at = Now();
+                if(!fn(t,first,i,end)) ok = false;
+                ns[t].push_back(Now() - at);
+            }
+        }));
+    }
+    for(std::thread& th : pool) th.join();
+    r.seconds = (Now() - begin) / 1e9;
+    for(const std::vector<double>& v : ns) r.ns.insert(r.ns.end(),v.begin(),v.end());
+    std::sort(r.ns.begin(),r.ns.end());
+    r.peak_rss_kb = PeakRss();
+    return ok;
+}
+
+static double Percentile(const std::vector<double>& ns, double q)
+{
+    if(ns.empty()) return 0;
+    return ns[std::min(ns.size() - 1,(size_t) (q * ns.size()))];
+}
+
+static void Report(const Result& r)
+{
+    results.push_back(r);
+    std::cerr << r.phase << " rows " << r.rows << " threads " << r.threads << " snips "
+        << r.snips << " disclosed " << r.disclosed << ": " << r.rows / r.seconds
+        << " rows/s p50 " << Percentile(r.ns,0.5) / 1000 << " us p99 "
+        << Percentile(r.ns,0.99) / 1000 << " us" << std::endl;
+}
+
+//---------------------------------------------------
+// json out
+//---------------------------------------------------
+static std::string Json()
+{
+    std::ostringstream os;
+    os << "{\"message_count\":" << MESSAGE_COUNT << ",\"results\":[";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        os << (i ? "," : "") << "\n{\"phase\":\"" << r.phase << "\",\"rows\":" << r.rows
+           << ",\"threads\":" << r.threads << ",\"snips\":" << r.snips
+           << ",\"disclosed\":" << r.disclosed
+           << ",\"rows_per_s\":" << r.rows / r.seconds
+           << ",\"p50_ns\":" << (uint64_t) Percentile(r.ns,0.5)
+           << ",\"p90_ns\":" << (uint64_t) Percentile(r.ns,0.9)
+           << ",\"p99_ns\":" << (uint64_t) Percentile(r.ns,0.99)
+           << ",\"max_ns\":" << (uint64_t) (r.ns.empty() ? 0 : r.ns.back())
+           << ",\"peak_rss_kb\":" << r.peak_rss_kb << ",\"bytes\":" << r.bytes << "}";
+    }
+    os << "\n]}\n";
+    return os.str();
+}
+
+static std::vector<size_t> ParseList(const char* arg)
+{
+    std::vector<size_t> v;
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss,item,',')) v.push_back(std::strtoul(item.c_str(),nullptr,10));
+    return v;
+}
+
+// the bytes an issuer hands over for a record, values, signature & signed snips
+static uint64_t IssuedBytes(const DeidRecord& r)
+{
+    uint64_t bytes = G1_size + 4 * Fr_size;
+    for(const std::string& v : r.record) bytes += v.size();
+    for(const std::pair<std::string,G1>& s : r.snips) bytes += s.first.size() + G1_size;
+    return bytes;
+}
+
+//---------------------------------------------------
+// starting point
+//---------------------------------------------------
+int main(int argc, char** argv)
+{
+    std::vector<size_t> rowcounts = {64,256};
+    std::vector<size_t> threadcounts = {1,2,4};
+    std::vector<size_t> snipcounts = {0,5};
+    std::vector<size_t> disclosed = {0,2};
+    CohortSpec spec = { 40, 0.8, 0 };
+    size_t chunk = 8;
+    std::string out, seed;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--rows") rowcounts = ParseList(argv[i+1]);
+        else if(arg == "--threads") threadcounts = ParseList(argv[i+1]);
+        else if(arg == "--snips") snipcounts = ParseList(argv[i+1]);
+        else if(arg == "--disclosed") disclosed = ParseList(argv[i+1]);
+        else if(arg == "--variants") spec.variants = std::strtoul(argv[i+1],nullptr,10);
+        else if(arg == "--overlap") spec.overlap = std::strtod(argv[i+1],nullptr);
+        else if(arg == "--chunk") chunk = std::strtoul(argv[i+1],nullptr,10);
+        else if(arg == "--out") out = argv[i+1];
+        else if(arg == "--seed") seed = argv[i+1];
+    }
+    if(chunk == 0) chunk = 1;
+    spec.minimum = *std::max_element(snipcounts.begin(),snipcounts.end());
+    if(!seed.empty()) rng::Seed(seed);
+    std::seed_seq seq(seed.begin(),seed.end());
+    std::mt19937_64 gen(seq);
+
+    // setup
+    initPairing();
+    auto p = std::make_shared<const Protocol>();
+    KeyPair kp;
+    BBKey bbk(p->crv.g2,p->crv.g1);
+    TrustLayer trust;
+    KeyGen(p->crv.g2,kp);
+    trust.pub = kp.pub;
+    trust.bbkeys = {bbk.pub};
+    const Verifier verifier(trust,p);
+
+    for(size_t rows : rowcounts) {
+        const std::vector<Patient> cohort = Cohort(rows,spec,gen);
+        for(size_t threads : threadcounts) {
+            if(threads == 0) continue;
+
+            // issuance, signatures over the records & their variants
+            std::vector<DeidRecord> records(rows);
+            Result issue = { "issue", rows, threads, 0, 0, 0, {}, 0, 0 };
+            Run(issue,rows,threads,chunk,[&](size_t,size_t,size_t b,size_t e){
+                for(size_t i = b; i < e; i++) {
+                    records[i] = DeidRecord(kp,bbk,cohort[i].record,p,cohort[i].variants);
+                }
+                return true;
+            });
+            for(const DeidRecord& r : records) issue.bytes += IssuedBytes(r);
+            Report(issue);
+
+            // ingestion, batch verification of what was issued
+            Result ingest = { "ingest", rows, threads, 0, 0, 0, {}, 0, 0 };
+            if(!Run(ingest,rows,threads,chunk,[&](size_t,size_t,size_t b,size_t e){
+                return VerifyRecords(trust,p,records.data() + b,e - b); })) {
+                std::cerr << "invalid records" << std::endl;
+                return 1;
+            }
+            Report(ingest);
+
+            // a prover per thread, outside of the timing
+            std::vector<std::unique_ptr<Prover>> provers;
+            for(size_t t = 0; t < threads; t++) {
+                provers.push_back(std::unique_ptr<Prover>(new Prover(records,trust,p)));
+            }
+            for(size_t s : snipcounts) {
+                for(size_t d : disclosed) {
+                    if(d > MESSAGE_COUNT) continue;
+                    std::vector<Request> discl(rows), disclsnip(rows);
+                    for(size_t i = 0; i < rows; i++) {
+                        discl[i].first = disclsnip[i].first = i;
+                        for(size_t n = 0; n < d; n++) discl[i].second.push_back(n);
+                        for(size_t n = 0; n < s; n++) disclsnip[i].second.push_back(n);
+                    }
+
+                    // every thread proves its slice under the same table key
+                    const std::string phrase = "scale " + std::to_string(rows) + " " +
+                        std::to_string(s) + " " + std::to_string(d);
+                    Result prove = { "NewTable", rows, threads, s, d, 0, {}, 0, 0 };
+                    Run(prove,rows,threads,chunk,[&](size_t t,size_t f,size_t b,size_t e){
+                        Prover& pr = *provers[t];
+                        if(b == f) {
+                            NewTable(phrase,pr,&discl[b],&disclsnip[b],e - b);
+                            return true;
+                        }
+                        return AppendRows(pr,&discl[b],&disclsnip[b],e - b);
+                    });
+                    std::vector<Row> table;
+                    for(const std::unique_ptr<Prover>& pr : provers) {
+                        if(!pr->table) continue;
+                        const std::vector<Row>& part = pr->table->deidrows;
+                        table.insert(table.end(),part.begin(),part.end());
+                    }
+                    Table key(0,phrase);
+                    std::string encoded;
+                    EncodeTable(encoded,key.tablekey,table.data(),table.size());
+                    prove.bytes = encoded.size();
+                    Report(prove);
+
+                    // the threads share one verifier, rowIds are checked unique per chunk only
+                    Result check = { "CheckTable", rows, threads, s, d, 0, {}, 0, 0 };
+                    if(!Run(check,rows,threads,chunk,[&](size_t,size_t,size_t b,size_t e){
+                        return CheckTable(verifier,key.tablekey,&table[b],e - b); })) {
+                        std::cerr << "invalid table " << phrase << std::endl;
+                        return 1;
+                    }
+                    Report(check);
+                }
+            }
+        }
+    }
+
+    // report
+    const std::string json = Json();
+    if(out.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(out) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * Cache of successful row verifications
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "cache.hpp"
+#include "codec.hpp"
+#include "transcript.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+#include <cybozu/sha2.hpp>
+
+#define CACHE_MAGIC "zkdeid-cache-1\n"
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Keys
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * The digest of the verification parameters: VERIFY_VERSION, protocol, trust layer &
+ * tablekey
+ * ------------------------------------------
+ */
+Digest philips::CacheContext(const Verifier& v, const G2& tablekey)
+{
+    Transcript t("zkdeid verify cache");
+    t.Absorb("version",(uint64_t) VERIFY_VERSION);
+    AbsorbSetup(t,*v.protocol,v.trust);
+    t.Absorb("tablekey",tablekey);
+
+    Fr c;
+    Digest d;
+    t.Challenge("context",c);
+    c.serialize(d.data(),d.size());
+    return d;
+}
+
+/**
+ * The cache key of a row under a context
+ * ------------------------------------------
+ */
+Digest philips::CacheKey(const Digest& context, const Row& row)
+{
+    std::string bytes;
+    EncodeRow(bytes,row);
+    Digest d;
+    cybozu::Sha256 h;
+    h.update(context.data(),context.size());
+    h.digest(d.data(),d.size(),bytes.data(),bytes.size());
+    return d;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Cache
+ *-------------------------------------------------------------------------------------*/
+
+static std::string Key(const Digest& d)
+{
+    return std::string(reinterpret_cast<const char*>(d.data()),d.size());
+}
+
+void VerifyCache::Touch(const std::string& key)
+{
+    auto it = index.find(key);
+    if(it != index.end()) {
+        order.splice(order.end(),order,it->second);
+        return;
+    }
+    if(capacity == 0) return;
+    if(index.size() == capacity) {
+        index.erase(order.front());
+        order.pop_front();
+    }
+    order.push_back(key);
+    index[key] = std::prev(order.end());
+}
+
+bool VerifyCache::Contains(const Digest& key)
+{
+    std::lock_guard<std::mutex> lk(m);
+    auto it = index.find(Key(key));
+    if(it == index.end()) return false;
+    order.splice(order.end(),order,it->second);
+    return true;
+}
+
+void VerifyCache::Insert(const Digest& key)
+{
+    std::lock_guard<std::mutex> lk(m);
+    Touch(Key(key));
+}
+
+size_t VerifyCache::Size() const
+{
+    std::lock_guard<std::mutex> lk(m);
+    return index.size();
+}
+
+bool VerifyCache::Save(const std::string& path) const
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::lock_guard<std::mutex> lk(m);
+        std::ofstream out(tmp,std::ios::binary | std::ios::trunc);
+        out << CACHE_MAGIC;
+        for(const std::string& key : order) out.write(key.data(),key.size());
+        if(!out.flush()) return false;
+    }
+    return rename(tmp.c_str(),path.c_str()) == 0;
+}
+
+// a missing, foreign or truncated file leaves the cache as it was
+bool VerifyCache::Load(const std::string& path)
+{
+    std::ifstream in(path,std::ios::binary);
+    std::string magic(sizeof(CACHE_MAGIC) - 1,'\0');
+    if(!in.read(&magic[0],magic.size()) || magic != CACHE_MAGIC) return false;
+    std::vector<std::string> keys;
+    std::string key(32,'\0');
+    while(in.read(&key[0],key.size())) keys.push_back(key);
+    if(in.gcount() != 0) return false;
+    std::lock_guard<std::mutex> lk(m);
+    for(const std::string& k : keys) Touch(k);
+    return true;
+}
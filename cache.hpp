@@ -0,0 +1,78 @@
+#pragma once
+/**
+ * Cache of successful row verifications
+ * keyed by a digest of the encoded row & everything its verification depends on, a hit
+ * means the very same row was proven valid under the very same parameters
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+//philips
+#include "checkpoint.hpp"
+#include "deid.hpp"
+
+// the meaning of a cache hit: bump whenever VerifyProof accepts a different set of rows
+// or the row encoding changes, so keys of an older verifier stop matching
+#define VERIFY_VERSION 1
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * Keys
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * The digest of the verification parameters: VERIFY_VERSION, protocol, trust layer &
+ * tablekey
+ * ------------------------------------------
+ */
+Digest CacheContext(const Verifier& v, const G2& tablekey);
+
+/**
+ * The cache key of a row under a context
+ * ------------------------------------------
+ */
+Digest CacheKey(const Digest& context, const Row& row);
+
+
+/*--------------------------------------------------------------------------------------
+ * Cache
+ * least recently used eviction at a fixed capacity, safe to share between threads
+ *-------------------------------------------------------------------------------------*/
+
+class VerifyCache {
+public:
+    explicit VerifyCache(size_t capacity) : capacity(capacity) {}
+
+    bool Contains(const Digest& key);  // a hit counts as a use
+    void Insert(const Digest& key);
+    size_t Size() const;
+
+    /**
+     * Persist the keys, most recently used last, Save replaces the file atomically &
+     * Load takes the keys of a file only when all of it reads
+     * ------------------------------------------
+     */
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path);
+private:
+    void Touch(const std::string& key);
+
+    size_t capacity;
+    mutable std::mutex m;
+    std::list<std::string> order;   // least recently used first
+    std::unordered_map<std::string,std::list<std::string>::iterator> index;
+};
+
+}
@@ -0,0 +1,145 @@
+/**
+ * Verified prefix of a growing table
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "checkpoint.hpp"
+#include "codec.hpp"
+#include "torus.hpp"
+
+#include <cybozu/sha2.hpp>
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Merkle frontier
+ *-------------------------------------------------------------------------------------*/
+
+Digest MerkleFrontier::Leaf(const std::string& data)
+{
+    Digest d;
+    cybozu::Sha256 h;
+    const uint8_t prefix = 0;
+    h.update(&prefix,1);
+    h.digest(d.data(),d.size(),data.data(),data.size());
+    return d;
+}
+
+Digest MerkleFrontier::Node(const Digest& left, const Digest& right)
+{
+    Digest d;
+    cybozu::Sha256 h;
+    const uint8_t prefix = 1;
+    h.update(&prefix,1);
+    h.update(left.data(),left.size());
+    h.digest(d.data(),d.size(),right.data(),right.size());
+    return d;
+}
+
+// merge with the subtrees of equal height, as a binary increment of the count
+void MerkleFrontier::Append(const Digest& leaf)
+{
+    Digest node = leaf;
+    size_t height = 0;
+    while((count >> height) & 1) {
+        node = Node(subtrees[height],node);
+        height++;
+    }
+    if(subtrees.size() <= height) subtrees.resize(height + 1);
+    subtrees[height] = node;
+    count++;
+}
+
+// the subtrees fold from the smallest up, which is the RFC 6962 split at powers of two
+Digest MerkleFrontier::Root() const
+{
+    Digest root;
+    if(count == 0) {
+        cybozu::Sha256 h;
+        h.digest(root.data(),root.size(),"",0);
+        return root;
+    }
+    bool first = true;
+    for(size_t i = 0; i < subtrees.size(); i++) {
+        if(!((count >> i) & 1)) continue;
+        root = first ? subtrees[i] : Node(subtrees[i],root);
+        first = false;
+    }
+    return root;
+}
+
+bool MerkleFrontier::Restore(uint64_t n, const std::vector<Digest>& trees)
+{
+    size_t bits = 0;
+    while(bits < 64 && (n >> bits) != 0) bits++;
+    if(trees.size() != bits) return false;
+    count = n;
+    subtrees = trees;
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Checkpoint
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * The leaf of a row, the hash of its encoding
+ * ------------------------------------------
+ */
+Digest philips::RowLeaf(const Row& row)
+{
+    std::string bytes;
+    EncodeRow(bytes,row);
+    return MerkleFrontier::Leaf(bytes);
+}
+
+/**
+ * The fingerprint of a rowId, the hash of its compressed encoding
+ * ------------------------------------------
+ */
+Digest philips::RowFingerprint(const Fp12& rowId)
+{
+    char buf[Gt_compressed_size];
+    Digest d;
+    CompressGt(rowId,buf);
+    cybozu::Sha256 h;
+    h.digest(d.data(),d.size(),buf,sizeof(buf));
+    return d;
+}
+
+static std::string RowKey(const Fp12& rowId)
+{
+    const Digest d = RowFingerprint(rowId);
+    return std::string(reinterpret_cast<const char*>(d.data()),d.size());
+}
+
+/**
+ * Verify rows appended to a table & extend the checkpoint with them
+ * ------------------------------------------
+ */
+bool philips::CheckAppend(const Verifier& v, TableCheckpoint& cp, const Row* rows,
+    size_t rowcount)
+{
+    TableContext table(*v.protocol,cp.tablekey,TableContext::Window(rowcount));
+    std::unordered_set<std::string> fresh;
+    std::vector<Digest> leaves;
+    fresh.reserve(rowcount);
+    leaves.reserve(rowcount);
+    for(size_t i = 0; i < rowcount; i++) {
+        const Row& r = *(rows+i);
+        std::string key = RowKey(r.proof.rowId);
+        if(cp.ids.count(key) || !fresh.insert(key).second) return false;
+        table.AddKeys(v,r.proof.issuer,r.proof.bbkey,!r.snips.empty());
+        if(!VerifyProof(r.proof,table,r.snips,r.disclosed,v)) return false;
+        leaves.push_back(RowLeaf(r));
+    }
+
+    // all rows hold, commit them
+    for(const Digest& leaf : leaves) cp.rows.Append(leaf);
+    cp.ids.insert(fresh.begin(),fresh.end());
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+/**
+ * Verified prefix of a growing table
+ * a Merkle frontier over the verified rows & the rowIds seen so far, so appended rows
+ * are verified without revisiting the prefix
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+//philips
+#include "deid.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+typedef std::array<uint8_t,32> Digest;
+
+/*--------------------------------------------------------------------------------------
+ * Merkle frontier
+ * the RFC 6962 tree hash, leaves H(0 || data) & nodes H(1 || left || right), kept as
+ * the roots of the complete subtrees, one per set bit of the leaf count
+ *-------------------------------------------------------------------------------------*/
+
+class MerkleFrontier {
+public:
+    MerkleFrontier() : count(0) {}
+
+    void Append(const Digest& leaf);
+    Digest Root() const;
+    uint64_t Count() const { return count; }
+
+    // for persistence, Restore checks that the subtrees fit the count
+    const std::vector<Digest>& Subtrees() const { return subtrees; }
+    bool Restore(uint64_t count, const std::vector<Digest>& subtrees);
+
+    static Digest Leaf(const std::string& data);
+    static Digest Node(const Digest& left, const Digest& right);
+private:
+    uint64_t count;
+    std::vector<Digest> subtrees; // by height, meaningful where the bit of count is set
+};
+
+
+/*--------------------------------------------------------------------------------------
+ * Checkpoint
+ *-------------------------------------------------------------------------------------*/
+
+// the state of a table after its first rows.Count() rows have been verified
+struct TableCheckpoint {
+    G2 tablekey;
+    MerkleFrontier rows;                  // over the encoded rows
+    std::unordered_set<std::string> ids;  // RowFingerprint of the rowIds
+
+    explicit TableCheckpoint(const G2& tablekey) : tablekey(tablekey) {}
+    TableCheckpoint() {}
+};
+
+/**
+ * The fingerprint of a rowId, the hash of its compressed encoding
+ * ------------------------------------------
+ */
+Digest RowFingerprint(const Fp12& rowId);
+
+/**
+ * The leaf of a row, the hash of its encoding
+ * ------------------------------------------
+ */
+Digest RowLeaf(const Row& row);
+
+/**
+ * Verify rows appended to a table & extend the checkpoint with them, the rowIds have
+ * to be new to the checkpoint, on failure the checkpoint is left as it was
+ * ------------------------------------------
+ */
+bool CheckAppend(const Verifier& v, TableCheckpoint& cp, const Row* rows,
+    size_t rowcount);
+
+}
@@ -0,0 +1,576 @@
+/**
+ * Binary marshalling of tables, rows and proofs
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "codec.hpp"
+#include "subgroup.hpp"
+
+#include <cstring>
+
+using namespace mcl::bn256;
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Primitives
+ *-------------------------------------------------------------------------------------*/
+
+void philips::PutU32(std::string& out, size_t v)
+{
+    char b[4] = { (char) (v & 0xff), (char) ((v >> 8) & 0xff),
+        (char) ((v >> 16) & 0xff), (char) ((v >> 24) & 0xff) };
+    out.append(b,4);
+}
+
+bool philips::GetU32(const char*& cur, const char* end, size_t& v)
+{
+    if(end - cur < 4) return false;
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(cur);
+    v = (size_t) b[0] | ((size_t) b[1] << 8) | ((size_t) b[2] << 16) |
+        ((size_t) b[3] << 24);
+    cur += 4;
+    return true;
+}
+
+// a count of elements that are at least min bytes each must fit the remaining input
+static bool GetCount(const char*& cur, const char* end, size_t min, size_t& v)
+{
+    return GetU32(cur,end,v) && v <= (size_t) (end - cur) / min;
+}
+
+static bool GetFlag(const char*& cur, const char* end, bool& flag)
+{
+    size_t v;
+    if(!GetU32(cur,end,v) || v > 1) return false;
+    flag = v == 1;
+    return true;
+}
+
+static bool GetId(const char*& cur, const char* end, uint32_t& id)
+{
+    size_t v;
+    if(!GetU32(cur,end,v)) return false;
+    id = (uint32_t) v;
+    return true;
+}
+
+static void PutString(std::string& out, const std::string& s)
+{
+    PutU32(out,s.size());
+    out.append(s);
+}
+
+static bool GetString(const char*& cur, const char* end, std::string& s)
+{
+    size_t n;
+    if(!GetCount(cur,end,1,n)) return false;
+    s.assign(cur,n);
+    cur += n;
+    return true;
+}
+
+// Gt elements use the torus encoding at half the size
+static void PutEl(std::string& out, const Fp12& el)
+{
+    char buf[Gt_compressed_size];
+    CompressGt(el,buf);
+    out.append(buf,sizeof(buf));
+}
+
+static bool GetEl(const char*& cur, const char* end, Fp12& el)
+{
+    if((size_t) (end - cur) < Gt_compressed_size) return false;
+    if(!DecompressGt(el,cur)) return false;
+    cur += Gt_compressed_size;
+    return true;
+}
+
+template<typename T>
+static size_t WireSize(const T& el)
+{
+    return BytesSize(el);
+}
+
+static size_t WireSize(const Fp12&)
+{
+    return Gt_compressed_size;
+}
+
+template<typename T>
+static void PutEl(std::string& out, const T& el)
+{
+    char buf[Fp12_size];
+    const size_t n = el.serialize(buf,BytesSize(el));
+    out.append(buf,n);
+}
+
+template<typename T>
+static bool GetEl(const char*& cur, const char* end, T& el)
+{
+    const size_t N = BytesSize(el);
+    if((size_t) (end - cur) < N) return false;
+    if(el.deserialize(cur,N) != N) return false;
+    cur += N;
+    return true;
+}
+
+template<typename T>
+static void PutVec(std::string& out, const std::vector<T>& v)
+{
+    PutU32(out,v.size());
+    for(const T& el : v) PutEl(out,el);
+}
+
+template<typename T>
+static bool GetVec(const char*& cur, const char* end, std::vector<T>& v)
+{
+    size_t n;
+    if(!GetCount(cur,end,WireSize(T()),n)) return false;
+    v.resize(n);
+    for(T& el : v) {
+        if(!GetEl(cur,end,el)) return false;
+    }
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Proofs
+ *-------------------------------------------------------------------------------------*/
+
+static void EncodeProof(std::string& out, const ZkProof& proof)
+{
+    PutU32(out,proof.aggregated);
+    PutU32(out,proof.issuer);
+    PutU32(out,proof.bbkey);
+    PutEl(out,proof.cmtA);
+    PutEl(out,proof.cmtB);
+    PutEl(out,proof.cmtPf1);
+    PutEl(out,proof.cmtBc);
+    PutEl(out,proof.cmtPf2);
+    PutEl(out,proof.cmtPf2b);
+    PutEl(out,proof.cmtPf3);
+    PutEl(out,proof.cmtPf4);
+    PutVec(out,proof.SiV);
+    PutVec(out,proof.cmtSnip);
+    PutEl(out,proof.rowId);
+    PutEl(out,proof.cmtU);
+    PutEl(out,proof.cmtL);
+    PutEl(out,proof.cmtY);
+    for(const Fr& el : proof.response) PutEl(out,el);
+    for(const Fr& el : proof.row_response) PutEl(out,el);
+    PutVec(out,proof.snip_response);
+}
+
+/**
+ * Bytes EncodeRow spends on the proof of a row
+ * ------------------------------------------
+ */
+size_t philips::EncodedProofSize(size_t snipcount, size_t messagecount, bool aggregated)
+{
+    const size_t responses = RESPONSE_COUNT - MESSAGE_COUNT + messagecount;
+    const size_t blinds = aggregated ? 1 : snipcount;
+    return 9 * G1_size + 3 * Gt_compressed_size + (responses + ROW_RESPONSE_COUNT) *
+        Fr_size + 6 * 4 + snipcount * G1_size + blinds * Gt_compressed_size +
+        (blinds + 2) * Fr_size;
+}
+
+static void EncodeProof(std::string& out, const ZkChallengeProof& proof)
+{
+    PutU32(out,proof.aggregated);
+    PutU32(out,proof.issuer);
+    PutU32(out,proof.bbkey);
+    PutEl(out,proof.cmtA);
+    PutEl(out,proof.cmtB);
+    PutEl(out,proof.cmtBc);
+    PutVec(out,proof.SiV);
+    PutEl(out,proof.rowId);
+    PutEl(out,proof.cmtU);
+    PutEl(out,proof.cmtL);
+    PutEl(out,proof.challenge);
+    PutEl(out,proof.row_challenge);
+    PutEl(out,proof.snip_challenge);
+    for(const Fr& el : proof.response) PutEl(out,el);
+    for(const Fr& el : proof.row_response) PutEl(out,el);
+    PutVec(out,proof.snip_response);
+}
+
+/**
+ * Bytes EncodeCompactRow spends on the proof of a row
+ * ------------------------------------------
+ */
+size_t philips::EncodedChallengeProofSize(size_t snipcount, size_t messagecount,
+    bool aggregated)
+{
+    const size_t responses = RESPONSE_COUNT - MESSAGE_COUNT + messagecount;
+    const size_t blinds = aggregated ? 1 : snipcount;
+    return 5 * G1_size + Gt_compressed_size + (3 + responses + ROW_RESPONSE_COUNT) *
+        Fr_size
+        + 5 * 4 + snipcount * G1_size + (blinds + 2) * Fr_size;
+}
+
+static bool DecodeProof(const char*& cur, const char* end, ZkProof& proof)
+{
+    if(!(GetFlag(cur,end,proof.aggregated) && GetId(cur,end,proof.issuer) &&
+        GetId(cur,end,proof.bbkey) && GetEl(cur,end,proof.cmtA) &&
+        GetEl(cur,end,proof.cmtB) && GetEl(cur,end,proof.cmtPf1) && GetEl(cur,end,proof.cmtBc) &&
+        GetEl(cur,end,proof.cmtPf2) && GetEl(cur,end,proof.cmtPf2b) &&
+        GetEl(cur,end,proof.cmtPf3) && GetEl(cur,end,proof.cmtPf4) &&
+        GetVec(cur,end,proof.SiV) && GetVec(cur,end,proof.cmtSnip) &&
+        GetEl(cur,end,proof.rowId) && GetEl(cur,end,proof.cmtU) &&
+        GetEl(cur,end,proof.cmtL) && GetEl(cur,end,proof.cmtY))) {
+        return false;
+    }
+    for(Fr& el : proof.response) {
+        if(!GetEl(cur,end,el)) return false;
+    }
+    for(Fr& el : proof.row_response) {
+        if(!GetEl(cur,end,el)) return false;
+    }
+    return GetVec(cur,end,proof.snip_response);
+}
+
+static bool DecodeProof(const char*& cur, const char* end, ZkChallengeProof& proof)
+{
+    if(!(GetFlag(cur,end,proof.aggregated) && GetId(cur,end,proof.issuer) &&
+        GetId(cur,end,proof.bbkey) && GetEl(cur,end,proof.cmtA) &&
+        GetEl(cur,end,proof.cmtB) && GetEl(cur,end,proof.cmtBc) && GetVec(cur,end,proof.SiV) &&
+        GetEl(cur,end,proof.rowId) && GetEl(cur,end,proof.cmtU) &&
+        GetEl(cur,end,proof.cmtL) && GetEl(cur,end,proof.challenge) &&
+        GetEl(cur,end,proof.row_challenge) && GetEl(cur,end,proof.snip_challenge))) {
+        return false;
+    }
+    for(Fr& el : proof.response) {
+        if(!GetEl(cur,end,el)) return false;
+    }
+    for(Fr& el : proof.row_response) {
+        if(!GetEl(cur,end,el)) return false;
+    }
+    return GetVec(cur,end,proof.snip_response);
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Rows & Tables
+ *-------------------------------------------------------------------------------------*/
+
+// the disclosed values & snips, shared by both row forms
+template<typename R>
+static void EncodeRowHead(std::string& out, const R& row)
+{
+    PutU32(out,row.disclosed.size());
+    for(const std::pair<std::string,size_t>& d : row.disclosed) {
+        PutString(out,d.first);
+        PutU32(out,d.second);
+    }
+    PutU32(out,row.snips.size());
+    for(const std::string& s : row.snips) PutString(out,s);
+}
+
+template<typename R>
+static bool DecodeRowHead(const char*& cur, const char* end, R& row)
+{
+    size_t n;
+    if(!GetCount(cur,end,8,n)) return false;
+    row.disclosed.resize(n);
+    for(std::pair<std::string,size_t>& d : row.disclosed) {
+        if(!GetString(cur,end,d.first) || !GetU32(cur,end,d.second)) return false;
+    }
+    if(!GetCount(cur,end,4,n)) return false;
+    row.snips.resize(n);
+    for(std::string& s : row.snips) {
+        if(!GetString(cur,end,s)) return false;
+    }
+    return true;
+}
+
+/**
+ * Append a row to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeRow(std::string& out, const Row& row)
+{
+    EncodeRowHead(out,row);
+    EncodeProof(out,row.proof);
+}
+
+
+/**
+ * Read a row from [cur,end)
+ * ------------------------------------------
+ */
+bool philips::DecodeRow(const char*& cur, const char* end, Row& row)
+{
+    return DecodeRowHead(cur,end,row) && DecodeProof(cur,end,row.proof);
+}
+
+
+/**
+ * Append a row in challenge form to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeCompactRow(std::string& out, const CompactRow& row)
+{
+    EncodeRowHead(out,row);
+    EncodeProof(out,row.proof);
+}
+
+
+/**
+ * Read a row in challenge form from [cur,end)
+ * ------------------------------------------
+ */
+bool philips::DecodeCompactRow(const char*& cur, const char* end, CompactRow& row)
+{
+    return DecodeRowHead(cur,end,row) && DecodeProof(cur,end,row.proof);
+}
+
+
+/**
+ * Append a table to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeTable(std::string& out, const G2& tablekey, const Row* rows,
+    size_t rowcount)
+{
+    PutEl(out,tablekey);
+    PutU32(out,rowcount);
+    for(size_t i = 0; i < rowcount; i++) {
+        EncodeRow(out,*(rows+i));
+    }
+}
+
+
+/**
+ * Read a table from [cur,end)
+ * ------------------------------------------
+ */
+bool philips::DecodeTable(const char*& cur, const char* end, Table& table)
+{
+    size_t n;
+    if(!GetEl(cur,end,table.tablekey) || !GetCount(cur,end,8,n)) return false;
+    table.deidrows.resize(n);
+    for(Row& r : table.deidrows) {
+        if(!DecodeRow(cur,end,r)) return false;
+    }
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Group membership
+ *-------------------------------------------------------------------------------------*/
+
+static void AddProof(SubgroupCheck& check, const ZkProof& proof)
+{
+    check.Add(proof.cmtA);
+    check.Add(proof.cmtB);
+    check.Add(proof.cmtPf1);
+    check.Add(proof.cmtBc);
+    check.Add(proof.cmtPf2);
+    check.Add(proof.cmtPf2b);
+    check.Add(proof.cmtPf3);
+    check.Add(proof.cmtPf4);
+    check.Add(proof.SiV);
+    check.Add(proof.cmtSnip);
+    check.Add(proof.rowId);
+    check.Add(proof.cmtU);
+    check.Add(proof.cmtL);
+    check.Add(proof.cmtY);
+}
+
+static void AddProof(SubgroupCheck& check, const ZkChallengeProof& proof)
+{
+    check.Add(proof.cmtA);
+    check.Add(proof.cmtB);
+    check.Add(proof.cmtBc);
+    check.Add(proof.SiV);
+    check.Add(proof.rowId);
+    check.Add(proof.cmtU);
+    check.Add(proof.cmtL);
+}
+
+template<typename R>
+static bool CheckRows(const G2& tablekey, const R* rows, size_t rowcount)
+{
+    SubgroupCheck check;
+    check.Add(tablekey);
+    for(size_t i = 0; i < rowcount; i++) AddProof(check,rows[i].proof);
+    return check.Check();
+}
+
+/**
+ * Check every group element of a table is in its group
+ * ------------------------------------------
+ */
+bool philips::ValidateRows(const G2& tablekey, const Row* rows, size_t rowcount)
+{
+    return CheckRows(tablekey,rows,rowcount);
+}
+
+bool philips::ValidateRows(const G2& tablekey, const CompactRow* rows, size_t rowcount)
+{
+    return CheckRows(tablekey,rows,rowcount);
+}
+
+
+/**
+ * Read a table from outside & check its group elements
+ * ------------------------------------------
+ */
+bool philips::DecodeUntrustedTable(const char*& cur, const char* end, Table& table)
+{
+    return DecodeTable(cur,end,table) &&
+        ValidateRows(table.tablekey,table.deidrows.data(),table.deidrows.size());
+}
+
+
+static bool Skip(const char*& cur, const char* end, size_t n)
+{
+    if((size_t) (end - cur) < n) return false;
+    cur += n;
+    return true;
+}
+
+// the layout of EncodeRowHead, then a proof of the length EncodedProofSize gives for its
+// flag & snip count, the counts it holds have to agree with that length
+static bool SkipRow(const char*& cur, const char* end)
+{
+    size_t n, len;
+    if(!GetCount(cur,end,8,n)) return false;
+    for(size_t i = 0; i < n; i++) {
+        if(!GetCount(cur,end,1,len) || !Skip(cur,end,len + 4)) return false;
+    }
+    if(!GetCount(cur,end,4,n)) return false;
+    for(size_t i = 0; i < n; i++) {
+        if(!GetCount(cur,end,1,len) || !Skip(cur,end,len)) return false;
+    }
+
+    const char* p = cur;
+    bool aggregated;
+    size_t snips, blinds, responses;
+    if(!GetFlag(p,end,aggregated) ||
+        !Skip(p,end,2 * 4 + 6 * G1_size + 2 * Gt_compressed_size) ||
+        !GetCount(p,end,G1_size,snips) || !Skip(p,end,snips * G1_size) ||
+        !GetCount(p,end,Gt_compressed_size,blinds)) {
+        return false;
+    }
+    if(blinds != (aggregated ? 1 : snips)) return false;
+    const size_t size = EncodedProofSize(snips,MESSAGE_COUNT,aggregated);
+    if((size_t) (end - cur) < size) return false;
+    p = cur + size - (blinds + 2) * Fr_size - 4;
+    if(!GetU32(p,end,responses) || responses != blinds + 2) return false;
+    cur += size;
+    return true;
+}
+
+/**
+ * Index a table from [cur,end) without decoding its rows
+ * ------------------------------------------
+ */
+bool philips::IndexTable(const char*& cur, const char* end, G2& tablekey,
+    std::vector<size_t>& offsets)
+{
+    const char* begin = cur;
+    size_t n;
+    if(!GetEl(cur,end,tablekey) || !GetCount(cur,end,8,n)) return false;
+    offsets.resize(n + 1);
+    for(size_t i = 0; i < n; i++) {
+        offsets[i] = cur - begin;
+        if(!SkipRow(cur,end)) return false;
+    }
+    offsets[n] = cur - begin;
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Trust
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * Append the public trust information to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeTrust(std::string& out, const TrustLayer& trust)
+{
+    PutEl(out,trust.pub);
+    PutVec(out,trust.bbkeys);
+    PutVec(out,trust.issuers);
+}
+
+
+/**
+ * Read the public trust information from [cur,end)
+ * ------------------------------------------
+ */
+bool philips::DecodeTrust(const char*& cur, const char* end, TrustLayer& trust)
+{
+    return GetEl(cur,end,trust.pub) && GetVec(cur,end,trust.bbkeys) &&
+        GetVec(cur,end,trust.issuers);
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Checkpoints
+ *-------------------------------------------------------------------------------------*/
+
+static void PutDigest(std::string& out, const Digest& d)
+{
+    out.append(reinterpret_cast<const char*>(d.data()),d.size());
+}
+
+static bool GetDigest(const char*& cur, const char* end, Digest& d)
+{
+    if((size_t) (end - cur) < d.size()) return false;
+    memcpy(d.data(),cur,d.size());
+    cur += d.size();
+    return true;
+}
+
+/**
+ * Append a table checkpoint to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeCheckpoint(std::string& out, const TableCheckpoint& cp)
+{
+    PutEl(out,cp.tablekey);
+    PutU32(out,cp.rows.Count());
+    PutU32(out,cp.rows.Subtrees().size());
+    for(const Digest& d : cp.rows.Subtrees()) PutDigest(out,d);
+    PutU32(out,cp.ids.size());
+    for(const std::string& id : cp.ids) out.append(id);
+}
+
+
+/**
+ * Read a table checkpoint from [cur,end), every verified row has exactly one rowId
+ * ------------------------------------------
+ */
+bool philips::DecodeCheckpoint(const char*& cur, const char* end, TableCheckpoint& cp)
+{
+    size_t count, n;
+    std::vector<Digest> subtrees;
+    if(!GetEl(cur,end,cp.tablekey) || !GetU32(cur,end,count) ||
+        !GetCount(cur,end,32,n)) {
+        return false;
+    }
+    subtrees.resize(n);
+    for(Digest& d : subtrees) {
+        if(!GetDigest(cur,end,d)) return false;
+    }
+    if(!cp.rows.Restore(count,subtrees) || !GetCount(cur,end,32,n) || n != count) {
+        return false;
+    }
+    cp.ids.clear();
+    cp.ids.reserve(n);
+    for(size_t i = 0; i < n; i++) {
+        if(!cp.ids.insert(std::string(cur,32)).second) return false;
+        cur += 32;
+    }
+    return true;
+}
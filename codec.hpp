@@ -0,0 +1,143 @@
+#pragma once
+/**
+ * Binary marshalling of tables, rows and proofs
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <string>
+#include <vector>
+#include <mcl/bn256.hpp>
+
+//philips
+#include "crypto.hpp"
+#include "protocol.hpp"
+#include "deid.hpp"
+#include "torus.hpp"
+#include "checkpoint.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * Encoding
+ * all integers are little endian u32, group elements use the mcl serialization
+ * except Gt, which is torus compressed
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * The integer primitive, for formats built on this encoding; GetU32 is false when fewer
+ * than 4 bytes are left
+ * ------------------------------------------
+ */
+void PutU32(std::string& out, size_t v);
+bool GetU32(const char*& cur, const char* end, size_t& v);
+
+/**
+ * Append a row to a buffer
+ * ------------------------------------------
+ */
+void EncodeRow(std::string& out, const Row& row);
+
+/**
+ * Append a row in challenge form to a buffer
+ * ------------------------------------------
+ */
+void EncodeCompactRow(std::string& out, const CompactRow& row);
+
+/**
+ * Append a table, given as tablekey + rows, to a buffer
+ * ------------------------------------------
+ */
+void EncodeTable(std::string& out, const G2& tablekey, const Row* rows, size_t rowcount);
+
+/**
+ * Append the public trust information to a buffer
+ * ------------------------------------------
+ */
+void EncodeTrust(std::string& out, const TrustLayer& trust);
+
+/**
+ * Append a table checkpoint to a buffer
+ * ------------------------------------------
+ */
+void EncodeCheckpoint(std::string& out, const TableCheckpoint& cp);
+
+/**
+ * Bytes EncodeRow spends on the proof of a row disclosing snipcount snips,
+ * for a protocol built with messagecount messages, aggregated as ZkProof::aggregated
+ * ------------------------------------------
+ */
+size_t EncodedProofSize(size_t snipcount, size_t messagecount = MESSAGE_COUNT,
+    bool aggregated = false);
+
+/**
+ * Bytes EncodeCompactRow spends on the proof of a row disclosing snipcount snips
+ * ------------------------------------------
+ */
+size_t EncodedChallengeProofSize(size_t snipcount, size_t messagecount = MESSAGE_COUNT,
+    bool aggregated = false);
+
+
+/*--------------------------------------------------------------------------------------
+ * Decoding
+ * cursors are advanced past the consumed bytes, false on malformed input
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * Read a row from [cur,end)
+ * ------------------------------------------
+ */
+bool DecodeRow(const char*& cur, const char* end, Row& row);
+
+/**
+ * Read a row in challenge form from [cur,end)
+ * ------------------------------------------
+ */
+bool DecodeCompactRow(const char*& cur, const char* end, CompactRow& row);
+
+/**
+ * Read a table from [cur,end)
+ * ------------------------------------------
+ */
+bool DecodeTable(const char*& cur, const char* end, Table& table);
+
+/**
+ * Check every group element of a table is in its group, see SubgroupCheck; decoding
+ * alone only puts them on their curve, tables from outside parties need this before
+ * they are verified
+ * ------------------------------------------
+ */
+bool ValidateRows(const G2& tablekey, const Row* rows, size_t rowcount);
+bool ValidateRows(const G2& tablekey, const CompactRow* rows, size_t rowcount);
+
+/**
+ * Read a table from [cur,end) & validate its rows, false on malformed input or on an
+ * element outside its group
+ * ------------------------------------------
+ */
+bool DecodeUntrustedTable(const char*& cur, const char* end, Table& table);
+
+/**
+ * Index a table from [cur,end) without decoding its rows, offsets are from the start of
+ * the table encoding, the end of the last row is offsets.back()
+ * ------------------------------------------
+ */
+bool IndexTable(const char*& cur, const char* end, G2& tablekey,
+    std::vector<size_t>& offsets);
+
+/**
+ * Read the public trust information from [cur,end)
+ * ------------------------------------------
+ */
+bool DecodeTrust(const char*& cur, const char* end, TrustLayer& trust);
+
+/**
+ * Read a table checkpoint from [cur,end)
+ * ------------------------------------------
+ */
+bool DecodeCheckpoint(const char*& cur, const char* end, TableCheckpoint& cp);
+
+}
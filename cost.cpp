@@ -0,0 +1,197 @@
+/**
+ * Cost model for proving & verifying tables
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "cost.hpp"
+#include "codec.hpp"
+#include "deid.hpp"
+#include "rng.hpp"
+
+#include <chrono>
+#include <sstream>
+
+using namespace mcl::bn256;
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Operation counts
+ * keep in sync with the STAT_COUNT annotations of deid.cpp
+ *-------------------------------------------------------------------------------------*/
+
+static uint64_t ProofCount(size_t message_count)
+{
+    return PROOF_COUNT - MESSAGE_COUNT + message_count;
+}
+
+/**
+ * Operations of NewZkProof for one row
+ * ------------------------------------------
+ */
+OpCount philips::ProveOps(size_t disclosed, size_t snips, size_t message_count,
+    bool aggregated)
+{
+    // the pf3 base & every snip pairing are plain, the other bases are tabled
+    OpCount ops = {};
+    ops.gt_fixed_pows = ProofCount(message_count) - disclosed - 1 + ROW_PROOF_COUNT;
+    if(aggregated && snips > 0) {
+        ops.pairings = 3;                   // rowId, pf3 base, combined snip
+        ops.g1_muls = 13 + 2 + 2 * snips;   // commitments, cmtY, Si^v, combination
+        ops.gt_pows = 1 + 1;
+        ops.gt_fixed_pows += 1;             // e
+        ops.hashes = 3 + snips;             // fiat shamir, snip weights
+        return ops;
+    }
+    ops.pairings = 2 + snips;               // rowId, pf3 base, snips
+    ops.g1_muls = 13 + 2 + snips;           // commitments, cmtY, Si^v
+    ops.gt_pows = 1 + snips;
+    ops.gt_fixed_pows += snips;             // e
+    ops.hashes = 3;                         // fiat shamir
+    return ops;
+}
+
+
+/**
+ * Operations of VerifyProof for one valid row
+ * ------------------------------------------
+ */
+OpCount philips::VerifyOps(size_t disclosed, size_t snips, size_t message_count,
+    bool aggregated)
+{
+    // every commitment & the per proof pf3 base & snip pairings are plain, the other
+    // bases are tabled
+    OpCount ops = {};
+    ops.gt_fixed_pows = ProofCount(message_count) - disclosed - 1 + ROW_PROOF_COUNT;
+    if(aggregated && snips > 0) {
+        ops.pairings = 4 + 3;               // left x2, pf3 base, pf4, combined snip
+        ops.g1_muls = disclosed + 11 + 2 * snips;
+        ops.gt_pows = 2 + 1 + 2;            // cmtPf3 & base, cmtPf4, cmtSnip & base
+        ops.gt_fixed_pows += 1;             // e
+        ops.hashes = 3 + disclosed + 2 * snips;
+        return ops;
+    }
+    ops.pairings = 4 + 2 * snips;           // left x2, pf3 base, pf4, snips
+    ops.g1_muls = disclosed + 11;           // disclosed, schnorr proofs 1, 2a, 2b, snip
+    ops.g2_muls = snips;
+    ops.gt_pows = 2 + 1 + 2 * snips;        // cmtPf3 & base, cmtPf4, cmtSnip & base
+    ops.gt_fixed_pows += snips;             // e
+    ops.hashes = 3 + disclosed + snips;
+    return ops;
+}
+
+
+/**
+ * Operations of the Prover & Verifier precomputation
+ * ------------------------------------------
+ */
+OpCount philips::SetupOps(size_t message_count)
+{
+    OpCount ops = {};
+    ops.pairings = ProofCount(message_count) + 1; // & the TableContext of the table
+    // e, e(iH, g2) & the generators, e(uH, g2), e(iH, pub) of the issuer & the rowbase;
+    // the special slots repeat e(iH, g2) & share its table
+    ops.gt_tables = 1 + GENERATOR_COUNT - MESSAGE_COUNT + message_count + 1 + 1 + 1;
+    return ops;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Calibration
+ *-------------------------------------------------------------------------------------*/
+
+template <typename F>
+static double TimeOp(size_t iterations, F fn)
+{
+    fn(); // warm up
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; i++) fn();
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now() -
+        begin).count() / iterations;
+}
+
+/**
+ * Time each operation class with a short self benchmark
+ * ------------------------------------------
+ */
+void philips::Calibrate(Calibration& calib, size_t iterations)
+{
+    if(iterations == 0) iterations = 1;
+    G1 g1, r1;
+    G2 g2, r2;
+    Fp12 e, re;
+    Fr x, h;
+    char buf[3 * Fp12_size]; // a fiat shamir challenge over Gt
+    hashAndMapToG1(g1,"calibrate");
+    hashAndMapToG2(g2,"calibrate");
+    pairing(e,g1,g2);
+    rng::Rand(x);
+    for(size_t i = 0; i < 3; i++) e.serialize(buf + i * Fp12_size,Fp12_size);
+
+    calib.pairing_ns = TimeOp(iterations,[&]{ pairing(re,g1,g2); });
+    calib.g1_mul_ns = TimeOp(iterations,[&]{ G1::mul(r1,g1,x); });
+    calib.g2_mul_ns = TimeOp(iterations,[&]{ G2::mul(r2,g2,x); });
+    calib.gt_pow_ns = TimeOp(iterations,[&]{ Fp12::pow(re,e,x); });
+    const GtFixedBase fixed(e);
+    calib.gt_fixed_pow_ns = TimeOp(iterations,[&]{ fixed.Pow(re,x); });
+    calib.gt_table_ns = TimeOp(iterations,[&]{ GtFixedBase table(e); });
+    calib.hash_ns = TimeOp(iterations,[&]{ h.setHashOf(buf,sizeof(buf)); });
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Estimates
+ *-------------------------------------------------------------------------------------*/
+
+static double Nanos(const OpCount& ops, const Calibration& c)
+{
+    return ops.pairings * c.pairing_ns + ops.g1_muls * c.g1_mul_ns +
+        ops.g2_muls * c.g2_mul_ns + ops.gt_pows * c.gt_pow_ns +
+        ops.gt_fixed_pows * c.gt_fixed_pow_ns + ops.gt_tables * c.gt_table_ns +
+        ops.hashes * c.hash_ns;
+}
+
+/**
+ * Predict the cost of a table
+ * ------------------------------------------
+ */
+void philips::EstimateCost(const TableSpec& spec, const Calibration& calib,
+    CostEstimate& cost)
+{
+    cost.setup = SetupOps(spec.message_count);
+    const bool aggregated = spec.aggregate_snips && spec.snips > 0;
+    cost.prove = ProveOps(spec.disclosed,spec.snips,spec.message_count,aggregated);
+    cost.verify = VerifyOps(spec.disclosed,spec.snips,spec.message_count,aggregated);
+    cost.proof_bytes = spec.rows *
+        EncodedProofSize(spec.snips,spec.message_count,aggregated);
+    cost.challenge_proof_bytes = spec.rows *
+        EncodedChallengeProofSize(spec.snips,spec.message_count,aggregated);
+
+    const double setup = Nanos(cost.setup,calib);
+    cost.prove_seconds = (setup + spec.rows * Nanos(cost.prove,calib)) * 1e-9;
+    cost.verify_seconds = (setup + spec.rows * Nanos(cost.verify,calib)) * 1e-9;
+}
+
+static void Dump(std::ostringstream& os, const char* name, const OpCount& ops)
+{
+    os << name << " pairings " << ops.pairings << " g1_muls " << ops.g1_muls
+       << " g2_muls " << ops.g2_muls << " gt_pows " << ops.gt_pows
+       << " gt_fixed_pows " << ops.gt_fixed_pows << " gt_tables " << ops.gt_tables
+       << " hashes " << ops.hashes << "\n";
+}
+
+std::string CostEstimate::Text() const
+{
+    std::ostringstream os;
+    Dump(os,"setup",setup);
+    Dump(os,"prove/row",prove);
+    Dump(os,"verify/row",verify);
+    os << "proof_bytes " << proof_bytes << "\n"
+       << "challenge_proof_bytes " << challenge_proof_bytes << "\n"
+       << "prove_s " << prove_seconds << "\n"
+       << "verify_s " << verify_seconds << "\n";
+    return os.str();
+}
@@ -0,0 +1,103 @@
+#pragma once
+/**
+ * Cost model for proving & verifying tables
+ * mirrors the operation structure of NewZkProof & VerifyProof
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <cstdint>
+#include <string>
+
+//philips
+#include "protocol.hpp"
+
+namespace philips {
+
+/*--------------------------------------------------------------------------------------
+ * Model
+ *-------------------------------------------------------------------------------------*/
+
+// the shape of a table, counts are per row
+struct TableSpec {
+    size_t rows;
+    size_t disclosed;
+    size_t snips;
+    size_t message_count;
+    bool aggregate_snips; // as Prover::aggregate_snips
+
+    TableSpec(size_t rows, size_t disclosed, size_t snips,
+        size_t message_count = MESSAGE_COUNT) : rows(rows), disclosed(disclosed),
+        snips(snips), message_count(message_count), aggregate_snips(false) {}
+};
+
+// the dominant operations, same classes as the stats counters
+struct OpCount {
+    uint64_t pairings;
+    uint64_t g1_muls;
+    uint64_t g2_muls;
+    uint64_t gt_pows;       // of a plain base
+    uint64_t gt_fixed_pows; // of a tabled GtFixedBase
+    uint64_t gt_tables;     // GtFixedBase tables built
+    uint64_t hashes;
+};
+
+// measured nanoseconds per operation on this host
+struct Calibration {
+    double pairing_ns;
+    double g1_mul_ns;
+    double g2_mul_ns;
+    double gt_pow_ns;
+    double gt_fixed_pow_ns;
+    double gt_table_ns;
+    double hash_ns;
+};
+
+struct CostEstimate {
+    OpCount setup;        // Prover or Verifier construction, once per table
+    OpCount prove;        // per row
+    OpCount verify;       // per row
+    uint64_t proof_bytes; // whole table
+    uint64_t challenge_proof_bytes; // whole table, proofs in challenge form
+    double prove_seconds;
+    double verify_seconds;
+
+    std::string Text() const;
+};
+
+/**
+ * Operations of NewZkProof for one row, under a TableContext that tables its rowbase
+ * ------------------------------------------
+ */
+OpCount ProveOps(size_t disclosed, size_t snips, size_t message_count = MESSAGE_COUNT,
+    bool aggregated = false);
+
+/**
+ * Operations of VerifyProof for one valid row, under a TableContext that tables its
+ * rowbase
+ * ------------------------------------------
+ */
+OpCount VerifyOps(size_t disclosed, size_t snips, size_t message_count = MESSAGE_COUNT,
+    bool aggregated = false);
+
+/**
+ * Operations of the Prover & Verifier precomputation, its pairings & power tables, & of
+ * one TableContext with its table
+ * ------------------------------------------
+ */
+OpCount SetupOps(size_t message_count = MESSAGE_COUNT);
+
+/**
+ * Time each operation class with a short self benchmark, pairing must be initialised
+ * ------------------------------------------
+ */
+void Calibrate(Calibration& calib, size_t iterations = 32);
+
+/**
+ * Predict the cost of a table
+ * ------------------------------------------
+ */
+void EstimateCost(const TableSpec& spec, const Calibration& calib, CostEstimate& cost);
+
+}
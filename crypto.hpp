@@ -8,9 +8,12 @@
 
 #include <type_traits>
 #include <iostream>
+#include <string>
 
 #include <mcl/bn256.hpp>
 
+#include "stats.hpp"
+
 using namespace mcl::bn256; 
 
 // Global constants
@@ -62,6 +65,19 @@ void SetupGenerators(std::array<G1,COUNT>& generators)
     }
 }
 
+/**
+ * Generate Generators from a public domain string, so that independent processes
+ * (prover, verifier, daemon) agree on them without exchanging setup
+ * ------------------------------------------
+ */
+template<size_t COUNT>
+void SetupGenerators(std::array<G1,COUNT>& generators, const std::string& domain) 
+{
+    for(size_t i = 0; i < COUNT; i++){
+        hashAndMapToG1(generators[i],domain + std::to_string(i));
+    }
+}
+
 
 /**
  * Create commitment: g^a * h^b
@@ -69,6 +85,7 @@ void SetupGenerators(std::array<G1,COUNT>& generators)
  */
 inline void PedersenCmt(const G1& g, const G1& h, const Fr& a, const Fr& b, G1& cmt) 
 {
+    STAT_COUNT(G1_MUL,2);
     G1 right;
     G1::mul(right,h,b);
     G1::mul(cmt,g,a);
@@ -83,15 +100,13 @@ inline void PedersenCmt(const G1& g, const G1& h, const Fr& a, const Fr& b, G1&
 template<typename G>
 inline void FiatShamir(const G& rand, const G& cmt, const G& gen, Fr& c) 
 {
-    G tmp;
-    const size_t N = BytesSize(tmp);
-    std::vector<char> buf(N+N+N);
-    tmp = rand;
-    size_t alloc_size = tmp.serialize(&buf[0],N); // TODO assert read sizes?
-    tmp = cmt;
-    alloc_size += tmp.serialize(&buf[alloc_size],N);
-    tmp = gen;
-    alloc_size += tmp.serialize(&buf[alloc_size],N);
+    STAT_PHASE(phase,FIATSHAMIR);
+    STAT_COUNT(HASH,1);
+    const size_t N = BytesSize(rand);
+    char buf[3 * Fp12_size]; // the largest element, no allocation per challenge
+    size_t alloc_size = rand.serialize(&buf[0],N); // TODO assert read sizes?
+    alloc_size += cmt.serialize(&buf[alloc_size],N);
+    alloc_size += gen.serialize(&buf[alloc_size],N);
     c.setHashOf(&buf[0],alloc_size); 
 }
 
@@ -0,0 +1,365 @@
+/**
+ * Local verification daemon
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "daemon.hpp"
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Socket helpers
+ *-------------------------------------------------------------------------------------*/
+
+static bool ReadAll(int fd, char* buf, size_t n)
+{
+    while(n > 0) {
+        ssize_t r = read(fd,buf,n);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        buf += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const char* buf, size_t n)
+{
+    while(n > 0) {
+        ssize_t r = send(fd,buf,n,MSG_NOSIGNAL);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        buf += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool WriteFrame(int fd, uint8_t tag, const std::string& payload)
+{
+    const size_t len = payload.size() + 1;
+    char head[5] = { (char) (len & 0xff), (char) ((len >> 8) & 0xff),
+        (char) ((len >> 16) & 0xff), (char) ((len >> 24) & 0xff), (char) tag };
+    return WriteAll(fd,head,5) && WriteAll(fd,payload.data(),payload.size());
+}
+
+static bool ReadFrame(int fd, uint8_t& tag, std::string& payload)
+{
+    char head[5];
+    if(!ReadAll(fd,head,5)) return false;
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(head);
+    size_t len = (size_t) b[0] | ((size_t) b[1] << 8) | ((size_t) b[2] << 16) |
+        ((size_t) b[3] << 24);
+    if(len == 0 || len > DAEMON_MAX_FRAME) return false;
+    tag = b[4];
+    payload.resize(len - 1);
+    return len == 1 || ReadAll(fd,&payload[0],len - 1);
+}
+
+static bool SocketAddress(const std::string& path, sockaddr_un& addr)
+{
+    if(path.size() >= sizeof(addr.sun_path)) return false;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path,path.c_str(),path.size());
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Statistics
+ *-------------------------------------------------------------------------------------*/
+
+double DaemonStats::Percentile(double q) const
+{
+    uint64_t total = 0;
+    for(uint64_t c : latency) total += c;
+    if(total == 0) return 0;
+    const uint64_t rank = (uint64_t) std::ceil(q * total);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < DAEMON_LATENCY_BUCKETS; i++) {
+        seen += latency[i];
+        if(seen >= rank) return (double) (1ull << i);
+    }
+    return (double) (1ull << (DAEMON_LATENCY_BUCKETS - 1));
+}
+
+std::string DaemonStats::Text() const
+{
+    std::ostringstream os;
+    os << "requests " << requests << "\n"
+       << "batches " << batches << "\n"
+       << "rows " << rows << "\n"
+       << "accepted " << accepted << "\n"
+       << "rejected " << rejected << "\n"
+       << "malformed " << malformed << "\n"
+       << "uptime_s " << uptime << "\n"
+       << "rows_per_s " << (uptime > 0 ? rows / uptime : 0) << "\n"
+       << "mean_batch " << (batches > 0 ? (double) requests / batches : 0) << "\n"
+       << "latency_p50_us " << Percentile(0.5) << "\n"
+       << "latency_p99_us " << Percentile(0.99) << "\n";
+    return os.str();
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Server
+ *-------------------------------------------------------------------------------------*/
+
+Daemon::Daemon(const TrustLayer& trust, std::shared_ptr<const Protocol> p,
+    const DaemonConfig& cfg) : verifier(trust,p), config(cfg), listenfd(-1),
+    running(false) {}
+
+Daemon::~Daemon()
+{
+    Stop();
+}
+
+
+/**
+ * Bind the socket and spin up the accept & batch threads
+ * ------------------------------------------
+ */
+bool Daemon::Start()
+{
+    sockaddr_un addr;
+    if(running || !SocketAddress(config.path,addr)) return false;
+    listenfd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(listenfd < 0) return false;
+    unlink(config.path.c_str());
+    if(bind(listenfd,(sockaddr*) &addr,sizeof(addr)) != 0 || listen(listenfd,64) != 0) {
+        close(listenfd);
+        listenfd = -1;
+        return false;
+    }
+    started = std::chrono::steady_clock::now();
+    running = true;
+    acceptor = std::thread(&Daemon::Accept,this);
+    batcher = std::thread(&Daemon::Batch,this);
+    return true;
+}
+
+
+/**
+ * Stop accepting, fail pending requests and wait for all threads
+ * ------------------------------------------
+ */
+void Daemon::Stop()
+{
+    if(!running.exchange(false)) return;
+    shutdown(listenfd,SHUT_RDWR);
+    close(listenfd);
+    listenfd = -1;
+    acceptor.join();
+    qcv.notify_all();
+    batcher.join();
+    {
+        std::lock_guard<std::mutex> lk(qmutex);
+        for(std::unique_ptr<Request>& req : queue) {
+            req->done.set_value(DAEMON_UNAVAILABLE);
+        }
+        queue.clear();
+    }
+    std::unique_lock<std::mutex> lk(cmutex);
+    for(int fd : clients) shutdown(fd,SHUT_RDWR);
+    ccv.wait(lk,[this]{ return clients.empty(); });
+    unlink(config.path.c_str());
+}
+
+
+DaemonStats Daemon::Stats() const
+{
+    std::lock_guard<std::mutex> lk(smutex);
+    DaemonStats s = stats;
+    s.uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+        started).count();
+    return s;
+}
+
+
+void Daemon::Accept()
+{
+    while(running) {
+        int fd = accept(listenfd,nullptr,nullptr);
+        if(fd < 0) {
+            if(errno == EINTR) continue;
+            return;
+        }
+        std::lock_guard<std::mutex> lk(cmutex);
+        clients.push_back(fd);
+        std::thread(&Daemon::Serve,this,fd).detach();
+    }
+}
+
+
+/**
+ * One thread per client, requests are decoded here and verified by the batcher
+ * ------------------------------------------
+ */
+void Daemon::Serve(int fd)
+{
+    uint8_t op;
+    std::string payload;
+    while(running && ReadFrame(fd,op,payload)) {
+        uint8_t status = DAEMON_MALFORMED;
+        std::string reply;
+        if(op == DAEMON_STATS) {
+            status = DAEMON_ACCEPT;
+            reply = Stats().Text();
+        } else if(op == DAEMON_CHECK_TABLE) {
+            std::unique_ptr<Request> req(new Request());
+            const char* cur = payload.data();
+            const char* end = cur + payload.size();
+            if(DecodeUntrustedTable(cur,end,req->table) && cur == end) {
+                std::future<uint8_t> result = req->done.get_future();
+                req->arrival = std::chrono::steady_clock::now();
+                {
+                    std::lock_guard<std::mutex> lk(qmutex);
+                    if(running) queue.push_back(std::move(req));
+                }
+                if(req) {
+                    status = DAEMON_UNAVAILABLE;
+                } else {
+                    qcv.notify_one();
+                    status = result.get();
+                }
+            } else {
+                std::lock_guard<std::mutex> lk(smutex);
+                stats.requests++;
+                stats.malformed++;
+            }
+        }
+        if(!WriteFrame(fd,status,reply)) break;
+    }
+    // forget the fd before closing it, once closed accept() may hand out the same number
+    std::lock_guard<std::mutex> lk(cmutex);
+    clients.erase(std::find(clients.begin(),clients.end(),fd));
+    close(fd);
+    ccv.notify_all();
+}
+
+
+/**
+ * Collect requests for at most window_us after the first one arrives, then verify the
+ * batch jointly on the warm verifier: one TableContext per tablekey & the rows of all
+ * tables spread over the workers
+ * ------------------------------------------
+ */
+void Daemon::Batch()
+{
+    std::vector<std::unique_ptr<Request>> batch;
+    std::vector<Table> tables;
+    std::vector<TableStatus> verdicts;
+    batch.reserve(config.maxbatch);
+    tables.reserve(config.maxbatch);
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lk(qmutex);
+            qcv.wait(lk,[this]{ return !queue.empty() || !running; });
+            if(!running) return;
+            const std::chrono::steady_clock::time_point deadline =
+                queue.front()->arrival + std::chrono::microseconds(config.window_us);
+            qcv.wait_until(lk,deadline,[this]{
+                return queue.size() >= config.maxbatch || !running; });
+            while(!queue.empty() && batch.size() < config.maxbatch) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        // the tables move out for the check & back for the statistics
+        for(std::unique_ptr<Request>& req : batch) {
+            tables.push_back(std::move(req->table));
+        }
+        CheckTables(verifier,tables.data(),tables.size(),config.workers,verdicts);
+        for(size_t i = 0; i < batch.size(); i++) {
+            batch[i]->table = std::move(tables[i]);
+            uint8_t status = verdicts[i].status == VERIFY_OK ? DAEMON_ACCEPT :
+                DAEMON_REJECT;
+            Record(*batch[i],status);
+            batch[i]->done.set_value(status);
+        }
+        {
+            std::lock_guard<std::mutex> lk(smutex);
+            stats.batches++;
+        }
+        batch.clear();
+        tables.clear();
+    }
+}
+
+
+void Daemon::Record(const Request& req, uint8_t status)
+{
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - req.arrival).count();
+    size_t bucket = 0;
+    while(bucket + 1 < DAEMON_LATENCY_BUCKETS && (1ull << bucket) < us) bucket++;
+
+    std::lock_guard<std::mutex> lk(smutex);
+    stats.requests++;
+    stats.rows += req.table.deidrows.size();
+    if(status == DAEMON_ACCEPT) stats.accepted++;
+    else stats.rejected++;
+    stats.latency[bucket]++;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Client
+ *-------------------------------------------------------------------------------------*/
+
+bool DaemonClient::Connect(const std::string& path)
+{
+    sockaddr_un addr;
+    Close();
+    if(!SocketAddress(path,addr)) return false;
+    fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd < 0) return false;
+    if(connect(fd,(sockaddr*) &addr,sizeof(addr)) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void DaemonClient::Close()
+{
+    if(fd >= 0) close(fd);
+    fd = -1;
+}
+
+bool DaemonClient::Call(uint8_t op, const std::string& payload, uint8_t& status,
+    std::string& reply)
+{
+    return fd >= 0 && payload.size() < DAEMON_MAX_FRAME &&
+        WriteFrame(fd,op,payload) && ReadFrame(fd,status,reply);
+}
+
+bool DaemonClient::CheckTable(const G2& tablekey, const Row* table, size_t rowcount,
+    uint8_t& status)
+{
+    std::string payload, reply;
+    EncodeTable(payload,tablekey,table,rowcount);
+    return Call(DAEMON_CHECK_TABLE,payload,status,reply);
+}
+
+bool DaemonClient::Stats(std::string& text)
+{
+    uint8_t status;
+    return Call(DAEMON_STATS,"",status,text) && status == DAEMON_ACCEPT;
+}
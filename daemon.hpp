@@ -0,0 +1,152 @@
+#pragma once
+/**
+ * Local verification daemon
+ * keeps the protocol & verifier warm and batches requests from local clients
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//philips
+#include "protocol.hpp"
+#include "deid.hpp"
+
+#define DAEMON_LATENCY_BUCKETS 32
+#define DAEMON_MAX_FRAME (1u << 30)
+
+namespace philips {
+
+/*--------------------------------------------------------------------------------------
+ * Wire protocol
+ * request:  u32 length | u8 op     | payload   (length covers op + payload)
+ * response: u32 length | u8 status | payload
+ *-------------------------------------------------------------------------------------*/
+
+enum DaemonOp {
+    DAEMON_CHECK_TABLE = 1, // payload: EncodeTable, response: status only
+    DAEMON_STATS = 2        // no payload, response: stats as text
+};
+
+enum DaemonStatus {
+    DAEMON_REJECT = 0,
+    DAEMON_ACCEPT = 1,
+    DAEMON_MALFORMED = 2,
+    DAEMON_UNAVAILABLE = 3
+};
+
+struct DaemonConfig {
+    std::string path;   // unix socket
+    size_t window_us;   // how long the first request of a batch waits for company
+    size_t maxbatch;    // requests per batch
+    size_t workers;     // threads verifying the rows of a batch
+
+    explicit DaemonConfig(const std::string& path) : path(path), window_us(2000),
+        maxbatch(64), workers(std::max(1u,std::thread::hardware_concurrency())) {}
+};
+
+struct DaemonStats {
+    uint64_t requests;
+    uint64_t batches;
+    uint64_t rows;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t malformed;
+    double uptime; // seconds
+    std::array<uint64_t,DAEMON_LATENCY_BUCKETS> latency; // log2 microsecond buckets
+
+    DaemonStats() : requests(0), batches(0), rows(0), accepted(0), rejected(0),
+        malformed(0), uptime(0) { latency.fill(0); }
+
+    // upper bound in microseconds of the q-th latency quantile
+    double Percentile(double q) const;
+    std::string Text() const;
+};
+
+
+/*--------------------------------------------------------------------------------------
+ * Server
+ *-------------------------------------------------------------------------------------*/
+
+class Daemon {
+public:
+    Daemon(const TrustLayer& trust, std::shared_ptr<const Protocol> p,
+        const DaemonConfig& cfg);
+    ~Daemon();
+
+    bool Start();
+    void Stop();
+    DaemonStats Stats() const;
+
+private:
+    struct Request {
+        Table table;
+        std::chrono::steady_clock::time_point arrival;
+        std::promise<uint8_t> done;
+    };
+
+    void Accept();
+    void Serve(int fd);
+    void Batch();
+    void Record(const Request& req, uint8_t status);
+
+    Verifier verifier;
+    DaemonConfig config;
+    int listenfd;
+    std::atomic<bool> running;
+    std::chrono::steady_clock::time_point started;
+
+    std::thread acceptor;
+    std::thread batcher;
+
+    std::mutex qmutex;
+    std::condition_variable qcv;
+    std::deque<std::unique_ptr<Request>> queue;
+
+    std::mutex cmutex;
+    std::condition_variable ccv;
+    std::vector<int> clients;
+
+    mutable std::mutex smutex;
+    DaemonStats stats;
+};
+
+
+/*--------------------------------------------------------------------------------------
+ * Client
+ *-------------------------------------------------------------------------------------*/
+
+class DaemonClient {
+public:
+    DaemonClient() : fd(-1) {}
+    ~DaemonClient() { Close(); }
+
+    bool Connect(const std::string& path);
+    void Close();
+
+    /**
+     * Ask the daemon to check a table, status is one of DaemonStatus
+     */
+    bool CheckTable(const G2& tablekey, const Row* table, size_t rowcount,
+        uint8_t& status);
+    bool Stats(std::string& text);
+
+private:
+    bool Call(uint8_t op, const std::string& payload, uint8_t& status,
+        std::string& reply);
+    int fd;
+};
+
+}
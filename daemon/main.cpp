@@ -0,0 +1,71 @@
+/** 
+ * Local verification daemon
+ * usage: zkdeidd <socket> <trustfile> [window_us] [maxbatch]
+ * the trust file holds the EncodeTrust bytes of the accepted issuers & bb keys
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <mcl/bn256.hpp>
+
+#include <codec.hpp>
+#include <daemon.hpp>
+
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace mcl::bn256;
+
+using namespace philips;
+
+//---------------------------------------------------
+// starting point
+//---------------------------------------------------
+int main(int argc, char** argv) 
+{
+    if(argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <socket> <trustfile> [window_us] [maxbatch]"
+            << std::endl;
+        return 1;
+    }
+    initPairing();
+
+    std::ifstream in(argv[2],std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+    TrustLayer trust;
+    const char* cur = bytes.data();
+    if(!in || !DecodeTrust(cur,bytes.data()+bytes.size(),trust)) {
+        std::cerr << "unreadable trust file " << argv[2] << std::endl;
+        return 1;
+    }
+
+    DaemonConfig cfg(argv[1]);
+    if(argc > 3) cfg.window_us = std::strtoul(argv[3],nullptr,10);
+    if(argc > 4) cfg.maxbatch = std::strtoul(argv[4],nullptr,10);
+    if(cfg.maxbatch == 0) cfg.maxbatch = 1;
+
+    // handle termination synchronously, worker threads inherit the mask
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set,SIGINT);
+    sigaddset(&set,SIGTERM);
+    pthread_sigmask(SIG_BLOCK,&set,nullptr);
+
+    Daemon daemon(trust,std::make_shared<const Protocol>(),cfg);
+    if(!daemon.Start()) {
+        std::cerr << "cannot listen on " << cfg.path << std::endl;
+        return 1;
+    }
+    std::cout << "listening on " << cfg.path << std::endl;
+
+    int sig;
+    sigwait(&set,&sig);
+    daemon.Stop();
+    std::cout << daemon.Stats().Text();
+    return 0;
+}
@@ -9,8 +9,24 @@
 #include "deid.hpp"
 #include "schnorr.hpp"
 #include "bb.hpp"
-
+#include "stats.hpp"
+#include "rng.hpp"
+#include "transcript.hpp"
+#include "torus.hpp"
+#include "cache.hpp"
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <cybozu/sha2.hpp>
 
 #define SECRET_COUNT RESPONSE_COUNT + ROW_RESPONSE_COUNT
 
@@ -28,7 +44,8 @@ using namespace philips;
  */
 void philips::KeyGen(const G2& base, KeyPair& kp) 
 {
-    kp.priv.setRand(); 
+    rng::Rand(kp.priv);
+    STAT_COUNT(G2_MUL,1);
     G2::mul(kp.pub,base,kp.priv); // pub =  base ^ priv
 }
 
@@ -46,15 +63,17 @@ void philips::Sign(const KeyPair& kp, const std::shared_ptr<const Protocol>& p,
     std::array<Fr,MESSAGE_COUNT>* hashes) 
 { 
     // random members
-    sig.s.setRand();
-    sig.c.setRand();
-    sig.u.setRand();
-    sig.l.setRand();
+    rng::Rand(sig.s);
+    rng::Rand(sig.c);
+    rng::Rand(sig.u);
+    rng::Rand(sig.l);
 
     Fr inv,sum;
     Fr::add(sum,kp.priv,sig.c);
     Fr::inv(inv,sum);
 
+    STAT_COUNT(HASH,MESSAGE_COUNT);
+    STAT_COUNT(G1_MUL,MESSAGE_COUNT + 4);
     G1 last, mult;
     int i = 0;
     mult = p->generators[0]; 
@@ -94,6 +113,11 @@ bool philips::VerifySignature(const G2& base, const G2& pub, const Signature& si
     Fp12 left, right; 
     G2 yhc;
 
+    STAT_COUNT(PAIRING,2);
+    STAT_COUNT(G2_MUL,1);
+    STAT_COUNT(HASH,MESSAGE_COUNT);
+    STAT_COUNT(G1_MUL,MESSAGE_COUNT + 3);
+
     // pair(sigma, y+G2.base^c) 
     G2::mul(yhc,base,sig.c);  
     G2::add(yhc,yhc,pub);
@@ -128,6 +152,122 @@ bool philips::VerifySignature(const G2& base, const G2& pub, const Signature& si
 }
 
 
+/**
+ * Batch verify the signatures of records
+ * with weights w the CLS equations e(sigma, pub * g2^c) = e(M, g2) multiply to
+ * prod e(sum w sigma, pub) e(sum w c sigma - sum w M, g2) = 1 over the issuers, where
+ * the generator part of sum w M takes one multiplication per generator for the whole
+ * batch; the snips make one batch per BB key
+ * ------------------------------------------
+ */
+bool philips::VerifyRecords(const TrustLayer& trust, 
+    const std::shared_ptr<const Protocol>& p, const DeidRecord* records, size_t count)
+{
+    if(count == 0) return true;
+    STAT_COUNT(HASH,MESSAGE_COUNT * count);
+    STAT_COUNT(G1_MUL,2 * count + MESSAGE_COUNT + 4);
+
+    // weighted sums of the exponents & of the signatures, per issuer & per snip key
+    std::map<uint32_t,G1> sigmas;
+    std::map<uint32_t,bb::BatchVerifier<G2,G1>> snips;
+    std::array<Fr,MESSAGE_COUNT> m;
+    Fr w0, wu, wl, ws;
+    G1 csigmas;
+    for(Fr& mi : m) mi.clear();
+    w0.clear();
+    wu.clear();
+    wl.clear();
+    ws.clear();
+    csigmas.clear();
+    for(size_t j = 0; j < count; j++) {
+        const DeidRecord& r = *(records+j);
+        if(!trust.Issuer(r.issuer)) return false;
+        if(!r.snips.empty() && !trust.BBKey(r.bbkey)) return false;
+        Fr w, t;
+        G1 tmp;
+        bb::BatchWeight(w);
+        Fr::add(w0,w0,w);
+        for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+            Fr hash;
+            hash.setHashOf(r.record[i]);
+            Fr::mul(t,w,hash);
+            Fr::add(m[i],m[i],t);
+        }
+        Fr::mul(t,w,r.sig.u);
+        Fr::add(wu,wu,t);
+        Fr::mul(t,w,r.sig.l);
+        Fr::add(wl,wl,t);
+        Fr::mul(t,w,r.sig.s);
+        Fr::add(ws,ws,t);
+        G1::mul(tmp,r.sig.sigma,w);
+        std::map<uint32_t,G1>::iterator sigma = sigmas.find(r.issuer);
+        if(sigma == sigmas.end()) sigmas.insert(std::make_pair(r.issuer,tmp));
+        else G1::add(sigma->second,sigma->second,tmp);
+        Fr::mul(t,w,r.sig.c);
+        G1::mul(tmp,r.sig.sigma,t);
+        G1::add(csigmas,csigmas,tmp);
+        if(r.snips.empty()) continue;
+        std::map<uint32_t,bb::BatchVerifier<G2,G1>>::iterator batch = snips.find(r.bbkey);
+        if(batch == snips.end()) {
+            batch = snips.insert(std::make_pair(r.bbkey,bb::BatchVerifier<G2,G1>(
+                p->crv.g2,p->crv.g1,*trust.BBKey(r.bbkey)))).first;
+        }
+        for(const std::pair<std::string,G1>& s : r.snips) {
+            batch->second.AddDouble(s.second,s.first,r.sig.l);
+        }
+    }
+    STAT_COUNT(PAIRING,sigmas.size() + 1);
+
+    // sum w M
+    G1 M, tmp;
+    G1::mul(M,p->generators[0],w0);
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+        G1::mul(tmp,p->generators[i+1],m[i]);
+        G1::add(M,M,tmp);
+    }
+    G1::mul(tmp,p->uH,wu);
+    G1::add(M,M,tmp);
+    G1::mul(tmp,p->lH,wl);
+    G1::add(M,M,tmp);
+    G1::mul(tmp,p->generators[MESSAGE_COUNT+1],ws);
+    G1::add(M,M,tmp);
+    G1::sub(M,csigmas,M);
+
+    // one final exponentiation for the signatures & the snips
+    Fp12 f, f2;
+    millerLoop(f,M,p->crv.g2);
+    for(const std::pair<const uint32_t,G1>& sigma : sigmas) {
+        millerLoop(f2,sigma.second,*trust.Issuer(sigma.first));
+        Fp12::mul(f,f,f2);
+    }
+    for(const std::pair<const uint32_t,bb::BatchVerifier<G2,G1>>& batch : snips) {
+        batch.second.Loops(f2);
+        Fp12::mul(f,f,f2);
+    }
+    finalExp(f,f);
+    return f.isOne();
+}
+
+
+/**
+ * Table the fixed bases of the proofs, the pairings the proofs never raise stay empty;
+ * a base seen before shares its table, e(iH, g2) fills every special slot & the last
+ * ------------------------------------------
+ */
+PairingTables::PairingTables(const Protocol& p,
+    const std::array<Fp12,PAIRING_COUNT>& precomputed) : e(p.crv.e)
+{
+    for(size_t i = 2; i < PAIRING_COUNT; i++) {
+        if(i == PAIRING_COUNT - 3) continue;
+        size_t j = 2;
+        while(j < i && (j == PAIRING_COUNT - 3 || !(precomputed[j] == precomputed[i]))) {
+            j++;
+        }
+        pairings[i] = j < i ? pairings[j] : GtFixedBase(precomputed[i]);
+    }
+}
+
+
 /**
  * Sign a sequence of vcf file snips
  * ------------------------------------------
@@ -148,66 +288,148 @@ void philips::SignSnips(const std::vector<std::string> seq, const BBKey kp,
  * CLS Zero Knowledge Proof
  *-------------------------------------------------------------------------------------*/
 
+// the public context of a row proof, the disclosed values & snips follow
+static void AbsorbStatement(Transcript& t, const G2& pub, const G2& tablekey)
+{
+    t.Absorb("pub",pub);
+    t.Absorb("tablekey",tablekey);
+}
+
+// the row elements both proof forms carry, the verifier checks the snip counts first
+template <typename P>
+static void AbsorbRow(Transcript& t, const P& proof)
+{
+    t.Absorb("aggregated",(uint64_t) proof.aggregated);
+    t.Absorb("issuer",(uint64_t) proof.issuer);
+    t.Absorb("bbkey",(uint64_t) proof.bbkey);
+    t.Absorb("cmtA",proof.cmtA);
+    t.Absorb("cmtB",proof.cmtB);
+    t.Absorb("cmtBc",proof.cmtBc);
+    t.Absorb("rowId",proof.rowId);
+    t.Absorb("cmtU",proof.cmtU);
+    t.Absorb("cmtL",proof.cmtL);
+    t.Absorb("snips",(uint64_t) proof.SiV.size());
+    for(const G1& siv : proof.SiV) {
+        t.Absorb("SiV",siv);
+    }
+}
+
+// the schnorr commitments, shipped in a ZkProof & recomputed for a ZkChallengeProof
+static void AbsorbCommitments(Transcript& t, const G1& cmtPf1, const G1& cmtPf2,
+    const G1& cmtPf2b, const Fp12& cmtPf3, const Fp12& cmtPf4, const G1& cmtY,
+    const std::vector<Fp12>& cmtSnip)
+{
+    t.Absorb("cmtPf1",cmtPf1);
+    t.Absorb("cmtPf2",cmtPf2);
+    t.Absorb("cmtPf2b",cmtPf2b);
+    t.Absorb("cmtPf3",cmtPf3);
+    t.Absorb("cmtPf4",cmtPf4);
+    t.Absorb("cmtY",cmtY);
+    for(const Fp12& cmt : cmtSnip) {
+        t.Absorb("cmtSnip",cmt);
+    }
+}
+
+// random weights for the aggregated snip equations, drawn once the SiV are fixed
+static void SnipWeights(Transcript& t, size_t n, std::vector<Fr>& weights)
+{
+    weights.resize(n);
+    for(Fr& w : weights) {
+        t.Challenge("snip weight",w);
+    }
+}
+
+static void Challenges(Transcript& t, Fr& fsc, Fr& fsc4, Fr& fsc2)
+{
+    t.Challenge("signature",fsc);
+    t.Challenge("row",fsc4);
+    t.Challenge("snips",fsc2);
+}
+
+// the context of an issuer from the key ring of the table, or from the cache of the
+// party when the table did not add it; held keeps a cache entry alive for the call
+template<typename Party>
+static const IssuerContext& IssuerOf(const TableContext& table, const Party& party,
+    uint32_t id, const G2& pub, std::shared_ptr<const IssuerContext>& held)
+{
+    const IssuerContext* issuer = table.keys.Issuer(id);
+    if(issuer) return *issuer;
+    held = party.keys->Issuer(*party.protocol,pub);
+    return *held;
+}
+
+// as IssuerOf for a snip key
+static const BBKeyContext& BBKeyOf(const TableContext& table, const Verifier& v,
+    uint32_t id, std::shared_ptr<const BBKeyContext>& held)
+{
+    const BBKeyContext* bbkey = table.keys.BBKey(id);
+    if(bbkey) return *bbkey;
+    held = v.keys->BBKey(v.trust.bbkeys[id]);
+    return *held;
+}
+
 /**
  * Create a New set of proof secrets & commitments
  * -----------------------------------------------
  */
-void philips::NewZkProof(const std::vector<size_t>& disclose, 
-    const std::vector<size_t>& snip, const G2& tablekey, const DeidRecord& drec, 
-    ZkProofKnowledge& proof, Prover& p) 
+bool philips::NewZkProof(const std::vector<size_t>& disclose, 
+    const std::vector<size_t>& snip, const TableContext& table, const DeidRecord& drec, 
+    ZkProofKnowledge& proof, const Prover& p) 
 {
+    STAT_PHASE(prove,PROVE);
+    const G2* pub = p.trust.Issuer(drec.issuer);
+    if(!pub || (!snip.empty() && !p.trust.BBKey(drec.bbkey))) return false;
+    std::shared_ptr<const IssuerContext> held;
+    const IssuerContext& issuer = IssuerOf(table,p,drec.issuer,*pub,held);
+    proof.issuer = drec.issuer;
+    proof.bbkey = drec.bbkey;
+
     // random factors
-    proof.r.setRand();
-    proof.open.setRand();
-    proof.pf1a.setRand();
-    proof.pf1b.setRand();
-    proof.pf2a.setRand();
-    proof.pf2b.setRand();
-    proof.pf2c.setRand();
-    proof.pfl1a.setRand();
-    proof.pfl1b.setRand();
-
-    for (size_t i = 0; i < PROOF_COUNT; i++) {
-        Fr x; 
-        x.setRand();
-        proof.pf3[i] = x;
-    }
-    for (size_t i = 0; i < ROW_PROOF_COUNT; i++) {
-        Fr x; 
-        x.setRand();
-        proof.pf4[i] = x;
-    }
-    proof.ublind.setRand();
-    proof.lblind.setRand();
-
-    // process the disclosure request
-    std::vector<size_t> targets = disclose;
-    std::sort(targets.begin(),targets.end()); 
+    std::array<Fr,11> factors;
+    rng::Rand(factors);
+    proof.r = factors[0];
+    proof.open = factors[1];
+    proof.pf1a = factors[2];
+    proof.pf1b = factors[3];
+    proof.pf2a = factors[4];
+    proof.pf2b = factors[5];
+    proof.pf2c = factors[6];
+    proof.pfl1a = factors[7];
+    proof.pfl1b = factors[8];
+    proof.ublind = factors[9];
+    proof.lblind = factors[10];
+    rng::Rand(proof.pf3);
+    rng::Rand(proof.pf4);
+
+    // process the disclosure request, absorbed in message order as the verifier sorts it
+    std::array<bool,MESSAGE_COUNT> disclosed = {};
+    for(size_t target : disclose) {
+        if(target >= MESSAGE_COUNT) return false;
+        disclosed[target] = true;
+    }
+    for(size_t target : snip) {
+        if(target >= drec.snips.size()) return false;
+    }
 
     // empty randoms for disclosed messages
-    for(size_t target : targets) {
-        proof.pf3[3 + target] = (Fr) 0;
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+        if(disclosed[i]) proof.pf3[3 + i] = (Fr) 0;
     }
 
-    // set up snip proof
-    proof.snipblinds.reserve(snip.size());
-    proof.v.reserve(snip.size());
-    std::vector<std::pair<std::string,G1>> Si;
-    Si.reserve(snip.size());
-    proof.cmtSnip.reserve(snip.size());
-    proof.SiV.reserve(snip.size());
-    proof.snip_response.reserve(snip.size()+2);
-    for(size_t target: snip) {
-        Si.push_back(drec.snips[target]);
-        Fr x,y; 
-        x.setRand();
-        proof.snipblinds.push_back(x);
-        y.setRand();
-        proof.v.push_back(y);
-
-    }
+    // set up snip proof, sized in place so a reused proof keeps its capacity
+    proof.aggregated = p.aggregate_snips && !snip.empty();
+    const size_t blinds = proof.aggregated ? 1 : snip.size();
+    proof.SiV.resize(snip.size());
+    proof.cmtSnip.resize(blinds);
+    proof.snip_response.resize(blinds + 2);
+    proof.snipblinds.resize(blinds);
+    proof.v.resize(snip.size());
+    rng::Rand(proof.snipblinds.data(),blinds);
+    rng::Rand(proof.v.data(),snip.size());
 
     // commitment time
+    STAT_TIMER(phase,PROVE_COMMIT);
+    STAT_COUNT(G1_MUL,7);
     G1 sigblind;
     PedersenCmt(p.protocol->crv.g1,p.protocol->iH,proof.r,proof.open,
         proof.cmtB);
@@ -232,83 +454,106 @@ void philips::NewZkProof(const std::vector<size_t>& disclose,
     G1::add(proof.cmtL,blind,hl);
 
     // rowId
-    pairing(proof.rowId,hu,tablekey);
+    STAT_NEXT(phase,PROVE_ROW);
+    STAT_COUNT(PAIRING,1);
+    precomputedMillerLoop(proof.rowId,hu,table.lines);
+    finalExp(proof.rowId,proof.rowId);
 
     // pf3 is complicated
-    pairing(p.pairings[0],proof.cmtA,p.protocol->crv.g2); 
-    Fp12::pow(proof.cmtPf3,p.pairings[0],proof.pf3[0]);
+    STAT_NEXT(phase,PROVE_PF3);
+    STAT_COUNT(PAIRING,1);
+    STAT_COUNT(GT_POW,1);
+    Fp12 abase;
+    pairing(abase,proof.cmtA,p.protocol->crv.g2); 
+    Fp12::pow(proof.cmtPf3,abase,proof.pf3[0]);
     for(size_t i =1; i < PROOF_COUNT; i++) {
         if(proof.pf3[i] != (Fr) 0) {
             Fp12 exp;
-            Fp12::pow(exp,p.pairings[i],proof.pf3[i]);
+            GtPow(exp,i == 1 ? issuer.ipub : p.tables->pairings[i],proof.pf3[i]);
             Fp12::mul(proof.cmtPf3,proof.cmtPf3,exp);
         }
     }
 
     // pf4
-    Fp12 left4;
-    pairing(left4,proof.cmtU,p.protocol->crv.g2);
-    Fp12::div(left4,left4,proof.rowId);    
-    pairing(p.pairings[PAIRING_COUNT-3],p.protocol->uH,tablekey); 
-
-    Fp12::pow(proof.cmtPf4,p.pairings[PAIRING_COUNT-3],proof.pf4[0]); 
+    STAT_NEXT(phase,PROVE_ROW);
+    table.rowbase.Pow(proof.cmtPf4,proof.pf4[0]); 
     for(size_t i = 0; i < 2; i++) {
         Fp12 exp;
-        Fp12::pow(exp,p.pairings[PAIRING_COUNT-2+i],proof.pf4[i+1]);
+        p.tables->pairings[PAIRING_COUNT-2+i].Pow(exp,proof.pf4[i+1]);
         Fp12::mul(proof.cmtPf4,proof.cmtPf4,exp);
     }
 
-    Fr fsc4;
-    FiatShamir<Fp12>(proof.cmtPf4,left4,p.pairings[PAIRING_COUNT-3],fsc4);
-
-    // compute the lefthand side
-    Fp12 left;
-    Fp12 leftbottom;
-    G1 disclosed = p.protocol->generators[0];
-    for(size_t target : targets) {
-        G1 tmp;
-        G1::mul(tmp,p.protocol->generators[target+1],drec.hashvalues[target]);
-        G1::add(disclosed,disclosed,tmp);
-    }
-    G1::add(disclosed,disclosed,proof.cmtU);
-    G1::add(disclosed,disclosed,proof.cmtL);
-    pairing(left,disclosed,p.protocol->crv.g2);  
-    pairing(leftbottom,proof.cmtA,p.trust.pub);
-    Fp12::div(left,left,leftbottom);
-
-    // fiat shamir over cmtPf3, left 
-    // TODO fsc for each proof ... ?
-    Fr fsc;
-    FiatShamir<Fp12>(proof.cmtPf3,left,p.pairings[0],fsc);
-
     // snip proof
+    STAT_NEXT(phase,PROVE_SNIPS);
+    STAT_COUNT(G1_MUL,2 + snip.size());
     G1 interm;
     G1::mul(proof.cmtY,p.protocol->lH,proof.pfl1a);
     G1::mul(interm,p.protocol->iH,proof.pfl1b);
     G1::add(proof.cmtY,proof.cmtY,interm);
 
     for(size_t i = 0; i < snip.size(); i++) {
-        Fp12 a1, a2, a3;
-        Fr ai;
-        G1 siv;
-
-   /*     bool help = bb::DoubleVerify<G2,G1>(p.protocol->crv.g2,p.protocol->crv.g1,
-            p.trust.bbkeys[0],pfunc,Si[i].second,Si[i].first,drec.sig.l);
-   */ 
-        G1::mul(siv,Si[i].second,proof.v[i]);
-        proof.SiV.push_back(siv);
-        pairing(a1,siv,p.protocol->crv.g2);
-        Fr::neg(ai,proof.pfl1a);
+        G1::mul(proof.SiV[i],drec.snips[snip[i]].second,proof.v[i]);
+    }
+
+    // all challenges from one transcript over the statement & the commitments
+    Transcript t("zkdeid row proof");
+    AbsorbStatement(t,*pub,table.tablekey);
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+        if(!disclosed[i]) continue;
+        t.Absorb("disclosed",(uint64_t) i);
+        t.Absorb("value",drec.hashvalues[i]);
+    }
+    for(size_t target : snip) {
+        t.Absorb("snip",drec.snips[target].first);
+    }
+    AbsorbRow(t,proof);
+
+    Fr ai, vsum;
+    Fr::neg(ai,proof.pfl1a);
+    if(proof.aggregated) {
+        // e(A, g2)^-pfl1a * e^blind with A = sum w_i SiV_i proves V = sum w_i v_i
+        STAT_COUNT(G1_MUL,snip.size());
+        STAT_COUNT(PAIRING,1);
+        STAT_COUNT(GT_POW,1);
+        // the weights of SnipWeights, squeezed one at a time
+        G1 agg;
+        agg.clear();
+        vsum.clear();
+        for(size_t i = 0; i < snip.size(); i++) {
+            G1 tmp;
+            Fr w, wv;
+            t.Challenge("snip weight",w);
+            G1::mul(tmp,proof.SiV[i],w);
+            G1::add(agg,agg,tmp);
+            Fr::mul(wv,w,proof.v[i]);
+            Fr::add(vsum,vsum,wv);
+        }
+        Fp12 a1, a2;
+        pairing(a1,agg,p.protocol->crv.g2);
         Fp12::pow(a1,a1,ai);
-        Fp12::pow(a2,p.protocol->crv.e,proof.snipblinds[i]);
-        Fp12::mul(a3,a1,a2);
-        proof.cmtSnip.push_back(a3);
+        p.tables->e.Pow(a2,proof.snipblinds[0]);
+        Fp12::mul(proof.cmtSnip[0],a1,a2);
+    } else {
+        STAT_COUNT(PAIRING,snip.size());
+        STAT_COUNT(GT_POW,snip.size());
+        for(size_t i = 0; i < snip.size(); i++) {
+            Fp12 a1, a2;
+            pairing(a1,proof.SiV[i],p.protocol->crv.g2);
+            Fp12::pow(a1,a1,ai);
+            p.tables->e.Pow(a2,proof.snipblinds[i]);
+            Fp12::mul(proof.cmtSnip[i],a1,a2);
+        }
     }
 
-    Fr fsc2;
-    FiatShamir<G1>(proof.cmtL,proof.cmtY,p.protocol->iH,fsc2);
+    AbsorbCommitments(t,proof.cmtPf1,proof.cmtPf2,proof.cmtPf2b,proof.cmtPf3,
+        proof.cmtPf4,proof.cmtY,proof.cmtSnip);
+    Challenges(t,proof.challenge,proof.row_challenge,proof.snip_challenge);
+    const Fr& fsc = proof.challenge;
+    const Fr& fsc4 = proof.row_challenge;
+    const Fr& fsc2 = proof.snip_challenge;
 
     // the randoms used to populate the schnorr style commits
+    STAT_NEXT(phase,PROVE_RESPONSE);
     std::array<Fr,SECRET_COUNT> randoms = {proof.pf1a, proof.pf1b, proof.pf2a,
         proof.pf2b, proof.pf2c};
     std::copy(proof.pf3.begin(),proof.pf3.end(),randoms.begin()+5);
@@ -348,138 +593,458 @@ void philips::NewZkProof(const std::vector<size_t>& disclose,
     }
 
     // snips seperately as dynamic
-    Fr zy,zt,lcpy;
+    Fr zy,zt;
     Fr::mul(zy,drec.sig.l,fsc2);
-    Fr::sub(lcpy,proof.pfl1a,zy);
-    proof.snip_response.push_back(lcpy);
+    Fr::sub(proof.snip_response[0],proof.pfl1a,zy);
     Fr::mul(zt,proof.lblind,fsc2);
-    Fr::sub(lcpy,proof.pfl1b,zt);
-    proof.snip_response.push_back(lcpy);
+    Fr::sub(proof.snip_response[1],proof.pfl1b,zt);
     for(size_t i = 0; i < proof.snipblinds.size(); i ++) {
         Fr mult;
-        Fr::mul(mult,proof.v[i],fsc2);
-        Fr::sub(lcpy,proof.snipblinds[i],mult);
-        proof.snip_response.push_back(lcpy);
+        Fr::mul(mult,proof.aggregated ? vsum : proof.v[i],fsc2);
+        Fr::sub(proof.snip_response[2+i],proof.snipblinds[i],mult);
+    }
+    return true;
+}
+
+bool philips::NewZkProof(const std::vector<size_t>& disclose, 
+    const std::vector<size_t>& snip, const G2& tablekey, const DeidRecord& drec, 
+    ZkProofKnowledge& proof, const Prover& p) 
+{
+    return NewZkProof(disclose,snip,TableContext(*p.protocol,tablekey,0),drec,proof,p);
+}
+
+// the snip parts have to line up with the disclosed snips before anything is absorbed
+template <typename P>
+static bool SnipShape(const P& proof, size_t snipcount, size_t commitments)
+{
+    if(proof.aggregated && snipcount == 0) return false;
+    const size_t blinds = proof.aggregated ? 1 : snipcount;
+    return proof.SiV.size() == snipcount && commitments == blinds &&
+        proof.snip_response.size() == blinds + 2;
+}
+
+// disclosed indices name distinct messages
+static bool DisclosedShape(DisclosedView disclosed)
+{
+    std::array<bool,MESSAGE_COUNT> seen = {};
+    for(const std::pair<std::string,size_t>& d : disclosed) {
+        if(d.second >= MESSAGE_COUNT || seen[d.second]) return false;
+        seen[d.second] = true;
     }
+    return true;
+}
+
+// the keys a proof refers to, null when the trust layer does not have them
+template <typename P>
+static const G2* ProofIssuer(const P& proof, size_t snipcount, const TrustLayer& trust)
+{
+    if(snipcount > 0 && !trust.BBKey(proof.bbkey)) return nullptr;
+    return trust.Issuer(proof.issuer);
+}
+
+static bool Verdict(VerifyStatus* status, VerifyStatus why)
+{
+    if(status) *status = why;
+    return why == VERIFY_OK;
 }
 
 /**
- * Verify the response to a challenge 
+ * The G1 part of the signature statement: absorbs the disclosed values & computes
+ * top = g0 * prod gi^mi * U * L
  * -----------------------------------------------
  */
-bool philips::VerifyProof(const ZkProof& proof, const G2& tablekey,
-    const std::vector<std::string>& snips, 
-    std::vector<std::pair<std::string,size_t>>& disclosed, Verifier& v)
-{
-    // PROCESS the proof
-    Fp12 left, newtop, leftbottom, lefttop;
-    G1 addtop;
-
-    // set left bottom & top
-    pairing(leftbottom,proof.cmtA,v.trust.pub);
-    addtop = v.protocol->generators[0];
-
-    // adjust top 
-    G1::add(addtop,addtop,proof.cmtU);
-    G1::add(addtop,addtop,proof.cmtL);
-
-    // deal with the disclosed info
-    std::sort(disclosed.begin(),disclosed.end(), 
-        [](const std::pair<std::string,size_t>&a,const std::pair<std::string,size_t>& b) 
-            { return a.second < b.second; }); 
-    for(auto pair: disclosed) {
+static void DisclosedStatement(const G1& cmtU, const G1& cmtL, DisclosedView disclosed,
+    Transcript& t, const Verifier& v, G1& top)
+{
+    STAT_COUNT(G1_MUL,disclosed.size());
+    STAT_COUNT(HASH,disclosed.size());
+    top = v.protocol->generators[0];
+    G1::add(top,top,cmtU);
+    G1::add(top,top,cmtL);
+
+    // deal with the disclosed info in message order, DisclosedShape made the indices
+    // distinct & in range
+    std::array<const std::string*,MESSAGE_COUNT> values = {};
+    for(const std::pair<std::string,size_t>& d : disclosed) {
+        values[d.second] = &d.first;
+    }
+    for(size_t i = 0; i < MESSAGE_COUNT; i++) {
+        if(!values[i]) continue;
         G1 tmp;
         Fr hash;
-        hash.setHashOf(pair.first);
-        G1::mul(tmp,v.protocol->generators[pair.second+1],hash);
-        G1::add(addtop,addtop,tmp);
+        hash.setHashOf(*values[i]);
+        t.Absorb("disclosed",(uint64_t) i);
+        t.Absorb("value",hash);
+        G1::mul(tmp,v.protocol->generators[i+1],hash);
+        G1::add(top,top,tmp);
     }
-    pairing(lefttop,addtop,v.protocol->crv.g2);  
+}
+
+/**
+ * The pairings of the signature proof: left = e(top, g2) / e(A, pub) & abase = e(A, g2)
+ * -----------------------------------------------
+ */
+static void SignatureStatement(const G1& cmtA, const G1& top, const IssuerContext& issuer,
+    const Verifier& v, Fp12& left, Fp12& abase)
+{
+    STAT_COUNT(PAIRING,3);
+    Fp12 leftbottom, lefttop;
+    precomputedMillerLoop(leftbottom,cmtA,issuer.lines);
+    finalExp(leftbottom,leftbottom);
+    pairing(lefttop,top,v.protocol->crv.g2);  
     Fp12::div(left,lefttop,leftbottom);
+    pairing(abase,cmtA,v.protocol->crv.g2);
+}
+
+/**
+ * The statement of the uniqueness proof: left4 = e(U, g2) / rowId against the bases
+ * e(uH, tablekey) of the table & e(uH, g2), e(iH, g2) at the end of the pairings
+ * -----------------------------------------------
+ */
+static void RowStatement(const G1& cmtU, const Fp12& rowId, const Verifier& v,
+    Fp12& left4)
+{
+    STAT_COUNT(PAIRING,1);
+    pairing(left4,cmtU,v.protocol->crv.g2);
+    Fp12::div(left4,left4,rowId);    
+}
+
+/**
+ * The statement of one snip proof: e(SiV, bbkey * g2^H(snip)) against e(SiV, g2)
+ * -----------------------------------------------
+ */
+static void SnipStatement(const G1& siv, const std::string& snip, const G2& bbkey,
+    const Verifier& v, Fp12& lpair, Fp12& sivpair)
+{
+    STAT_COUNT(PAIRING,2);
+    STAT_COUNT(G2_MUL,1);
+    STAT_COUNT(HASH,1);
+    Fr hash;
+    G2 second;
+    hash.setHashOf(snip);
+    G2::mul(second,v.protocol->crv.g2,hash);
+    G2::add(second,bbkey,second);
+    pairing(lpair,siv,second);
+    pairing(sivpair,siv,v.protocol->crv.g2);
+}
+
+/**
+ * The statement of an aggregated snip proof: with A = sum wi SiVi & C = sum wi H(snipi)
+ * SiVi the product of the snip statements is e(A, bbkey) e(C, g2) against e(A, g2)
+ * -----------------------------------------------
+ */
+static void AggregateSnipStatement(const std::vector<G1>& SiV, SnipView snips,
+    const std::vector<Fr>& weights, 
+    const BBKeyContext& bbkey, const Verifier& v, Fp12& lpair, Fp12& apair)
+{
+    STAT_COUNT(PAIRING,3);
+    STAT_COUNT(G1_MUL,2 * snips.size());
+    STAT_COUNT(HASH,snips.size());
+    G1 A, C;
+    A.clear();
+    C.clear();
+    for(size_t i = 0; i < snips.size(); i++) {
+        Fr hash;
+        G1 tmp;
+        hash.setHashOf(snips[i]);
+        G1::mul(tmp,SiV[i],weights[i]);
+        G1::add(A,A,tmp);
+        G1::mul(tmp,tmp,hash);
+        G1::add(C,C,tmp);
+    }
+
+    // one final exponentiation for the product of the two left pairings
+    Fp12 ml;
+    precomputedMillerLoop(lpair,A,bbkey.lines);
+    millerLoop(ml,C,v.protocol->crv.g2);
+    Fp12::mul(lpair,lpair,ml);
+    finalExp(lpair,lpair);
+    pairing(apair,A,v.protocol->crv.g2);
+}
+
+// the buffers of the verifier, per thread, they grow to the largest row seen & stay
+struct VerifyScratch {
+    std::vector<Fr> weights;   // aggregated snip weights
+    std::vector<Fp12> cmtSnip; // recomputed snip commitments of the challenge form
+};
+
+static VerifyScratch& Scratch()
+{
+    static thread_local VerifyScratch s;
+    return s;
+}
 
-    // update pairing
-    pairing(v.pairings[0],proof.cmtA,v.protocol->crv.g2);
+/**
+ * Verify the response to a challenge 
+ * -----------------------------------------------
+ */
+bool philips::VerifyProof(const ZkProof& proof, const TableContext& table, SnipView snips,
+    DisclosedView disclosed, const Verifier& v, VerifyStatus* status)
+{
+    STAT_PHASE(verify,VERIFY);
+    STAT_TIMER(phase,VERIFY_G1);
 
-    // compute fiat-shamir
-    Fr fsc;
-    Fp12 p0 = v.pairings[0];
-    FiatShamir<Fp12>(proof.cmtPf3,left,p0,fsc);
+    // structure first, nothing below reads past a malformed proof
+    if(!SnipShape(proof,snips.size(),proof.cmtSnip.size())) {
+        return Verdict(status,VERIFY_SHAPE);
+    }
+    if(!DisclosedShape(disclosed)) return Verdict(status,VERIFY_DISCLOSED);
+    const G2* pub = ProofIssuer(proof,snips.size(),v.trust);
+    if(!pub) return Verdict(status,VERIFY_KEY);
+
+    // the challenges only need the transcript
+    G1 top;
+    Transcript t("zkdeid row proof");
+    AbsorbStatement(t,*pub,table.tablekey);
+    DisclosedStatement(proof.cmtU,proof.cmtL,disclosed,t,v,top);
+    for(const std::string& snip : snips) {
+        t.Absorb("snip",snip);
+    }
+    Fr fsc, fsc4, fsc2;
+    std::vector<Fr>& weights = Scratch().weights;
+    AbsorbRow(t,proof);
+    if(proof.aggregated) {
+        SnipWeights(t,snips.size(),weights);
+    }
+    AbsorbCommitments(t,proof.cmtPf1,proof.cmtPf2,proof.cmtPf2b,proof.cmtPf3,
+        proof.cmtPf4,proof.cmtY,proof.cmtSnip);
+    Challenges(t,fsc,fsc4,fsc2);
 
     // simplified calling
-    const std::array<G1,2> pf1gens = {v.protocol->crv.g1,v.protocol->iH};
-    const std::array<G1,2> pfl1gens = {v.protocol->lH,v.protocol->iH};
+    const std::array<G1,2>& pf1gens = v.protocol->cmtgens;
+    const std::array<G1,2>& pfl1gens = v.protocol->lgens;
     const std::array<G1,1> pf2gens = {proof.cmtB};
 
-    // check proof 1
+    // the G1 equations: proofs 1, 2a & 2b, then the knowledge behind cmtL
     if (!VerifySchnorrProofG1<RESPONSE_COUNT,2>(proof.cmtB,proof.cmtPf1,fsc,
-        proof.response.begin(),pf1gens.begin())) {
-        return false;
+        proof.response.begin(),pf1gens.begin()) ||
+        !VerifySchnorrProofG1<RESPONSE_COUNT,1>(proof.cmtBc,proof.cmtPf2,fsc,
+        (proof.response.begin() + 2),pf2gens.begin()) ||
+        !VerifySchnorrProofG1<RESPONSE_COUNT,2>(proof.cmtBc,proof.cmtPf2b,fsc,
+        (proof.response.begin() + 3),pf1gens.begin())) {
+        return Verdict(status,VERIFY_COMMITMENT);
     }
-
-    // check proof 2a
-    if (!VerifySchnorrProofG1<RESPONSE_COUNT,1>(proof.cmtBc,proof.cmtPf2,fsc,
-        (proof.response.begin() + 2),pf2gens.begin())) {
-        return false;
+    std::array<Fr,2> fixresp = { proof.snip_response[0], proof.snip_response[1] };
+    if (!VerifySchnorrProofG1<2,2>(proof.cmtL,proof.cmtY,fsc2,fixresp.begin(),
+        pfl1gens.begin())){
+        return Verdict(status,VERIFY_SNIP_SECRET);
     }
 
-    // check proof 2b 
-    if (!VerifySchnorrProofG1<RESPONSE_COUNT,2>(proof.cmtBc,proof.cmtPf2b,fsc,
-        (proof.response.begin() + 3),pf1gens.begin())) {
-        return false;
-    }
+    // uniqueness, the cheapest of the pairing checks
+    STAT_NEXT(phase,VERIFY_ROW);
+    Fp12 left4;
+    RowStatement(proof.cmtU,proof.rowId,v,left4);
+    const std::array<const GtFixedBase*,1> rowlead = {{ &table.rowbase }};
+    if (!VerifySchnorrProofGt<ROW_RESPONSE_COUNT,ROW_PROOF_COUNT,1>(left4,proof.cmtPf4,
+        fsc4,proof.row_response.begin(),rowlead,
+        v.tables->pairings.begin() + PAIRING_COUNT - 2)) {
+        return Verdict(status,VERIFY_ROW);
+    } 
 
-    // check proof 3 
-    if (!VerifySchnorrProofGt<RESPONSE_COUNT,PROOF_COUNT>(left,proof.cmtPf3,fsc,
-        (proof.response.begin() + 5),v.pairings.begin())) {
-        return false;
+    // check proof 3, e(A, g2) & e(iH, pub) lead the fixed bases
+    STAT_NEXT(phase,VERIFY_PF3);
+    std::shared_ptr<const IssuerContext> held;
+    const IssuerContext& issuer = IssuerOf(table,v,proof.issuer,*pub,held);
+    Fp12 left, abase;
+    SignatureStatement(proof.cmtA,top,issuer,v,left,abase);
+    const GtFixedBase plain(abase,0);
+    const std::array<const GtFixedBase*,2> leads = {{ &plain, &issuer.ipub }};
+    if (!VerifySchnorrProofGt<RESPONSE_COUNT,PROOF_COUNT,2>(left,proof.cmtPf3,fsc,
+        (proof.response.begin() + 5),leads,v.tables->pairings.begin() + 2)) {
+        return Verdict(status,VERIFY_SIGNATURE);
     } 
 
-    // uniqueness time
-    Fp12 left4;
-    pairing(left4,proof.cmtU,v.protocol->crv.g2);
-    Fp12::div(left4,left4,proof.rowId);    
-    pairing(v.pairings[PAIRING_COUNT-3],v.protocol->uH,tablekey); 
+    // snip time
+    STAT_NEXT(phase,VERIFY_SNIPS);
+    // e(SiV, g2) is per proof & e is tabled
+    Fr::neg(fixresp[0],proof.snip_response[0]);
+    if(proof.aggregated) {
+        Fp12 lpair, apair;
+        std::shared_ptr<const BBKeyContext> held;
+        AggregateSnipStatement(proof.SiV,snips,weights,BBKeyOf(table,v,proof.bbkey,held),v,
+            lpair,apair);
+        fixresp[1] = proof.snip_response[2];
+        const GtFixedBase plain(apair,0);
+        const std::array<const GtFixedBase*,1> lead = {{ &plain }};
+        if(!VerifySchnorrProofGt<2,2,1>(lpair,proof.cmtSnip[0],fsc2,fixresp.begin(),
+            lead,&v.tables->e)) {
+            return Verdict(status,VERIFY_SNIPS);
+        }
+        return Verdict(status,VERIFY_OK);
+    }
+    for(size_t i = 0; i < snips.size(); i++) {
+        Fp12 lpair,sivpair;
+        SnipStatement(proof.SiV[i],snips[i],v.trust.bbkeys[proof.bbkey],v,lpair,sivpair);
+        fixresp[1] = proof.snip_response[2+i];
+        const GtFixedBase plain(sivpair,0);
+        const std::array<const GtFixedBase*,1> lead = {{ &plain }};
+        if (!VerifySchnorrProofGt<2,2,1>(lpair,proof.cmtSnip[i],fsc2,fixresp.begin(),
+            lead,&v.tables->e)){
+            return Verdict(status,VERIFY_SNIPS);
+        }
+    }
 
-    Fr fsc4;
-    FiatShamir<Fp12>(proof.cmtPf4,left4,v.pairings[PAIRING_COUNT-3],fsc4);
+    return Verdict(status,VERIFY_OK);
+}
 
-    if (!VerifySchnorrProofGt<ROW_RESPONSE_COUNT,ROW_PROOF_COUNT>(left4,proof.cmtPf4,
-        fsc4,proof.row_response.begin(),v.pairings.begin()+PROOF_COUNT)) {
-        return false;
-    } 
+bool philips::VerifyProof(const ZkProof& proof, const G2& tablekey, SnipView snips,
+    DisclosedView disclosed, const Verifier& v)
+{
+    return VerifyProof(proof,TableContext(*v.protocol,tablekey,0),snips,disclosed,v);
+}
 
-    // snip time
-    Fr fsc2;
-    FiatShamir<G1>(proof.cmtL,proof.cmtY,v.protocol->iH,fsc2);
 
+/**
+ * Drop the commitments of a proof, keeping the challenges that bind them
+ * -----------------------------------------------
+ */
+void philips::CompactProof(const ZkProofKnowledge& proof, ZkChallengeProof& compact)
+{
+    compact.aggregated = proof.aggregated;
+    compact.issuer = proof.issuer;
+    compact.bbkey = proof.bbkey;
+    compact.cmtA = proof.cmtA;
+    compact.cmtB = proof.cmtB;
+    compact.cmtBc = proof.cmtBc;
+    compact.SiV = proof.SiV;
+    compact.rowId = proof.rowId;
+    compact.cmtU = proof.cmtU;
+    compact.cmtL = proof.cmtL;
+    compact.challenge = proof.challenge;
+    compact.row_challenge = proof.row_challenge;
+    compact.snip_challenge = proof.snip_challenge;
+    compact.response = proof.response;
+    compact.row_response = proof.row_response;
+    compact.snip_response = proof.snip_response;
+}
+
+
+/**
+ * Verify a proof in challenge form: recompute the commitments from the responses and
+ * check that they hash to the shipped challenges
+ * -----------------------------------------------
+ */
+bool philips::VerifyChallengeProof(const ZkChallengeProof& proof, 
+    const TableContext& table, SnipView snips, DisclosedView disclosed, const Verifier& v,
+    VerifyStatus* status)
+{
+    STAT_PHASE(verify,VERIFY);
+    STAT_TIMER(phase,VERIFY_G1);
+    if(!SnipShape(proof,snips.size(),proof.aggregated ? 1 : snips.size())) {
+        return Verdict(status,VERIFY_SHAPE);
+    }
+    if(!DisclosedShape(disclosed)) return Verdict(status,VERIFY_DISCLOSED);
+    const G2* pub = ProofIssuer(proof,snips.size(),v.trust);
+    if(!pub) return Verdict(status,VERIFY_KEY);
+
+    G1 top;
+    Transcript t("zkdeid row proof");
+    AbsorbStatement(t,*pub,table.tablekey);
+    DisclosedStatement(proof.cmtU,proof.cmtL,disclosed,t,v,top);
+    for(const std::string& snip : snips) {
+        t.Absorb("snip",snip);
+    }
+    AbsorbRow(t,proof);
+    VerifyScratch& scratch = Scratch();
+    std::vector<Fr>& weights = scratch.weights;
+    if(proof.aggregated) {
+        SnipWeights(t,snips.size(),weights);
+    }
+
+    const Fr& fsc = proof.challenge;
+    const Fr& fsc4 = proof.row_challenge;
+    const Fr& fsc2 = proof.snip_challenge;
+    const std::array<G1,2>& pf1gens = v.protocol->cmtgens;
+    const std::array<G1,2>& pfl1gens = v.protocol->lgens;
+    const std::array<G1,1> pf2gens = {proof.cmtB};
+
+    // proofs 1, 2a & 2b
+    G1 cmtPf1, cmtPf2, cmtPf2b;
+    SchnorrCommitmentG1<RESPONSE_COUNT,2>(proof.cmtB,fsc,proof.response.begin(),
+        pf1gens.begin(),cmtPf1);
+    SchnorrCommitmentG1<RESPONSE_COUNT,1>(proof.cmtBc,fsc,proof.response.begin() + 2,
+        pf2gens.begin(),cmtPf2);
+    SchnorrCommitmentG1<RESPONSE_COUNT,2>(proof.cmtBc,fsc,proof.response.begin() + 3,
+        pf1gens.begin(),cmtPf2b);
+
+    // proof 3
+    STAT_NEXT(phase,VERIFY_PF3);
+    std::shared_ptr<const IssuerContext> held;
+    const IssuerContext& issuer = IssuerOf(table,v,proof.issuer,*pub,held);
+    Fp12 left, abase, cmtPf3;
+    SignatureStatement(proof.cmtA,top,issuer,v,left,abase);
+    const GtFixedBase plain(abase,0);
+    const std::array<const GtFixedBase*,2> leads = {{ &plain, &issuer.ipub }};
+    SchnorrCommitmentGt<RESPONSE_COUNT,PROOF_COUNT,2>(left,fsc,
+        proof.response.begin() + 5,leads,v.tables->pairings.begin() + 2,cmtPf3);
+
+    // uniqueness
+    STAT_NEXT(phase,VERIFY_ROW);
+    Fp12 left4, cmtPf4;
+    RowStatement(proof.cmtU,proof.rowId,v,left4);
+    const std::array<const GtFixedBase*,1> rowlead = {{ &table.rowbase }};
+    SchnorrCommitmentGt<ROW_RESPONSE_COUNT,ROW_PROOF_COUNT,1>(left4,fsc4,
+        proof.row_response.begin(),rowlead,v.tables->pairings.begin() + PAIRING_COUNT - 2,
+        cmtPf4);
+
+    // snips
+    STAT_NEXT(phase,VERIFY_SNIPS);
+    G1 cmtY;
     std::array<Fr,2> fixresp = { proof.snip_response[0], proof.snip_response[1] };
-    if (!VerifySchnorrProofG1<2,2>(proof.cmtL,proof.cmtY,fsc2,fixresp.begin(),
-        pfl1gens.begin())){
-        return false;
+    SchnorrCommitmentG1<2,2>(proof.cmtL,fsc2,fixresp.begin(),pfl1gens.begin(),cmtY);
+
+    std::vector<Fp12>& cmtSnip = scratch.cmtSnip;
+    cmtSnip.resize(proof.snip_response.size() - 2);
+    Fr::neg(fixresp[0],proof.snip_response[0]);
+    if(proof.aggregated) {
+        Fp12 lpair, apair;
+        std::shared_ptr<const BBKeyContext> held;
+        AggregateSnipStatement(proof.SiV,snips,weights,BBKeyOf(table,v,proof.bbkey,held),v,
+            lpair,apair);
+        fixresp[1] = proof.snip_response[2];
+        const GtFixedBase plain(apair,0);
+        const std::array<const GtFixedBase*,1> lead = {{ &plain }};
+        SchnorrCommitmentGt<2,2,1>(lpair,fsc2,fixresp.begin(),lead,&v.tables->e,
+            cmtSnip[0]);
     }
-    
-    std::array<Fp12,2> gens = { v.protocol->crv.e, v.protocol->crv.e };
-    Fr negative;
-    Fr::neg(negative,proof.snip_response[0]);
-    fixresp[0] = negative;
-    for(size_t i = 0; i < snips.size(); i++) {
-        Fr hash;
-        G2 second;
+    for(size_t i = 0; !proof.aggregated && i < snips.size(); i++) {
         Fp12 lpair,sivpair;
-        hash.setHashOf(snips.at(i));
-        G2::mul(second,v.protocol->crv.g2,hash);
-        G2::add(second,v.trust.bbkeys[0],second);
-        pairing(lpair,proof.SiV[i],second);
-        pairing(sivpair,proof.SiV[i],v.protocol->crv.g2);
+        SnipStatement(proof.SiV[i],snips[i],v.trust.bbkeys[proof.bbkey],v,lpair,sivpair);
         fixresp[1] = proof.snip_response[2+i];
-        gens[0] = sivpair;
-        if (!VerifySchnorrProofGt<2,2>(lpair,proof.cmtSnip[i],fsc2,fixresp.begin(),
-            gens.begin())){
-            return false;
-        }
+        const GtFixedBase plain(sivpair,0);
+        const std::array<const GtFixedBase*,1> lead = {{ &plain }};
+        SchnorrCommitmentGt<2,2,1>(lpair,fsc2,fixresp.begin(),lead,&v.tables->e,
+            cmtSnip[i]);
     }
 
-    return true;
+    // the recomputed commitments have to reproduce every challenge
+    Fr c, c4, c2;
+    AbsorbCommitments(t,cmtPf1,cmtPf2,cmtPf2b,cmtPf3,cmtPf4,cmtY,cmtSnip);
+    Challenges(t,c,c4,c2);
+    const bool ok = c == fsc && c4 == fsc4 && c2 == fsc2;
+    return Verdict(status,ok ? VERIFY_OK : VERIFY_CHALLENGE);
+}
+
+
+bool philips::VerifyChallengeProof(const ZkChallengeProof& proof, const G2& tablekey,
+    SnipView snips, DisclosedView disclosed, const Verifier& v)
+{
+    return VerifyChallengeProof(proof,TableContext(*v.protocol,tablekey,0),snips,
+        disclosed,v);
+}
+
+
+/**
+ * The name of a rejection reason
+ * -----------------------------------------------
+ */
+const char* philips::StatusName(VerifyStatus status)
+{
+    static const char* names[VERIFY_STATUS_COUNT] = {
+        "ok", "shape", "disclosed", "key", "duplicate row", "commitment", "snip secret",
+        "row", "signature", "snips", "challenge"
+    };
+    return status < VERIFY_STATUS_COUNT ? names[status] : "unknown";
 }
 
 
@@ -487,6 +1052,143 @@ bool philips::VerifyProof(const ZkProof& proof, const G2& tablekey,
  * Table Business
  *-------------------------------------------------------------------------------------*/
 
+/**
+ * The seed of a row in derived nonce mode, it binds everything the proof depends on so
+ * a nonce is never reused for a different statement
+ * -----------------------------------------------
+ */
+static void RowSeed(const Prover& p, size_t row, 
+    const std::pair<size_t,std::vector<size_t>>& discl,
+    const std::pair<size_t,std::vector<size_t>>& disclsnip, uint8_t seed[32])
+{
+    char buf[Fr_size];
+    const DeidRecord& drec = p.drecords[discl.first];
+    Transcript t("zkdeid row nonce");
+    t.Absorb("secret",p.nonce_secret);
+    t.Absorb("tablekey",p.table->tablekey);
+    t.Absorb("row",(uint64_t) row);
+    t.Absorb("record",(uint64_t) discl.first);
+    t.Absorb("sigma",drec.sig.sigma);
+    t.Absorb("l",drec.sig.l);
+    t.Absorb("issuer",(uint64_t) drec.issuer);
+    t.Absorb("bbkey",(uint64_t) drec.bbkey);
+    const G2* issuer = p.trust.Issuer(drec.issuer);
+    const G2* bbkey = p.trust.BBKey(drec.bbkey);
+    if(issuer) t.Absorb("issuer pub",*issuer);
+    if(bbkey) t.Absorb("bbkey pub",*bbkey);
+    t.Absorb("aggregated",(uint64_t) p.aggregate_snips);
+    t.Absorb("disclosed",(uint64_t) discl.second.size());
+    for(size_t n : discl.second) {
+        t.Absorb("index",(uint64_t) n);
+        if(n < MESSAGE_COUNT) t.Absorb("message",drec.record[n]);
+    }
+    t.Absorb("snips",(uint64_t) disclsnip.second.size());
+    for(size_t n : disclsnip.second) {
+        t.Absorb("index",(uint64_t) n);
+        if(n >= drec.snips.size()) continue;
+        t.Absorb("snip",drec.snips[n].first);
+        t.Absorb("snip sig",drec.snips[n].second);
+    }
+    Fr c;
+    t.Challenge("seed",c);
+    c.serialize(buf,sizeof(buf));
+    memcpy(seed,buf,32);
+    memset(buf,0,sizeof(buf));
+}
+
+// prove one row, with randomness derived from the row when the prover has a secret
+static bool ProveRow(const Prover& p, const TableContext& table, size_t row,
+    const std::pair<size_t,std::vector<size_t>>& discl,
+    const std::pair<size_t,std::vector<size_t>>& disclsnip, ZkProofKnowledge& proof)
+{
+    const DeidRecord& drec = p.drecords[discl.first];
+    if(p.nonce_secret.empty()) {
+        return NewZkProof(discl.second,disclsnip.second,table,drec,proof,p);
+    }
+    uint8_t seed[32];
+    RowSeed(p,row,discl,disclsnip,seed);
+    rng::ScopedSeed scope(seed,sizeof(seed));
+    memset(seed,0,sizeof(seed));
+    return NewZkProof(discl.second,disclsnip.second,table,drec,proof,p);
+}
+
+// the record, messages & snips a row request names & the keys NewZkProof will look up
+static bool RowRequest(const Prover& p,
+    const std::pair<size_t,std::vector<size_t>>& discl,
+    const std::pair<size_t,std::vector<size_t>>& disclsnip)
+{
+    if(discl.first >= p.drecords.size()) return false;
+    const DeidRecord& drec = p.drecords[discl.first];
+    for(size_t n : discl.second) {
+        if(n >= MESSAGE_COUNT) return false;
+    }
+    for(size_t n : disclsnip.second) {
+        if(n >= drec.snips.size()) return false;
+    }
+    if(!p.trust.Issuer(drec.issuer)) return false;
+    return disclsnip.second.empty() || p.trust.BBKey(drec.bbkey);
+}
+
+/**
+ * Prove rows into the table of the prover from row first on, rows & knowledge already
+ * there are overwritten in place: strings & vectors keep their capacity & the proofs
+ * are made straight into the knowledge, or into one scratch proof per call in derived
+ * nonce mode, so a warmed up prover allocates nothing per row. The keys of the rows are
+ * added to the table context up front, a row that fails drops the rows from first on
+ * -----------------------------------------------
+ */
+static bool ProveRows(Prover& p, size_t first,
+    const std::pair<size_t,std::vector<size_t>>* discl, 
+    const std::pair<size_t,std::vector<size_t>>* disclsnip, size_t rowcount)
+{
+    for(size_t i = 0; i < rowcount; i++) {
+        if(!RowRequest(p,discl[i],disclsnip[i])) return false;
+    }
+    const bool derived = !p.nonce_secret.empty();
+    std::vector<Row>& rows = p.table->deidrows;
+    rows.resize(first + rowcount);
+    if(!derived) {
+        if(!p.knowledge) {
+            p.knowledge.reset(new std::vector<std::pair<size_t,ZkProofKnowledge>>());
+        }
+        p.knowledge->resize(first + rowcount);
+    }
+    ZkProofKnowledge scratch;
+    TableContext context(*p.protocol,p.table->tablekey,TableContext::Window(rowcount));
+    for(size_t i = 0; i < rowcount; i++) {
+        const DeidRecord& drec = p.drecords[discl[i].first];
+        context.AddKeys(p,drec.issuer,drec.bbkey,!disclsnip[i].second.empty());
+    }
+    for(size_t i = 0; i < rowcount; i++) {
+        const size_t index = discl[i].first;
+        const DeidRecord& drec = p.drecords[index];
+        ZkProofKnowledge* proof = &scratch;
+        if(!derived) {
+            (*p.knowledge)[first + i].first = index;
+            proof = &(*p.knowledge)[first + i].second;
+        }
+        if(!ProveRow(p,context,first + i,discl[i],disclsnip[i],*proof)) {
+            rows.resize(first);
+            if(!derived) p.knowledge->resize(first);
+            return false;
+        }
+
+        Row& row = rows[first + i];
+        row.disclosed.resize(discl[i].second.size());
+        for(size_t k = 0; k < discl[i].second.size(); k++) {
+            const size_t n = discl[i].second[k];
+            row.disclosed[k].first = drec.record[n];
+            row.disclosed[k].second = n;
+        }
+        row.snips.resize(disclsnip[i].second.size());
+        for(size_t k = 0; k < disclsnip[i].second.size(); k++) {
+            row.snips[k] = drec.snips[disclsnip[i].second[k]].first;
+        }
+        row.proof = *proof;
+    }
+    return true;
+}
+
 /**
  * Create a new table of deidentified data
  * -----------------------------------------------
@@ -495,48 +1197,349 @@ void philips::NewTable(const std::string& phrase, Prover &p,
     const std::pair<size_t,std::vector<size_t>>* discl, 
     const std::pair<size_t,std::vector<size_t>>* disclsnip, size_t rowcount)
 {
-    p.table.reset(new Table(rowcount,phrase));
-    p.knowledge.reset(new std::vector<std::pair<size_t,ZkProofKnowledge>>());
-    p.knowledge->reserve(rowcount);
+    // an earlier table is rebuilt in place, its rows & knowledge keep their capacity
+    if(p.table) hashAndMapToG2(p.table->tablekey,phrase);
+    else p.table.reset(new Table(rowcount,phrase));
+    if(!p.nonce_secret.empty()) p.knowledge.reset();
+    if(!ProveRows(p,0,discl,disclsnip,rowcount)) {
+        p.table->deidrows.clear();
+        if(p.knowledge) p.knowledge->clear();
+    }
+}
+
+
+/**
+ * Append rows to the table of the prover under the same tablekey
+ * -----------------------------------------------
+ */
+bool philips::AppendRows(Prover &p, const std::pair<size_t,std::vector<size_t>>* discl, 
+    const std::pair<size_t,std::vector<size_t>>* disclsnip, size_t rowcount)
+{
+    return p.table && ProveRows(p,p.table->deidrows.size(),discl,disclsnip,rowcount);
+}
+
+
+// every public field of two proofs, the rebuilt row has to be the one emitted
+static bool SameProof(const ZkProof& a, const ZkProof& b)
+{
+    return a.aggregated == b.aggregated && a.issuer == b.issuer && a.bbkey == b.bbkey &&
+        a.cmtA == b.cmtA && a.cmtB == b.cmtB && a.cmtPf1 == b.cmtPf1 &&
+        a.cmtBc == b.cmtBc && a.cmtPf2 == b.cmtPf2 && a.cmtPf2b == b.cmtPf2b &&
+        a.cmtPf3 == b.cmtPf3 && a.cmtPf4 == b.cmtPf4 && a.SiV == b.SiV &&
+        a.cmtSnip == b.cmtSnip && a.rowId == b.rowId && a.cmtU == b.cmtU &&
+        a.cmtL == b.cmtL && a.cmtY == b.cmtY && a.response == b.response &&
+        a.row_response == b.row_response && a.snip_response == b.snip_response;
+}
+
+/**
+ * Rebuild the knowledge of a row of a table made with Prover::nonce_secret
+ * -----------------------------------------------
+ */
+bool philips::RowKnowledge(Prover& p, size_t row,
+    const std::pair<size_t,std::vector<size_t>>& discl,
+    const std::pair<size_t,std::vector<size_t>>& disclsnip, ZkProofKnowledge& proof)
+{
+    if(p.nonce_secret.empty() || !p.table || row >= p.table->deidrows.size() ||
+        discl.first >= p.drecords.size()) {
+        return false;
+    }
+    proof = ZkProofKnowledge();
+    const TableContext context(*p.protocol,p.table->tablekey,0);
+    if(!ProveRow(p,context,row,discl,disclsnip,proof)) return false;
+    return SameProof(proof,p.table->deidrows[row].proof);
+}
+
+
+static bool TableVerdict(TableStatus* status, VerifyStatus why, size_t row)
+{
+    if(status) {
+        status->status = why;
+        status->row = row;
+    }
+    return why == VERIFY_OK;
+}
+
+static size_t Commitments(const ZkProof& proof, size_t)
+{
+    return proof.cmtSnip.size();
+}
+
+static size_t Commitments(const ZkChallengeProof& proof, size_t snips)
+{
+    return proof.aggregated ? 1 : snips;
+}
+
+// the first row whose rowId an earlier row has, the size of ids when none; ids holds the
+// RowFingerprint & the number of every row & is sorted in place, so equal rowIds meet
+static size_t FirstDuplicate(std::vector<std::pair<Digest,size_t>>& ids)
+{
+    std::sort(ids.begin(),ids.end());
+    size_t first = ids.size();
+    for(size_t i = 1; i < ids.size(); i++) {
+        if(ids[i].first == ids[i-1].first) first = std::min(first,ids[i].second);
+    }
+    return first;
+}
+
+// the shapes & the rowId uniqueness of every row, before any proof of the table
+template <typename R>
+static bool TableShape(const R* table, size_t rowcount, const Verifier& v,
+    TableStatus* status)
+{
+    std::vector<std::pair<Digest,size_t>> ids;
+    ids.reserve(rowcount);
     for(size_t i = 0; i < rowcount; i++) {
-        size_t index = (*(discl+i)).first;
-        ZkProofKnowledge proof;
-        NewZkProof((*(discl+i)).second,(*(disclsnip+i)).second,p.table->tablekey,
-            p.drecords[index],proof,p); 
-        p.knowledge->push_back(std::make_pair(index,proof));
-        std::vector<std::pair<std::string,size_t>> disclosed;
-        std::vector<std::string> snips;
-        for(size_t n : (*(discl+i)).second) { 
-            disclosed.push_back(std::make_pair(p.drecords[index].record[n],n));
+        const R& r = *(table+i);
+        if(!SnipShape(r.proof,r.snips.size(),Commitments(r.proof,r.snips.size()))) {
+            return TableVerdict(status,VERIFY_SHAPE,i);
         }
-        for(size_t n : (*(disclsnip+i)).second) { 
-            snips.push_back(p.drecords[index].snips[n].first);
+        if(!DisclosedShape(r.disclosed)) return TableVerdict(status,VERIFY_DISCLOSED,i);
+        if(!ProofIssuer(r.proof,r.snips.size(),v.trust)) {
+            return TableVerdict(status,VERIFY_KEY,i);
         }
-        Row r =  { disclosed, snips, (ZkProof) proof, proof.rowId };
-        p.table->deidrows.push_back(r);
+        ids.push_back(std::make_pair(RowFingerprint(r.proof.rowId),i));
     }
+    const size_t dup = FirstDuplicate(ids);
+    if(dup < rowcount) return TableVerdict(status,VERIFY_DUPLICATE_ROW,dup);
+    return true;
 }
 
 
 /**
- * Create a new table of deidentified data
+ * Check a table of deidentified data
  * -----------------------------------------------
  */
-bool philips::CheckTable(Verifier& v, const G2& tablekey, Row* table, size_t rowcount)
+bool philips::CheckTable(const Verifier& v, const G2& tablekey, const Row* table,
+    size_t rowcount, VerifyCache* cache, TableStatus* status)
 {
-    char buf[FP_SIZE];
-    std::hash<std::string> hash_fn;
-    std::unordered_map<size_t,int> map;
+    if(!TableShape(table,rowcount,v,status)) return false;
+    std::unique_ptr<TableContext> tablectx; // on the first row the cache misses
+    Digest context;
+    if(cache) context = CacheContext(v,tablekey);
     for(size_t i = 0; i < rowcount; i++){
-        (*(table+i)).rowId.serialize(buf,FP_SIZE);
-        std::string stringrep(buf);
-        size_t hashv = hash_fn(stringrep);
-        if(map.find(hashv) != map.end()) return false;
-        map[hashv] = 1;
-        if(!VerifyProof((*(table+i)).proof,tablekey,(*(table+i)).snips,
-            (*(table+i)).disclosed,v)) 
-            return false; 
+        Digest key;
+        if(cache) {
+            key = CacheKey(context,*(table+i));
+            if(cache->Contains(key)) continue;
+        }
+        if(!tablectx) {
+            tablectx.reset(new TableContext(*v.protocol,tablekey,
+                TableContext::Window(rowcount - i)));
+        }
+        tablectx->AddKeys(v,(*(table+i)).proof.issuer,(*(table+i)).proof.bbkey,
+            !(*(table+i)).snips.empty());
+        VerifyStatus why;
+        if(!VerifyProof((*(table+i)).proof,*tablectx,(*(table+i)).snips,
+            (*(table+i)).disclosed,v,&why)) {
+            return TableVerdict(status,why,i);
+        }
+        if(cache) cache->Insert(key);
     }
-    return true;
+    return TableVerdict(status,VERIFY_OK,0);
 }
 
+
+/**
+ * Check a table of rows in challenge form
+ * -----------------------------------------------
+ */
+bool philips::CheckTable(const Verifier& v, const G2& tablekey, const CompactRow* table,
+    size_t rowcount, TableStatus* status)
+{
+    if(!TableShape(table,rowcount,v,status)) return false;
+    TableContext context(*v.protocol,tablekey,TableContext::Window(rowcount));
+    for(size_t i = 0; i < rowcount; i++){
+        context.AddKeys(v,(*(table+i)).proof.issuer,(*(table+i)).proof.bbkey,
+            !(*(table+i)).snips.empty());
+        VerifyStatus why;
+        if(!VerifyChallengeProof((*(table+i)).proof,context,(*(table+i)).snips,
+            (*(table+i)).disclosed,v,&why)) {
+            return TableVerdict(status,why,i);
+        }
+    }
+    return TableVerdict(status,VERIFY_OK,0);
+}
+
+
+/**
+ * Check several tables together
+ * -----------------------------------------------
+ */
+bool philips::CheckTables(const Verifier& v, const Table* tables, size_t count,
+    size_t workers, std::vector<TableStatus>& status)
+{
+    // shapes, the tablekeys & the rows under each, then one context per tablekey with
+    // the keys of its rows before any thread starts
+    status.assign(count,TableStatus());
+    std::vector<const G2*> keys;
+    std::vector<size_t> proofs;
+    std::vector<size_t> context(count,0);
+    for(size_t t = 0; t < count; t++) {
+        const Table& table = *(tables+t);
+        const std::vector<Row>& rows = table.deidrows;
+        if(!TableShape(rows.data(),rows.size(),v,&status[t])) continue;
+        size_t& c = context[t];
+        while(c < keys.size() && !(*keys[c] == table.tablekey)) c++;
+        if(c == keys.size()) {
+            keys.push_back(&table.tablekey);
+            proofs.push_back(0);
+        }
+        proofs[c] += rows.size();
+    }
+    std::vector<std::unique_ptr<TableContext>> contexts;
+    for(size_t c = 0; c < keys.size(); c++) {
+        contexts.emplace_back(new TableContext(*v.protocol,*keys[c],
+            TableContext::Window(proofs[c])));
+    }
+    std::vector<std::pair<size_t,size_t>> work; // table, row
+    for(size_t t = 0; t < count; t++) {
+        const std::vector<Row>& rows = (tables+t)->deidrows;
+        if(status[t].status != VERIFY_OK) continue;
+        for(size_t i = 0; i < rows.size(); i++) {
+            contexts[context[t]]->AddKeys(v,rows[i].proof.issuer,rows[i].proof.bbkey,
+                !rows[i].snips.empty());
+            work.push_back(std::make_pair(t,i));
+        }
+    }
+
+    // rows are handed out one at a time, rows above a known bad row of their table skip
+    std::mutex m;
+    std::atomic<size_t> next(0);
+    auto verify = [&]() {
+        for(size_t j = next++; j < work.size(); j = next++) {
+            const size_t t = work[j].first, i = work[j].second;
+            {
+                std::lock_guard<std::mutex> lk(m);
+                if(status[t].status != VERIFY_OK && status[t].row < i) continue;
+            }
+            const Row& r = (tables+t)->deidrows[i];
+            VerifyStatus why;
+            if(VerifyProof(r.proof,*contexts[context[t]],r.snips,r.disclosed,v,&why)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lk(m);
+            if(status[t].status == VERIFY_OK || i < status[t].row) {
+                TableVerdict(&status[t],why,i);
+            }
+        }
+    };
+    workers = std::max<size_t>(1,std::min(workers,work.size()));
+    std::vector<std::thread> threads;
+    for(size_t w = 1; w < workers; w++) threads.push_back(std::thread(verify));
+    verify();
+    for(std::thread& th : threads) th.join();
+
+    bool all = true;
+    for(const TableStatus& s : status) all = all && s.status == VERIFY_OK;
+    return all;
+}
+
+
+/**
+ * Rows to verify so that bad rows out of rowcount are missed with probability at most
+ * 1 - confidence when sampling without replacement
+ * -----------------------------------------------
+ */
+static size_t SampleSize(size_t rowcount, size_t bad, double confidence, double& achieved)
+{
+    double miss = 1;
+    size_t n = 0;
+    while(n < rowcount && 1 - miss < confidence) {
+        miss *= (double) (rowcount - bad - std::min(n,rowcount - bad)) / (rowcount - n);
+        n++;
+    }
+    achieved = n == rowcount ? 1 : 1 - miss;
+    return n;
+}
+
+// uniform in [0, bound] without modulo bias
+static uint64_t Below(rng::Generator& g, uint64_t bound)
+{
+    const uint64_t range = bound + 1;
+    const uint64_t limit = range == 0 ? 0 : UINT64_MAX - UINT64_MAX % range;
+    uint64_t x;
+    do {
+        g.Fill(&x,sizeof(x));
+    } while(range != 0 && x >= limit);
+    return range == 0 ? x : x % range;
+}
+
+/**
+ * Audit a table by verifying a random sample of its rows
+ * -----------------------------------------------
+ */
+bool philips::SampleCheckTable(const Verifier& v, const G2& tablekey, const Row* table,
+    size_t rowcount, const std::string& seed, double confidence, double bad_fraction, 
+    SampleReport& report)
+{
+    rng::Bytes(report.nonce.data(),report.nonce.size());
+    CommitSeed(seed,report.nonce,report.commitment);
+    report.sampled = 0;
+    report.passed = false;
+    report.bad_fraction = bad_fraction;
+    report.confidence = 0;
+
+    // every row, and the sample depends on all of them
+    MerkleFrontier leaves;
+    std::vector<std::pair<Digest,size_t>> ids;
+    ids.reserve(rowcount);
+    for(size_t i = 0; i < rowcount; i++){
+        leaves.Append(RowLeaf(*(table+i)));
+        ids.push_back(std::make_pair(RowFingerprint((*(table+i)).proof.rowId),i));
+    }
+    report.rows = leaves.Root();
+    if(FirstDuplicate(ids) < rowcount) {
+        report.unique = false;
+        return false;
+    }
+    Transcript t("zkdeid sample");
+    t.Absorb("seed",seed);
+    t.Absorb("tablekey",tablekey);
+    t.Absorb("rows",(uint64_t) rowcount);
+    t.Absorb("root",std::string(report.rows.begin(),report.rows.end()));
+    report.unique = true;
+    if(rowcount == 0) {
+        report.confidence = 1;
+        return report.passed = true;
+    }
+
+    // Floyd's algorithm draws the sample without replacement
+    const double fraction = std::min(std::max(bad_fraction,0.0),1.0);
+    const size_t bad = std::max<size_t>(1,(size_t) std::ceil(fraction * rowcount));
+    const size_t n = SampleSize(rowcount,std::min(bad,rowcount),confidence,
+        report.confidence);
+    Fr key;
+    uint8_t keybytes[32];
+    t.Challenge("sample",key);
+    key.serialize(keybytes,sizeof(keybytes));
+    rng::ChaCha20Rng gen(keybytes);
+    std::unordered_set<size_t> pick;
+    pick.reserve(n);
+    for(size_t j = rowcount - n; j < rowcount; j++) {
+        const size_t r = (size_t) Below(gen,j);
+        if(!pick.insert(r).second) pick.insert(j);
+    }
+    std::vector<size_t> order(pick.begin(),pick.end());
+    std::sort(order.begin(),order.end());
+
+    TableContext context(*v.protocol,tablekey,TableContext::Window(order.size()));
+    for(size_t i : order) {
+        const Row& r = *(table+i);
+        report.sampled++;
+        context.AddKeys(v,r.proof.issuer,r.proof.bbkey,!r.snips.empty());
+        if(!VerifyProof(r.proof,context,r.snips,r.disclosed,v)) return false;
+    }
+    return report.passed = true;
+}
+
+/**
+ * The commitment to an audit seed
+ * -----------------------------------------------
+ */
+void philips::CommitSeed(const std::string& seed, const std::array<uint8_t,32>& nonce,
+    std::array<uint8_t,32>& commitment)
+{
+    cybozu::Sha256 h;
+    h.update(nonce.data(),nonce.size());
+    h.digest(commitment.data(),commitment.size(),seed.data(),seed.size());
+}
@@ -16,6 +16,9 @@
 #include "crypto.hpp"
 #include "protocol.hpp"
 #include "bb.hpp"
+#include "fixedbase.hpp"
+#include "keys.hpp"
+#include "stats.hpp"
 
 // CLS based constants
 #define PROOF_COUNT     (MESSAGE_COUNT + SPECIAL_COUNT + 4)
@@ -33,6 +36,8 @@ using namespace mcl::bn256;
 
 typedef bb::KeyPair<G2,G1> BBKey; 
 
+class VerifyCache;
+
 /*--------------------------------------------------------------------------------------
  * Signature functionality
  *-------------------------------------------------------------------------------------*/
@@ -89,6 +94,8 @@ struct DeidRecord {
     std::array<std::string,MESSAGE_COUNT> record;
     std::array<Fr,MESSAGE_COUNT> hashvalues;
     Signature sig;
+    uint32_t issuer = 0; // the ids in the trust layer of the signing keys
+    uint32_t bbkey = 0;
 
     // simplify initialization
     DeidRecord(const KeyPair &kp, const BBKey& bkp, 
@@ -102,8 +109,22 @@ struct DeidRecord {
     DeidRecord() {}
 };
 
+/**
+ * Verify the CLS signatures & the snip signatures of records from the issuers of the
+ * trust layer in one batch, for records taken in by a prover; every equation is raised
+ * to a random 64 bit weight so a batch of any size costs one miller loop per issuer &
+ * two per snip key plus one, & one final exponentiation, false if any signature in it
+ * is invalid or refers to a key the trust layer does not have
+ * ------------------------------------------
+ */
+bool VerifyRecords(const TrustLayer& trust, const std::shared_ptr<const Protocol>& p,
+    const DeidRecord* records, size_t count);
+
 // The public part of the zero-knowledge proof 
 struct ZkProof { 
+    bool aggregated = false; // one snip proof for all snips, see Prover::aggregate_snips
+    uint32_t issuer = 0;     // key ids in the trust layer, as in the DeidRecord
+    uint32_t bbkey = 0;
     G1 cmtA;
     G1 cmtB;
     G1 cmtPf1;    
@@ -113,7 +134,7 @@ struct ZkProof {
     Fp12 cmtPf3;
     Fp12 cmtPf4;
     std::vector<G1> SiV; // Si^v
-    std::vector<Fp12> cmtSnip; // denoted in math as a..
+    std::vector<Fp12> cmtSnip; // denoted in math as a.., one when aggregated
     Fp12 rowId;  
     G1 cmtU; // u value blinder
     G1 cmtL; // l value blinder
@@ -123,7 +144,31 @@ struct ZkProof {
     std::vector<Fr> snip_response; 
 };
 
+// The proof in challenge form: the schnorr commitments are left out, the verifier 
+// recomputes them from the responses and checks they reproduce the challenges
+struct ZkChallengeProof {
+    bool aggregated = false;
+    uint32_t issuer = 0;
+    uint32_t bbkey = 0;
+    G1 cmtA;
+    G1 cmtB;
+    G1 cmtBc;
+    std::vector<G1> SiV; // Si^v
+    Fp12 rowId;
+    G1 cmtU;
+    G1 cmtL;
+    Fr challenge;      // signature proofs
+    Fr row_challenge;  // uniqueness proof
+    Fr snip_challenge; // snip proofs
+    std::array<Fr,RESPONSE_COUNT> response;
+    std::array<Fr,ROW_RESPONSE_COUNT> row_response; 
+    std::vector<Fr> snip_response; 
+};
+
 struct ZkProofKnowledge : ZkProof {
+    Fr challenge;                   // the fiat-shamir challenges
+    Fr row_challenge;
+    Fr snip_challenge;
     Fr r;                           // secret for A
     Fr open;                        // secret for B
     Fr ublind; 
@@ -133,7 +178,7 @@ struct ZkProofKnowledge : ZkProof {
     Fr pf2a, pf2b, pf2c;            
     std::array<Fr,PROOF_COUNT> pf3; 
     std::array<Fr,ROW_PROOF_COUNT> pf4; 
-    std::vector<Fr> snipblinds;
+    std::vector<Fr> snipblinds;     // one when aggregated
     std::vector<Fr> v;
 };
 
@@ -141,8 +186,14 @@ struct ZkProofKnowledge : ZkProof {
 struct Row {
     std::vector<std::pair<std::string,size_t>> disclosed; 
     std::vector<std::string> snips; 
-    ZkProof proof;
-    Fp12 rowId; 
+    ZkProof proof; // proof.rowId is the row identity
+};
+
+// a row of deid data with a proof in challenge form
+struct CompactRow {
+    std::vector<std::pair<std::string,size_t>> disclosed; 
+    std::vector<std::string> snips; 
+    ZkChallengeProof proof;
 };
 
 // a table of deidentified data
@@ -158,17 +209,38 @@ struct Table {
     Table(){}
 };
 
+// power tables of crv.e & of the precomputed pairings, read only so copies share them
+struct PairingTables {
+    GtFixedBase e;
+    // empty at 0, 1 & PAIRING_COUNT-3, issuer keys table e(iH, pub) in their context
+    std::array<GtFixedBase,PAIRING_COUNT> pairings;
+
+    PairingTables(const Protocol& p, const std::array<Fp12,PAIRING_COUNT>& pairings);
+};
+
 struct Prover {
     std::vector<DeidRecord> drecords;
     std::unique_ptr<Table> table; 
     std::unique_ptr<std::vector<std::pair<size_t,ZkProofKnowledge>>> knowledge;
-    std::array<Fp12,PAIRING_COUNT> pairings; // precomputed pairings
+    // precomputed pairings, 0 & PAIRING_COUNT-3 stay unused: e(A, g2) is per proof &
+    // e(uH, tablekey) lives in the TableContext, 1 is e(iH, pub) of issuer 0 only
+    std::array<Fp12,PAIRING_COUNT> pairings;
     TrustLayer trust;
     std::shared_ptr<const Protocol> protocol;
+    std::shared_ptr<KeyCache> keys; // the issuer & snip keys rows refer to, copies share
+    std::shared_ptr<const PairingTables> tables;
+    // prove all snips of a row with one random linear combination of their BB 
+    // equations, the proof then carries one Gt commitment & three snip responses
+    bool aggregate_snips;
+    // when set NewTable derives the proof randomness of every row from this secret,
+    // the table key & the row request, keeps no knowledge & RowKnowledge rebuilds it
+    std::string nonce_secret;
 
     Prover(const std::vector<DeidRecord>& drec, const TrustLayer& trust, 
-        std::shared_ptr<const Protocol> p) :  drecords(drec), trust(trust), protocol(p) 
+        std::shared_ptr<const Protocol> p) :  drecords(drec), trust(trust), protocol(p),
+        keys(std::make_shared<KeyCache>()), aggregate_snips(false)
     {
+        STAT_COUNT(PAIRING,PROOF_COUNT);
         pairing(pairings[1],protocol->iH,trust.pub); 
         pairing(pairings[2],protocol->iH,protocol->crv.g2);
         for(size_t i = 1; i < GENERATOR_COUNT; i++) {
@@ -179,17 +251,24 @@ struct Prover {
         }
         pairing(pairings[PAIRING_COUNT-2],protocol->uH,protocol->crv.g2);
         pairings[PAIRING_COUNT-1] = pairings[2+GENERATOR_COUNT];
+        keys->Insert(std::make_shared<const IssuerContext>(trust.pub,pairings[1]));
+        tables = std::make_shared<const PairingTables>(*protocol,pairings);
     }
 };
 
 struct Verifier {
-    std::array<Fp12,PAIRING_COUNT> pairings; // precomputed pairings
+    // precomputed pairings, 0 & PAIRING_COUNT-3 stay unused: e(A, g2) is per proof &
+    // e(uH, tablekey) lives in the TableContext, 1 is e(iH, pub) of issuer 0 only
+    std::array<Fp12,PAIRING_COUNT> pairings;
     TrustLayer trust;
     std::shared_ptr<const Protocol> protocol;
+    std::shared_ptr<KeyCache> keys; // the issuer & snip keys rows refer to, copies share
+    std::shared_ptr<const PairingTables> tables;
 
     Verifier(const TrustLayer& trust, std::shared_ptr<const Protocol> p) : 
-        trust(trust), protocol(p)
+        trust(trust), protocol(p), keys(std::make_shared<KeyCache>())
     {
+        STAT_COUNT(PAIRING,PROOF_COUNT);
         pairing(pairings[1],protocol->iH,trust.pub); 
         pairing(pairings[2],protocol->iH,protocol->crv.g2);
         for(size_t i = 1; i < GENERATOR_COUNT; i++) {
@@ -200,29 +279,167 @@ struct Verifier {
         }
         pairing(pairings[PAIRING_COUNT-2],protocol->uH,protocol->crv.g2);
         pairings[PAIRING_COUNT-1] = pairings[2+GENERATOR_COUNT];
+        keys->Insert(std::make_shared<const IssuerContext>(trust.pub,pairings[1]));
+        tables = std::make_shared<const PairingTables>(*protocol,pairings);
+    }
+
+    // from the pairings another Verifier precomputed for the same trust & protocol
+    Verifier(const TrustLayer& trust, std::shared_ptr<const Protocol> p,
+        const std::array<Fp12,PAIRING_COUNT>& precomputed) : pairings(precomputed),
+        trust(trust), protocol(p), keys(std::make_shared<KeyCache>()),
+        tables(std::make_shared<const PairingTables>(*p,precomputed))
+    {
+        keys->Insert(std::make_shared<const IssuerContext>(trust.pub,pairings[1]));
     }
 };
-    
+
+// the tablekey dependent precomputation, read only once built & its keys added so
+// threads can share it
+struct TableContext {
+    G2 tablekey;
+    GtFixedBase rowbase;      // e(uH, tablekey)
+    std::vector<Fp6> lines;   // miller loop lines of tablekey, for the rowIds
+    KeyRing keys;             // the issuer & snip keys of the rows, see AddKeys
+
+    // window 0 keeps no power table of rowbase, see Window
+    TableContext(const Protocol& p, const G2& tablekey, size_t window = GT_WINDOW) :
+        tablekey(tablekey)
+    {
+        STAT_COUNT(PAIRING,1);
+        Fp12 e;
+        pairing(e,p.uH,tablekey);
+        rowbase = GtFixedBase(e,window);
+        precomputeG2(lines,tablekey);
+    }
+
+    // the table of rowbase costs about as much as two plain powers, so a context for
+    // fewer proofs than that goes without
+    static size_t Window(size_t proofs) { return proofs > 2 ? GT_WINDOW : 0; }
+
+    // the keys a row refers to, rows whose keys were not added look them up in the
+    // cache of the prover or verifier instead
+    template<typename Party>
+    void AddKeys(const Party& party, uint32_t issuer, uint32_t bbkey, bool snips) {
+        keys.AddIssuer(*party.protocol,party.trust,*party.keys,issuer);
+        if(snips) keys.AddBBKey(party.trust,*party.keys,bbkey);
+    }
+
+    // every key of the trust layer, for a context used where the cache must not be
+    template<typename Party>
+    void AddTrustKeys(const Party& party) {
+        for(uint32_t id = 0; id <= party.trust.issuers.size(); id++) {
+            keys.AddIssuer(*party.protocol,party.trust,*party.keys,id);
+        }
+        for(uint32_t id = 0; id < party.trust.bbkeys.size(); id++) {
+            keys.AddBBKey(party.trust,*party.keys,id);
+        }
+    }
+};
+
+// why a proof or a table was rejected, the checks run in this order from the cheapest
+enum VerifyStatus {
+    VERIFY_OK = 0,
+    VERIFY_SHAPE,         // snip, commitment or response counts do not match the snips
+    VERIFY_DISCLOSED,     // a disclosed index out of range or repeated
+    VERIFY_KEY,           // an issuer or snip key id the trust layer does not have
+    VERIFY_DUPLICATE_ROW, // a rowId seen before in the table
+    VERIFY_COMMITMENT,    // proofs 1, 2a or 2b on B & B^c
+    VERIFY_SNIP_SECRET,   // the proof of knowledge behind cmtL
+    VERIFY_ROW,           // the uniqueness proof of the rowId
+    VERIFY_SIGNATURE,     // proof 3, the signature on the disclosed values
+    VERIFY_SNIPS,         // a snip proof
+    VERIFY_CHALLENGE,     // challenge form: the recomputed commitments miss a challenge
+    VERIFY_STATUS_COUNT
+};
+
+const char* StatusName(VerifyStatus status);
+
+// where a table check stopped
+struct TableStatus {
+    VerifyStatus status;
+    size_t row; // the rejected row
+
+    TableStatus() : status(VERIFY_OK), row(0) {}
+};
+
 
 /*--------------------------------------------------------------------------------------
  * Proof methods for rows
  *-------------------------------------------------------------------------------------*/
 
 /**
- * Create a New set of proof secrets & commitments
+ * Create a New set of proof secrets & commitments, false when the issuer of the record
+ * or, with snips, its BB key is not in the trust layer of the prover
  * -----------------------------------------------
  */
-void NewZkProof(const std::vector<size_t>& disclose, const std::vector<size_t>& snip,
-    const G2& tablekey, const DeidRecord& drec, ZkProofKnowledge& proof, Prover& p);
+bool NewZkProof(const std::vector<size_t>& disclose, const std::vector<size_t>& snip,
+    const TableContext& table, const DeidRecord& drec, ZkProofKnowledge& proof,
+    const Prover& p);
+
+// as above with a TableContext built for the call
+bool NewZkProof(const std::vector<size_t>& disclose, const std::vector<size_t>& snip,
+    const G2& tablekey, const DeidRecord& drec, ZkProofKnowledge& proof, const Prover& p);
 
 
 /**
- * Verify the response to a challenge 
+ * A read only view of elements the caller owns, the verifier takes the disclosed values
+ * & snips of a row this way & never copies, reorders or allocates them
  * -----------------------------------------------
  */
-bool VerifyProof(const ZkProof& proof, const G2& tablekey,
-    const std::vector<std::string>& snips, 
-    std::vector<std::pair<std::string,size_t>>& disclosed, Verifier& v);
+template <typename T>
+class View {
+public:
+    View() : first(nullptr), count(0) {}
+    View(const T* data, size_t size) : first(data), count(size) {}
+    View(const std::vector<T>& v) : first(v.data()), count(v.size()) {}
+
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+    const T& operator[](size_t i) const { return first[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+private:
+    const T* first;
+    size_t count;
+};
+
+typedef View<std::pair<std::string,size_t>> DisclosedView;
+typedef View<std::string> SnipView;
+
+/**
+ * Verify the response to a challenge, the verifier & the context are only read so one
+ * of each serves any number of threads; shapes are checked first, then the G1 equations
+ * & the pairing work last, status gets the reason of a rejection. The row is only read
+ * & the working buffers are per thread, so a warmed up thread verifies without
+ * allocating
+ * -----------------------------------------------
+ */
+bool VerifyProof(const ZkProof& proof, const TableContext& table, SnipView snips,
+    DisclosedView disclosed, const Verifier& v, VerifyStatus* status = nullptr);
+
+// as above with a TableContext built for the call
+bool VerifyProof(const ZkProof& proof, const G2& tablekey, SnipView snips,
+    DisclosedView disclosed, const Verifier& v);
+
+
+/**
+ * Drop the commitments of a proof, keeping the challenges that bind them
+ * -----------------------------------------------
+ */
+void CompactProof(const ZkProofKnowledge& proof, ZkChallengeProof& compact);
+
+
+/**
+ * Verify a proof in challenge form
+ * -----------------------------------------------
+ */
+bool VerifyChallengeProof(const ZkChallengeProof& proof, const TableContext& table,
+    SnipView snips, DisclosedView disclosed, const Verifier& v,
+    VerifyStatus* status = nullptr);
+
+// as above with a TableContext built for the call
+bool VerifyChallengeProof(const ZkChallengeProof& proof, const G2& tablekey,
+    SnipView snips, DisclosedView disclosed, const Verifier& v);
 
 
 /*--------------------------------------------------------------------------------------
@@ -230,19 +447,91 @@ bool VerifyProof(const ZkProof& proof, const G2& tablekey,
  *-------------------------------------------------------------------------------------*/
 
 /**
- * Create a new table of deidentified data
+ * Create a new table of deidentified data, a table the prover already has is rebuilt in
+ * place so its rows & knowledge keep their capacity; the table is left empty when
+ * AppendRows would refuse the rows
  * -----------------------------------------------
  */
 void NewTable(const std::string& phrase, Prover &p,
     const std::pair<size_t,std::vector<size_t>>* discl, 
     const std::pair<size_t,std::vector<size_t>>* disclsnip, size_t rowcount);
 
+/**
+ * Append rows to the table of the prover under the same tablekey, false without a table,
+ * when a request names a record, message or snip out of range or when a record refers
+ * to a key the prover does not have, nothing is appended then
+ * -----------------------------------------------
+ */
+bool AppendRows(Prover &p, const std::pair<size_t,std::vector<size_t>>* discl, 
+    const std::pair<size_t,std::vector<size_t>>* disclsnip, size_t rowcount);
+
+/**
+ * Rebuild the knowledge of a row of a table made with Prover::nonce_secret, from the
+ * disclosure request NewTable was given for that row, false unless the rebuilt proof is
+ * the emitted one in every public field
+ * -----------------------------------------------
+ */
+bool RowKnowledge(Prover& p, size_t row,
+    const std::pair<size_t,std::vector<size_t>>& discl,
+    const std::pair<size_t,std::vector<size_t>>& disclsnip, ZkProofKnowledge& proof);
+
+
+/**
+ * Check a table of deidentified data, rows found in the cache skip their proof & rows
+ * that verify are added to it; the shapes & rowId uniqueness of every row are checked 
+ * before any proof, status gets the reason & the row of a rejection
+ * -----------------------------------------------
+ */
+bool CheckTable(const Verifier& v,const G2& tablekey,const Row* table, size_t rowcount,
+    VerifyCache* cache = nullptr, TableStatus* status = nullptr);
+
+/**
+ * Check a table of rows in challenge form
+ * -----------------------------------------------
+ */
+bool CheckTable(const Verifier& v,const G2& tablekey,const CompactRow* table,
+    size_t rowcount, TableStatus* status = nullptr);
+
+/**
+ * Check several tables together, tables under the same tablekey share one TableContext
+ * & the rows of all tables are verified by workers threads on the one verifier; status
+ * gets the outcome of every table, a rejection names its lowest bad row; true when every
+ * table passed
+ * -----------------------------------------------
+ */
+bool CheckTables(const Verifier& v, const Table* tables, size_t count, size_t workers,
+    std::vector<TableStatus>& status);
+
+// the outcome of SampleCheckTable
+struct SampleReport {
+    std::array<uint8_t,32> commitment; // CommitSeed of the seed & nonce
+    std::array<uint8_t,32> nonce;      // random, opens the commitment with the seed
+    std::array<uint8_t,32> rows;       // MerkleFrontier root of the RowLeaf of every row
+    size_t sampled;        // rows verified
+    bool unique;           // the rowId pass over all rows
+    bool passed;
+    double bad_fraction;   // as requested
+    double confidence;     // achieved, 1 when every row was verified
+};
+
+/**
+ * Audit a table by verifying a random sample of its rows, sized so that a table with at
+ * least bad_fraction invalid rows fails with probability confidence; the sample is drawn
+ * from the seed & the digest of every encoded row, which the report returns, and the
+ * rowId uniqueness pass still covers every row
+ * -----------------------------------------------
+ */
+bool SampleCheckTable(const Verifier& v, const G2& tablekey, const Row* table,
+    size_t rowcount, const std::string& seed, double confidence, double bad_fraction, 
+    SampleReport& report);
 
 /**
- * Create a new table of deidentified data
+ * The commitment to an audit seed, sha256 of nonce | seed, so a guessable seed stays
+ * hidden until the nonce is opened
  * -----------------------------------------------
  */
-bool CheckTable(Verifier& v,const G2& tablekey,Row* table, size_t rowcount);
+void CommitSeed(const std::string& seed, const std::array<uint8_t,32>& nonce,
+    std::array<uint8_t,32>& commitment);
 
 }
 
@@ -0,0 +1,80 @@
+/**
+ * Fixed base exponentiation in Gt
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "fixedbase.hpp"
+#include "stats.hpp"
+
+#include <cstdint>
+
+using namespace philips;
+
+// the digits of an Fr of w bits each, one more for the carry of the last signed digit
+static size_t Digits(size_t window)
+{
+    return (Fr::getBitSize() + window - 1) / window + 1;
+}
+
+// w bits of a little endian number from bit at on, zero past its end
+static unsigned Bits(const uint8_t* num, size_t n, size_t at, size_t window)
+{
+    unsigned v = 0;
+    for(size_t i = 0; i < window && (at + i) / 8 < n; i++) {
+        v |= ((num[(at + i) / 8] >> ((at + i) % 8)) & 1u) << i;
+    }
+    return v;
+}
+
+GtFixedBase::GtFixedBase(const Fp12& base, size_t window) : base(base), window(window)
+{
+    if(window == 0) return;
+    STAT_COUNT(GT_TABLE,1);
+    const size_t half = (size_t) 1 << (window - 1);
+    const size_t digits = Digits(window);
+    std::shared_ptr<std::vector<Fp12>> powers =
+        std::make_shared<std::vector<Fp12>>(digits * half);
+    Fp12 b = base;
+    for(size_t j = 0; j < digits; j++) {
+        Fp12* row = &(*powers)[j * half];
+        row[0] = b;
+        for(size_t k = 1; k < half; k++) Fp12::mul(row[k],row[k-1],b);
+        Fp12::sqr(b,row[half-1]); // base^(2^(window (j+1)))
+    }
+    table = powers;
+}
+
+void GtFixedBase::Pow(Fp12& out, const Fr& x) const
+{
+    if(!table) {
+        STAT_COUNT(GT_POW,1);
+        Fp12::pow(out,base,x);
+        return;
+    }
+    STAT_COUNT(GT_FIXED_POW,1);
+    // mcl serializes Fr as little endian bytes
+    uint8_t num[64];
+    const size_t n = x.serialize(num,sizeof(num));
+    const size_t half = (size_t) 1 << (window - 1);
+    const size_t digits = Digits(window);
+    Fp12 acc = 1;
+    unsigned carry = 0;
+    for(size_t j = 0; j < digits; j++) {
+        unsigned d = Bits(num,n,j * window,window) + carry;
+        carry = d > half ? 1 : 0;
+        if(carry) d = (1u << window) - d;
+        if(d == 0) continue;
+        const Fp12& power = (*table)[j * half + d - 1];
+        if(carry) {
+            Fp12 inv = power;
+            Fp6::neg(inv.b,inv.b);
+            Fp12::mul(acc,acc,inv);
+        } else {
+            Fp12::mul(acc,acc,power);
+        }
+    }
+    out = acc;
+}
@@ -0,0 +1,48 @@
+#pragma once
+/**
+ * Fixed base exponentiation in Gt
+ * the powers base^(k 2^(w j)) are tabled once, a power is then one multiplication per
+ * signed w bit digit of the exponent & no squarings
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <memory>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+using namespace mcl::bn256;
+
+// bits per digit, a table holds (bits / GT_WINDOW + 2) 2^(GT_WINDOW-1) elements
+#ifndef GT_WINDOW
+#define GT_WINDOW 4
+#endif
+
+namespace philips {
+
+/*--------------------------------------------------------------------------------------
+ * Fixed base
+ * the base has to be in Gt, digits are signed & a negative digit takes the inverse,
+ * which is the conjugate in the cyclotomic subgroup; the table is read only, so copies
+ * share it
+ *-------------------------------------------------------------------------------------*/
+
+class GtFixedBase {
+public:
+    GtFixedBase() : window(0) { base = 1; }
+
+    // window 0 keeps no table & Pow is Fp12::pow, for bases used once
+    explicit GtFixedBase(const Fp12& base, size_t window = GT_WINDOW);
+
+    void Pow(Fp12& out, const Fr& x) const;
+    const Fp12& Base() const { return base; }
+private:
+    Fp12 base;
+    size_t window;
+    // per digit j base^(k 2^(window j)) for k = 1..2^(window-1), null for window 0
+    std::shared_ptr<const std::vector<Fp12>> table;
+};
+
+}
@@ -0,0 +1,669 @@
+/**
+ * Streaming JSON export & import of tables for the web front-end
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "json.hpp"
+#include "base.hpp"
+
+#include <cstring>
+#include <limits>
+
+using namespace philips;
+
+#define MAX_DEPTH 64 // nesting the reader skips through in unknown values
+
+// the members of a proof in the order they are written
+static const char* proof_fields[] = {
+    "aggregated", "issuer", "bbkey", "cmtA", "cmtB", "cmtPf1", "cmtBc", "cmtPf2",
+    "cmtPf2b", "cmtPf3", "cmtPf4", "SiV", "cmtSnip", "rowId", "cmtU", "cmtL", "cmtY",
+    "response", "row_response", "snip_response"
+};
+static const size_t proof_field_count = sizeof(proof_fields) / sizeof(proof_fields[0]);
+
+/*--------------------------------------------------------------------------------------
+ * Writer
+ *-------------------------------------------------------------------------------------*/
+
+void JsonTableWriter::Flush()
+{
+    if(used == 0) return;
+    if(stream) stream->write(buf,used);
+    else buffer->append(buf,used);
+    used = 0;
+}
+
+void JsonTableWriter::Put(char c)
+{
+    if(used == sizeof(buf)) Flush();
+    buf[used++] = c;
+}
+
+void JsonTableWriter::Put(const char* s, size_t n)
+{
+    if(used + n > sizeof(buf)) Flush();
+    if(n > sizeof(buf)) {
+        if(stream) stream->write(s,n);
+        else buffer->append(s,n);
+        return;
+    }
+    memcpy(buf + used,s,n);
+    used += n;
+}
+
+void JsonTableWriter::Key(const char* key)
+{
+    Put('"');
+    Put(key,strlen(key));
+    Put("\":",2);
+}
+
+void JsonTableWriter::Number(uint64_t v)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char) ('0' + v % 10);
+        v /= 10;
+    } while(v > 0);
+    Put(digits + sizeof(digits) - n,n);
+}
+
+void JsonTableWriter::String(const std::string& s)
+{
+    static const char hex[] = "0123456789abcdef";
+    Put('"');
+    for(char c : s) {
+        const unsigned char u = (unsigned char) c;
+        if(c == '"' || c == '\\') {
+            Put('\\');
+            Put(c);
+        } else if(u < 0x20) {
+            const char esc[6] = { '\\', 'u', '0', '0', hex[u >> 4], hex[u & 0xf] };
+            Put(esc,sizeof(esc));
+        } else {
+            Put(c);
+        }
+    }
+    Put('"');
+}
+
+// encoded in place, an element is at most a few hundred characters
+void JsonTableWriter::Base64(const char* raw, size_t n)
+{
+    const size_t m = base64_encoded_size(n);
+    if(used + m + 2 > sizeof(buf)) Flush();
+    buf[used++] = '"';
+    base64_encode(buf + used,reinterpret_cast<const uint8_t*>(raw),n);
+    used += m;
+    buf[used++] = '"';
+}
+
+template<typename T>
+void JsonTableWriter::El(const T& el)
+{
+    char raw[Fp12_size];
+    const size_t n = el.serialize(raw,BytesSize(el));
+    Base64(raw,n);
+}
+
+void JsonTableWriter::El(const Fp12& el)
+{
+    char raw[Gt_compressed_size];
+    CompressGt(el,raw);
+    Base64(raw,sizeof(raw));
+}
+
+template<typename I>
+void JsonTableWriter::Els(I begin, I end)
+{
+    Put('[');
+    for(I it = begin; it != end; ++it) {
+        if(it != begin) Put(',');
+        El(*it);
+    }
+    Put(']');
+}
+
+void JsonTableWriter::Proof(const ZkProof& proof)
+{
+    const char** f = proof_fields;
+    Put('{');
+    Key(*f++);
+    if(proof.aggregated) Put("true",4);
+    else Put("false",5);
+    Put(','); Key(*f++); Number(proof.issuer);
+    Put(','); Key(*f++); Number(proof.bbkey);
+    Put(','); Key(*f++); El(proof.cmtA);
+    Put(','); Key(*f++); El(proof.cmtB);
+    Put(','); Key(*f++); El(proof.cmtPf1);
+    Put(','); Key(*f++); El(proof.cmtBc);
+    Put(','); Key(*f++); El(proof.cmtPf2);
+    Put(','); Key(*f++); El(proof.cmtPf2b);
+    Put(','); Key(*f++); El(proof.cmtPf3);
+    Put(','); Key(*f++); El(proof.cmtPf4);
+    Put(','); Key(*f++); Els(proof.SiV.begin(),proof.SiV.end());
+    Put(','); Key(*f++); Els(proof.cmtSnip.begin(),proof.cmtSnip.end());
+    Put(','); Key(*f++); El(proof.rowId);
+    Put(','); Key(*f++); El(proof.cmtU);
+    Put(','); Key(*f++); El(proof.cmtL);
+    Put(','); Key(*f++); El(proof.cmtY);
+    Put(','); Key(*f++); Els(proof.response.begin(),proof.response.end());
+    Put(','); Key(*f++); Els(proof.row_response.begin(),proof.row_response.end());
+    Put(','); Key(*f++); Els(proof.snip_response.begin(),proof.snip_response.end());
+    Put('}');
+}
+
+void JsonTableWriter::Begin(const G2& tablekey)
+{
+    rows = 0;
+    Put('{');
+    Key("tablekey");
+    El(tablekey);
+    Put(',');
+    Key("rows");
+    Put('[');
+}
+
+void JsonTableWriter::Add(const Row& row)
+{
+    if(rows++ > 0) Put(',');
+    Put("\n{",2);
+    Key("disclosed");
+    Put('[');
+    for(size_t i = 0; i < row.disclosed.size(); i++) {
+        if(i > 0) Put(',');
+        Put('[');
+        String(row.disclosed[i].first);
+        Put(',');
+        Number(row.disclosed[i].second);
+        Put(']');
+    }
+    Put("],",2);
+    Key("snips");
+    Put('[');
+    for(size_t i = 0; i < row.snips.size(); i++) {
+        if(i > 0) Put(',');
+        String(row.snips[i]);
+    }
+    Put("],",2);
+    Key("proof");
+    Proof(row.proof);
+    Put('}');
+}
+
+void JsonTableWriter::End()
+{
+    Put("\n]}\n",4);
+    Flush();
+}
+
+/**
+ * Write a whole table
+ * ------------------------------------------
+ */
+void philips::WriteTableJson(std::ostream& out, const G2& tablekey, const Row* rows,
+    size_t rowcount)
+{
+    JsonTableWriter w(out);
+    w.Begin(tablekey);
+    for(size_t i = 0; i < rowcount; i++) w.Add(rows[i]);
+    w.End();
+}
+
+void philips::WriteTableJson(std::string& out, const G2& tablekey, const Row* rows,
+    size_t rowcount)
+{
+    JsonTableWriter w(out);
+    w.Begin(tablekey);
+    for(size_t i = 0; i < rowcount; i++) w.Add(rows[i]);
+    w.End();
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Reader
+ *-------------------------------------------------------------------------------------*/
+
+bool JsonTableReader::Fail()
+{
+    failed = true;
+    inrows = false;
+    return false;
+}
+
+// the next character after white space, eof as -1
+int JsonTableReader::Peek()
+{
+    for(;;) {
+        const int c = src->sgetc();
+        if(c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return c == std::char_traits<char>::eof() ? -1 : c;
+        }
+        src->sbumpc();
+    }
+}
+
+bool JsonTableReader::Expect(char c)
+{
+    if(Peek() != c) return Fail();
+    src->sbumpc();
+    return true;
+}
+
+bool JsonTableReader::Literal(const char* word)
+{
+    Peek();
+    for(const char* w = word; *w; w++) {
+        if(src->sbumpc() != *w) return Fail();
+    }
+    return true;
+}
+
+bool JsonTableReader::Hex4(unsigned& v)
+{
+    v = 0;
+    for(size_t i = 0; i < 4; i++) {
+        const int c = src->sbumpc();
+        v <<= 4;
+        if(c >= '0' && c <= '9') v |= c - '0';
+        else if(c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return Fail();
+    }
+    return true;
+}
+
+// a \u escape as utf-8, surrogates have to come in pairs
+bool JsonTableReader::Unicode(std::string* s)
+{
+    unsigned u;
+    if(!Hex4(u)) return false;
+    if(u >= 0xdc00 && u < 0xe000) return Fail();
+    if(u >= 0xd800 && u < 0xdc00) {
+        unsigned low;
+        if(src->sbumpc() != '\\' || src->sbumpc() != 'u' || !Hex4(low)) return Fail();
+        if(low < 0xdc00 || low >= 0xe000) return Fail();
+        u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+    }
+    if(!s) return true;
+    if(u < 0x80) {
+        s->push_back((char) u);
+    } else if(u < 0x800) {
+        s->push_back((char) (0xc0 | (u >> 6)));
+        s->push_back((char) (0x80 | (u & 0x3f)));
+    } else if(u < 0x10000) {
+        s->push_back((char) (0xe0 | (u >> 12)));
+        s->push_back((char) (0x80 | ((u >> 6) & 0x3f)));
+        s->push_back((char) (0x80 | (u & 0x3f)));
+    } else {
+        s->push_back((char) (0xf0 | (u >> 18)));
+        s->push_back((char) (0x80 | ((u >> 12) & 0x3f)));
+        s->push_back((char) (0x80 | ((u >> 6) & 0x3f)));
+        s->push_back((char) (0x80 | (u & 0x3f)));
+    }
+    return true;
+}
+
+// a string into s, reusing its capacity, or skipped when s is null
+bool JsonTableReader::String(std::string* s)
+{
+    if(!Expect('"')) return false;
+    if(s) s->clear();
+    for(;;) {
+        const int c = src->sbumpc();
+        if(c == '"') return true;
+        if(c == std::char_traits<char>::eof() || (c >= 0 && c < 0x20)) return Fail();
+        if(c != '\\') {
+            if(s) s->push_back((char) c);
+            continue;
+        }
+        char esc;
+        switch(src->sbumpc()) {
+        case '"': esc = '"'; break;
+        case '\\': esc = '\\'; break;
+        case '/': esc = '/'; break;
+        case 'b': esc = '\b'; break;
+        case 'f': esc = '\f'; break;
+        case 'n': esc = '\n'; break;
+        case 'r': esc = '\r'; break;
+        case 't': esc = '\t'; break;
+        case 'u':
+            if(!Unicode(s)) return false;
+            continue;
+        default: return Fail();
+        }
+        if(s) s->push_back(esc);
+    }
+}
+
+// an object key & its colon, keys that do not fit come back empty so they are skipped
+bool JsonTableReader::Key(char* key, size_t cap)
+{
+    if(!Expect('"')) return false;
+    size_t n = 0;
+    bool fits = true;
+    for(;;) {
+        const int c = src->sbumpc();
+        if(c == '"') break;
+        if(c == std::char_traits<char>::eof() || (c >= 0 && c < 0x20)) return Fail();
+        if(c == '\\') {
+            fits = false;
+            if(src->sbumpc() == std::char_traits<char>::eof()) return Fail();
+            continue;
+        }
+        if(n + 1 < cap) key[n++] = (char) c;
+        else fits = false;
+    }
+    key[fits ? n : 0] = 0;
+    return Expect(':');
+}
+
+bool JsonTableReader::Number(uint64_t& v, uint64_t max)
+{
+    int c = Peek();
+    if(c < '0' || c > '9') return Fail();
+    v = 0;
+    const bool zero = c == '0';
+    while(c >= '0' && c <= '9') {
+        const uint64_t d = c - '0';
+        if(v > (max - d) / 10) return Fail();
+        v = 10 * v + d;
+        src->sbumpc();
+        c = src->sgetc();
+        if(zero && c >= '0' && c <= '9') return Fail(); // no leading zeros
+    }
+    if(c == '.' || c == 'e' || c == 'E') return Fail();
+    return true;
+}
+
+bool JsonTableReader::Bool(bool& v)
+{
+    v = Peek() == 't';
+    return Literal(v ? "true" : "false");
+}
+
+// a base64 string of exactly n bytes, decoded without allocating
+bool JsonTableReader::Base64(char* raw, size_t n)
+{
+    char text[base64_encoded_size(Fp12_size) + 1];
+    const size_t m = base64_encoded_size(n);
+    if(!Expect('"')) return false;
+    size_t len = 0;
+    for(;;) {
+        const int c = src->sbumpc();
+        if(c == '"') break;
+        if(c == std::char_traits<char>::eof() || len == m) return Fail();
+        text[len++] = (char) c;
+    }
+    if(len != m || base64_decoded_size(text,len) != n) return Fail();
+    return base64_decode(reinterpret_cast<uint8_t*>(raw),text,len) || Fail();
+}
+
+template<typename T>
+bool JsonTableReader::El(T& el)
+{
+    char raw[Fp12_size];
+    const size_t n = BytesSize(el);
+    if(!Base64(raw,n)) return false;
+    return el.deserialize(raw,n) == n || Fail();
+}
+
+bool JsonTableReader::El(Fp12& el)
+{
+    char raw[Gt_compressed_size];
+    if(!Base64(raw,sizeof(raw))) return false;
+    return DecompressGt(el,raw) || Fail();
+}
+
+template<typename F>
+bool JsonTableReader::Array(F item)
+{
+    if(!Expect('[')) return false;
+    if(Peek() == ']') {
+        src->sbumpc();
+        return true;
+    }
+    for(;;) {
+        if(!item()) return Fail();
+        const int c = Peek();
+        src->sbumpc();
+        if(c == ']') return true;
+        if(c != ',') return Fail();
+    }
+}
+
+// members in any order, field gets each key & reads its value
+template<typename F>
+bool JsonTableReader::Object(F field)
+{
+    if(!Expect('{')) return false;
+    if(Peek() == '}') {
+        src->sbumpc();
+        return true;
+    }
+    for(;;) {
+        char key[32];
+        if(!Key(key,sizeof(key)) || !field(key)) return Fail();
+        const int c = Peek();
+        src->sbumpc();
+        if(c == '}') return true;
+        if(c != ',') return Fail();
+    }
+}
+
+template<typename T>
+bool JsonTableReader::Els(std::vector<T>& v)
+{
+    size_t k = 0;
+    if(!Array([&]{
+        if(k == v.size()) v.emplace_back();
+        return El(v[k++]); })) {
+        return false;
+    }
+    v.resize(k);
+    return true;
+}
+
+template<typename T, size_t N>
+bool JsonTableReader::Els(std::array<T,N>& v)
+{
+    size_t k = 0;
+    if(!Array([&]{ return k < N && El(v[k++]); })) return false;
+    return k == N || Fail();
+}
+
+// any value, discarded
+bool JsonTableReader::Skip(size_t depth)
+{
+    if(depth > MAX_DEPTH) return Fail();
+    const int c = Peek();
+    if(c == '"') return String(nullptr);
+    if(c == '{') return Object([&](const char*){ return Skip(depth + 1); });
+    if(c == '[') return Array([&]{ return Skip(depth + 1); });
+    if(c == 't') return Literal("true");
+    if(c == 'f') return Literal("false");
+    if(c == 'n') return Literal("null");
+    if(c != '-' && (c < '0' || c > '9')) return Fail();
+    int n = c;
+    do {
+        src->sbumpc();
+        n = src->sgetc();
+    } while((n >= '0' && n <= '9') || n == '-' || n == '+' || n == '.' || n == 'e' ||
+        n == 'E');
+    return true;
+}
+
+bool JsonTableReader::Disclosed(std::vector<std::pair<std::string,size_t>>& disclosed)
+{
+    size_t k = 0;
+    if(!Array([&]{
+        if(k == disclosed.size()) disclosed.emplace_back();
+        std::pair<std::string,size_t>& d = disclosed[k++];
+        uint64_t index;
+        if(!Expect('[') || !String(&d.first) || !Expect(',') ||
+            !Number(index,std::numeric_limits<size_t>::max()) || !Expect(']')) {
+            return false;
+        }
+        d.second = (size_t) index;
+        return true; })) {
+        return false;
+    }
+    disclosed.resize(k);
+    return true;
+}
+
+bool JsonTableReader::Snips(std::vector<std::string>& snips)
+{
+    size_t k = 0;
+    if(!Array([&]{
+        if(k == snips.size()) snips.emplace_back();
+        return String(&snips[k++]); })) {
+        return false;
+    }
+    snips.resize(k);
+    return true;
+}
+
+bool JsonTableReader::Proof(ZkProof& proof)
+{
+    uint32_t seen = 0;
+    if(!Object([&](const char* key) {
+        size_t f = 0;
+        while(f < proof_field_count && strcmp(key,proof_fields[f]) != 0) f++;
+        if(f == proof_field_count) return Skip();
+        if(seen & (1u << f)) return false;
+        seen |= 1u << f;
+        uint64_t id;
+        switch(f) {
+        case 0: return Bool(proof.aggregated);
+        case 1:
+            if(!Number(id,std::numeric_limits<uint32_t>::max())) return false;
+            proof.issuer = (uint32_t) id;
+            return true;
+        case 2:
+            if(!Number(id,std::numeric_limits<uint32_t>::max())) return false;
+            proof.bbkey = (uint32_t) id;
+            return true;
+        case 3: return El(proof.cmtA);
+        case 4: return El(proof.cmtB);
+        case 5: return El(proof.cmtPf1);
+        case 6: return El(proof.cmtBc);
+        case 7: return El(proof.cmtPf2);
+        case 8: return El(proof.cmtPf2b);
+        case 9: return El(proof.cmtPf3);
+        case 10: return El(proof.cmtPf4);
+        case 11: return Els(proof.SiV);
+        case 12: return Els(proof.cmtSnip);
+        case 13: return El(proof.rowId);
+        case 14: return El(proof.cmtU);
+        case 15: return El(proof.cmtL);
+        case 16: return El(proof.cmtY);
+        case 17: return Els(proof.response);
+        case 18: return Els(proof.row_response);
+        default: return Els(proof.snip_response);
+        } })) {
+        return false;
+    }
+    return seen == (1u << proof_field_count) - 1 || Fail();
+}
+
+/**
+ * Read up to the rows, the tablekey has to come first
+ * ------------------------------------------
+ */
+bool JsonTableReader::Begin(G2& tablekey)
+{
+    bool key = false;
+    if(!Expect('{')) return false;
+    for(bool more = Peek() != '}'; more; ) {
+        char name[32];
+        if(!Key(name,sizeof(name))) return false;
+        if(strcmp(name,"rows") == 0) {
+            if(!key || !Expect('[')) return Fail();
+            inrows = true;
+            first = true;
+            return true;
+        }
+        if(strcmp(name,"tablekey") == 0) {
+            if(key || !El(tablekey)) return Fail();
+            key = true;
+        } else if(!Skip()) {
+            return false;
+        }
+        more = Peek() == ',';
+        if(more) src->sbumpc();
+    }
+    return Fail(); // no rows
+}
+
+/**
+ * The next row, the end of the rows finishes the document
+ * ------------------------------------------
+ */
+bool JsonTableReader::Next(Row& row)
+{
+    if(!inrows) return false;
+    if(Peek() == ']') {
+        src->sbumpc();
+        inrows = false;
+        for(;;) {
+            const int c = Peek();
+            src->sbumpc();
+            if(c == '}') break;
+            char name[32];
+            if(c != ',' || !Key(name,sizeof(name)) || !Skip()) return Fail();
+        }
+        done = true;
+        return false;
+    }
+    if(!first && !Expect(',')) return false;
+    first = false;
+    uint32_t seen = 0;
+    return Object([&](const char* key) {
+        if(strcmp(key,"disclosed") == 0) {
+            seen |= 1;
+            return Disclosed(row.disclosed);
+        }
+        if(strcmp(key,"snips") == 0) {
+            seen |= 2;
+            return Snips(row.snips);
+        }
+        if(strcmp(key,"proof") == 0) {
+            seen |= 4;
+            return Proof(row.proof);
+        }
+        return Skip(); }) && (seen == 7 || Fail());
+}
+
+/**
+ * Read a whole table, false on malformed input
+ * ------------------------------------------
+ */
+static bool ReadAll(JsonTableReader& r, G2& tablekey, std::vector<Row>& rows)
+{
+    rows.clear();
+    if(!r.Begin(tablekey)) return false;
+    for(;;) {
+        rows.emplace_back();
+        if(!r.Next(rows.back())) break;
+    }
+    rows.pop_back();
+    return r.Done();
+}
+
+bool philips::ReadTableJson(std::istream& in, G2& tablekey, std::vector<Row>& rows)
+{
+    JsonTableReader r(in);
+    return ReadAll(r,tablekey,rows);
+}
+
+bool philips::ReadTableJson(const char* data, size_t n, G2& tablekey,
+    std::vector<Row>& rows)
+{
+    JsonTableReader r(data,n);
+    return ReadAll(r,tablekey,rows);
+}
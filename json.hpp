@@ -0,0 +1,153 @@
+#pragma once
+/**
+ * Streaming JSON export & import of tables for the web front-end
+ * {"tablekey":"..","rows":[{"disclosed":[["value",index],..],"snips":["..",..],
+ * "proof":{"aggregated":false,"issuer":0,"bbkey":0,"cmtA":"..",..}},..]}
+ * group elements are base64 strings of their codec encoding, Gt torus compressed
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+//philips
+#include "crypto.hpp"
+#include "deid.hpp"
+#include "torus.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * Writer
+ * elements are encoded straight into a fixed buffer that is flushed to the stream or
+ * appended to the string when full, nothing is allocated per element
+ *-------------------------------------------------------------------------------------*/
+
+class JsonTableWriter {
+public:
+    explicit JsonTableWriter(std::ostream& out) : stream(&out), buffer(nullptr), used(0),
+        rows(0) {}
+    explicit JsonTableWriter(std::string& out) : stream(nullptr), buffer(&out), used(0),
+        rows(0) {}
+    ~JsonTableWriter() { Flush(); }
+    JsonTableWriter(const JsonTableWriter&) = delete;
+    JsonTableWriter& operator=(const JsonTableWriter&) = delete;
+
+    // the table key, then any number of rows & the end, in that order
+    void Begin(const G2& tablekey);
+    void Add(const Row& row);
+    void End();
+
+    void Flush();
+private:
+    void Put(char c);
+    void Put(const char* s, size_t n);
+    void Key(const char* key);
+    void Number(uint64_t v);
+    void String(const std::string& s);
+    void Base64(const char* raw, size_t n);
+    template<typename T> void El(const T& el);
+    void El(const Fp12& el);
+    template<typename I> void Els(I begin, I end);
+    void Proof(const ZkProof& proof);
+
+    std::ostream* stream;
+    std::string* buffer;
+    char buf[4096];
+    size_t used;
+    size_t rows;
+};
+
+/**
+ * Write a whole table
+ * ------------------------------------------
+ */
+void WriteTableJson(std::ostream& out, const G2& tablekey, const Row* rows,
+    size_t rowcount);
+void WriteTableJson(std::string& out, const G2& tablekey, const Row* rows,
+    size_t rowcount);
+
+
+/*--------------------------------------------------------------------------------------
+ * Reader
+ * a pull parser over a stream or a buffer, rows are parsed one at a time as they are
+ * read & a reused Row keeps the capacity of its vectors & strings; the tablekey has to
+ * come before the rows, unknown keys are skipped
+ *-------------------------------------------------------------------------------------*/
+
+class JsonTableReader {
+public:
+    explicit JsonTableReader(std::istream& in) : src(in.rdbuf()), failed(false),
+        inrows(false), first(true), done(false) {}
+    JsonTableReader(const char* data, size_t n) : mem(data,n), src(&mem), failed(false),
+        inrows(false), first(true), done(false) {}
+    JsonTableReader(const JsonTableReader&) = delete;
+    JsonTableReader& operator=(const JsonTableReader&) = delete;
+
+    // read up to the rows, false on malformed input
+    bool Begin(G2& tablekey);
+
+    // the next row, false after the last one or on malformed input
+    bool Next(Row& row);
+
+    bool Failed() const { return failed; }
+    bool Done() const { return done; } // the whole document was read
+private:
+    // a streambuf over caller memory
+    struct MemBuf : public std::streambuf {
+        MemBuf() {}
+        MemBuf(const char* data, size_t n) {
+            char* p = const_cast<char*>(data);
+            setg(p,p,p + n);
+        }
+    };
+
+    bool Fail();
+    int Peek();
+    bool Expect(char c);
+    bool Literal(const char* rest);
+    bool Key(char* key, size_t cap);
+    bool String(std::string* s);
+    bool Unicode(std::string* s);
+    bool Hex4(unsigned& v);
+    bool Number(uint64_t& v, uint64_t max);
+    bool Bool(bool& v);
+    bool Base64(char* raw, size_t n);
+    template<typename T> bool El(T& el);
+    bool El(Fp12& el);
+    template<typename T> bool Els(std::vector<T>& v);
+    template<typename T, size_t N> bool Els(std::array<T,N>& v);
+    template<typename F> bool Array(F item);
+    template<typename F> bool Object(F field);
+    bool Skip(size_t depth = 0);
+    bool Disclosed(std::vector<std::pair<std::string,size_t>>& disclosed);
+    bool Snips(std::vector<std::string>& snips);
+    bool Proof(ZkProof& proof);
+
+    MemBuf mem;
+    std::streambuf* src;
+    bool failed;
+    bool inrows;
+    bool first;
+    bool done;
+};
+
+/**
+ * Read a whole table, false on malformed input
+ * ------------------------------------------
+ */
+bool ReadTableJson(std::istream& in, G2& tablekey, std::vector<Row>& rows);
+bool ReadTableJson(const char* data, size_t n, G2& tablekey, std::vector<Row>& rows);
+
+}
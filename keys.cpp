@@ -0,0 +1,136 @@
+/**
+ * Per key precomputation for issuers & BB snip keys
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "keys.hpp"
+#include "stats.hpp"
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Key contexts
+ *-------------------------------------------------------------------------------------*/
+
+IssuerContext::IssuerContext(const Protocol& p, const G2& pub) : pub(pub)
+{
+    STAT_COUNT(PAIRING,1);
+    Fp12 e;
+    pairing(e,p.iH,pub);
+    ipub = GtFixedBase(e);
+    precomputeG2(lines,pub);
+}
+
+IssuerContext::IssuerContext(const G2& pub, const Fp12& ipub) : pub(pub), ipub(ipub)
+{
+    precomputeG2(lines,pub);
+}
+
+BBKeyContext::BBKeyContext(const G2& pub) : pub(pub)
+{
+    precomputeG2(lines,pub);
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Cache
+ *-------------------------------------------------------------------------------------*/
+
+// the kind of key & its serialization
+static std::string Key(char kind, const G2& pub)
+{
+    char buf[256];
+    const size_t n = pub.serialize(buf,sizeof(buf));
+    return std::string(1,kind) + std::string(buf,n);
+}
+
+bool KeyCache::Find(const std::string& key, Entry& found)
+{
+    std::lock_guard<std::mutex> lk(m);
+    auto it = index.find(key);
+    if(it == index.end()) return false;
+    order.splice(order.end(),order,it->second);
+    found = *it->second;
+    return true;
+}
+
+void KeyCache::Touch(const Entry& entry)
+{
+    std::lock_guard<std::mutex> lk(m);
+    auto it = index.find(entry.key);
+    if(it != index.end()) {
+        order.splice(order.end(),order,it->second);
+        return;
+    }
+    if(capacity == 0) return;
+    if(index.size() == capacity) {
+        index.erase(order.front().key);
+        order.pop_front();
+    }
+    order.push_back(entry);
+    index[entry.key] = std::prev(order.end());
+}
+
+// contexts are built outside the lock, two threads missing at once both build one
+std::shared_ptr<const IssuerContext> KeyCache::Issuer(const Protocol& p, const G2& pub)
+{
+    Entry e;
+    e.key = Key('i',pub);
+    if(Find(e.key,e)) return e.issuer;
+    e.issuer = std::make_shared<const IssuerContext>(p,pub);
+    Touch(e);
+    return e.issuer;
+}
+
+std::shared_ptr<const BBKeyContext> KeyCache::BBKey(const G2& pub)
+{
+    Entry e;
+    e.key = Key('b',pub);
+    if(Find(e.key,e)) return e.bbkey;
+    e.bbkey = std::make_shared<const BBKeyContext>(pub);
+    Touch(e);
+    return e.bbkey;
+}
+
+void KeyCache::Insert(const std::shared_ptr<const IssuerContext>& issuer)
+{
+    Entry e;
+    e.key = Key('i',issuer->pub);
+    e.issuer = issuer;
+    Touch(e);
+}
+
+size_t KeyCache::Size() const
+{
+    std::lock_guard<std::mutex> lk(m);
+    return index.size();
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * KeyRing
+ *-------------------------------------------------------------------------------------*/
+
+bool KeyRing::AddIssuer(const Protocol& p, const TrustLayer& trust, KeyCache& cache,
+    uint32_t id)
+{
+    if(Issuer(id)) return true;
+    const G2* pub = trust.Issuer(id);
+    if(!pub) return false;
+    if(issuers.size() <= trust.issuers.size()) issuers.resize(trust.issuers.size() + 1);
+    issuers[id] = cache.Issuer(p,*pub);
+    return true;
+}
+
+bool KeyRing::AddBBKey(const TrustLayer& trust, KeyCache& cache, uint32_t id)
+{
+    if(BBKey(id)) return true;
+    const G2* pub = trust.BBKey(id);
+    if(!pub) return false;
+    if(bbkeys.size() < trust.bbkeys.size()) bbkeys.resize(trust.bbkeys.size());
+    bbkeys[id] = cache.BBKey(*pub);
+    return true;
+}
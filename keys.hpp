@@ -0,0 +1,110 @@
+#pragma once
+/**
+ * Per key precomputation for issuers & BB snip keys
+ * a trust layer can hold several issuers & rotating snip keys, the pairings & G2 line
+ * tables of each key are built on first use & kept in a least recently used cache
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+//philips
+#include "fixedbase.hpp"
+#include "protocol.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * Key contexts
+ *-------------------------------------------------------------------------------------*/
+
+// the precomputation for an issuer key
+struct IssuerContext {
+    G2 pub;
+    GtFixedBase ipub;          // e(iH, pub), a base of the signature proof
+    std::vector<Fp6> lines;    // miller loop lines of pub
+
+    IssuerContext(const Protocol& p, const G2& pub);
+    IssuerContext(const G2& pub, const Fp12& ipub); // with e(iH, pub) known
+};
+
+// the precomputation for a BB snip key
+struct BBKeyContext {
+    G2 pub;
+    std::vector<Fp6> lines;    // miller loop lines of pub
+
+    explicit BBKeyContext(const G2& pub);
+};
+
+
+/*--------------------------------------------------------------------------------------
+ * Cache
+ * least recently used eviction at a fixed capacity, safe to share between threads, 
+ * entries stay valid for whoever holds them after they are evicted
+ *-------------------------------------------------------------------------------------*/
+
+class KeyCache {
+public:
+    explicit KeyCache(size_t capacity = 16) : capacity(capacity) {}
+
+    std::shared_ptr<const IssuerContext> Issuer(const Protocol& p, const G2& pub);
+    std::shared_ptr<const BBKeyContext> BBKey(const G2& pub);
+
+    // add a context built elsewhere
+    void Insert(const std::shared_ptr<const IssuerContext>& issuer);
+    size_t Size() const;
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const IssuerContext> issuer;
+        std::shared_ptr<const BBKeyContext> bbkey;
+    };
+    bool Find(const std::string& key, Entry& found);
+    void Touch(const Entry& entry);
+
+    size_t capacity;
+    mutable std::mutex m;
+    std::list<Entry> order;    // least recently used first
+    std::unordered_map<std::string,std::list<Entry>::iterator> index;
+};
+
+
+/*--------------------------------------------------------------------------------------
+ * KeyRing
+ * the contexts of the keys one table refers to, indexed by their id in the trust layer:
+ * each id goes through the KeyCache once, after that a row finds its keys without
+ * serializing them or taking the cache lock. Keys are added before the ring is shared,
+ * reading it is then safe from any thread
+ *-------------------------------------------------------------------------------------*/
+
+class KeyRing {
+public:
+    // false for an id the trust layer does not have, an id already added costs nothing
+    bool AddIssuer(const Protocol& p, const TrustLayer& trust, KeyCache& cache,
+        uint32_t id);
+    bool AddBBKey(const TrustLayer& trust, KeyCache& cache, uint32_t id);
+
+    // null for an id not added
+    const IssuerContext* Issuer(uint32_t id) const {
+        return id < issuers.size() ? issuers[id].get() : nullptr;
+    }
+    const BBKeyContext* BBKey(uint32_t id) const {
+        return id < bbkeys.size() ? bbkeys[id].get() : nullptr;
+    }
+private:
+    std::vector<std::shared_ptr<const IssuerContext>> issuers;
+    std::vector<std::shared_ptr<const BBKeyContext>> bbkeys;
+};
+
+}
@@ -6,6 +6,8 @@
  */
 
 #include <array>
+#include <cstdint>
+#include <vector>
 #include <mcl/bn256.hpp>
 
 #include "crypto.hpp"
@@ -47,17 +49,32 @@ struct Protocol {
     G1 iH; 
     Curve crv;
     std::array<G1,GENERATOR_COUNT> generators; 
+    std::array<G1,2> cmtgens; // g1, iH of the commitment B & the proofs on it
+    std::array<G1,2> lgens;   // lH, iH of the commitment to l
     Protocol() {
         hashAndMapToG1(iH,"uniqueH");
         hashAndMapToG1(lH,"lambdaH");
         hashAndMapToG1(uH,"issuerH");
-        SetupGenerators(generators); 
+        SetupGenerators(generators,"generator"); 
+        cmtgens = {{ crv.g1, iH }};
+        lgens = {{ lH, iH }};
     }
 };
 
+// the keys rows may refer to by id: issuer 0 is pub & issuer i > 0 is issuers[i-1], 
+// snip key i is bbkeys[i]
 struct TrustLayer {
     G2 pub;    
     std::vector<G2> bbkeys;
+    std::vector<G2> issuers;
+
+    // null for an unknown id
+    const G2* Issuer(uint32_t id) const {
+        return id == 0 ? &pub : id <= issuers.size() ? &issuers[id-1] : nullptr;
+    }
+    const G2* BBKey(uint32_t id) const {
+        return id < bbkeys.size() ? &bbkeys[id] : nullptr;
+    }
 };
 
 }
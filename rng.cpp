@@ -0,0 +1,321 @@
+/**
+ * Per thread random generation for the proof secrets
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "rng.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cybozu/sha2.hpp>
+
+using namespace philips::rng;
+
+#define RESEED_BLOCKS (1u << 16) // 4MB of keystream per OS key
+
+/*--------------------------------------------------------------------------------------
+ * ChaCha20
+ *-------------------------------------------------------------------------------------*/
+
+static inline uint32_t Rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+#define QUARTER(a,b,c,d) \
+    a += b; d ^= a; d = Rotl(d,16); \
+    c += d; b ^= c; b = Rotl(b,12); \
+    a += b; d ^= a; d = Rotl(d,8);  \
+    c += d; b ^= c; b = Rotl(b,7);
+
+void philips::rng::ChaCha20Block(const uint32_t key[8], uint32_t counter,
+    const uint32_t nonce[3], uint8_t out[64])
+{
+    const uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, nonce[0], nonce[1], nonce[2]
+    };
+    uint32_t x[16];
+    memcpy(x,in,sizeof(x));
+    for(size_t i = 0; i < 10; i++) {
+        QUARTER(x[0],x[4],x[8],x[12]);
+        QUARTER(x[1],x[5],x[9],x[13]);
+        QUARTER(x[2],x[6],x[10],x[14]);
+        QUARTER(x[3],x[7],x[11],x[15]);
+        QUARTER(x[0],x[5],x[10],x[15]);
+        QUARTER(x[1],x[6],x[11],x[12]);
+        QUARTER(x[2],x[7],x[8],x[13]);
+        QUARTER(x[3],x[4],x[9],x[14]);
+    }
+    for(size_t i = 0; i < 16; i++) {
+        const uint32_t v = x[i] + in[i];
+        out[4*i+0] = (uint8_t) v;
+        out[4*i+1] = (uint8_t) (v >> 8);
+        out[4*i+2] = (uint8_t) (v >> 16);
+        out[4*i+3] = (uint8_t) (v >> 24);
+    }
+}
+
+#undef QUARTER
+
+static void LoadKey(uint32_t key[8], const uint8_t seed[32])
+{
+    for(size_t i = 0; i < 8; i++) {
+        key[i] = (uint32_t) seed[4*i] | (uint32_t) seed[4*i+1] << 8 |
+            (uint32_t) seed[4*i+2] << 16 | (uint32_t) seed[4*i+3] << 24;
+    }
+}
+
+ChaCha20Rng::~ChaCha20Rng()
+{
+    volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(key);
+    for(size_t i = 0; i < sizeof(key); i++) p[i] = 0;
+}
+
+void ChaCha20Rng::Rekey(const uint8_t seed[32])
+{
+    LoadKey(key,seed);
+    blocks = 0;
+    pos = sizeof(buf);
+}
+
+// 4 blocks per refill, the first 32 bytes become the next key
+void ChaCha20Rng::Refill()
+{
+    static const uint32_t nonce[3] = {0, 0, 0};
+    for(uint32_t i = 0; i < sizeof(buf) / 64; i++) {
+        ChaCha20Block(key,i,nonce,buf + 64 * i);
+    }
+    LoadKey(key,buf);
+    memset(buf,0,32);
+    blocks += sizeof(buf) / 64;
+    pos = 32;
+}
+
+void ChaCha20Rng::Fill(void* out, size_t n)
+{
+    uint8_t* o = static_cast<uint8_t*>(out);
+    while(n > 0) {
+        if(pos == sizeof(buf)) Refill();
+        const size_t take = std::min(n,sizeof(buf) - pos);
+        memcpy(o,buf + pos,take);
+        memset(buf + pos,0,take);
+        pos += take;
+        o += take;
+        n -= take;
+    }
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Per thread state
+ * the epoch changes on Seed, Unseed & in a forked child, threads rekey when they see it
+ *-------------------------------------------------------------------------------------*/
+
+namespace {
+
+struct Global {
+    std::mutex m;
+    std::atomic<uint64_t> epoch;
+    bool seeded;
+    uint8_t seed[32];
+    uint64_t threads; // threads keyed since the seed was set
+    Global() : epoch(1), seeded(false), threads(0) {}
+};
+
+Global& Shared()
+{
+    static Global g;
+    return g;
+}
+
+// the lock is held across fork, so a child never inherits it from another thread of
+// the parent that was in the middle of keying
+void BeforeFork()
+{
+    Shared().m.lock();
+}
+
+void AfterForkParent()
+{
+    Shared().m.unlock();
+}
+
+void OnFork()
+{
+    Shared().m.unlock();
+    Shared().epoch.fetch_add(1);
+}
+
+// the kernel's entropy, aborting is the only safe answer to a missing /dev/urandom
+void Entropy(uint8_t seed[32])
+{
+    int fd = open("/dev/urandom",O_RDONLY | O_CLOEXEC);
+    size_t got = 0;
+    while(fd >= 0 && got < 32) {
+        ssize_t r = read(fd,seed + got,32 - got);
+        if(r <= 0) break;
+        got += r;
+    }
+    if(fd >= 0) close(fd);
+    if(got != 32) abort();
+}
+
+struct Local {
+    ChaCha20Rng own;
+    Generator* installed;
+    uint64_t epoch;
+    bool deterministic;
+
+    Local() : own(Zero()), installed(nullptr), epoch(0), deterministic(false) {
+        static std::once_flag fork;
+        std::call_once(fork,[]{ pthread_atfork(BeforeFork,AfterForkParent,OnFork); });
+    }
+
+    static const uint8_t* Zero() {
+        static const uint8_t zero[32] = {};
+        return zero;
+    }
+
+    void Key() {
+        Global& g = Shared();
+        uint8_t seed[32];
+        bool seeded;
+        {
+            std::lock_guard<std::mutex> lk(g.m);
+            epoch = g.epoch.load();
+            seeded = g.seeded;
+            if(seeded) {
+                cybozu::Sha256 h;
+                const uint64_t ordinal = g.threads++;
+                h.update(g.seed,sizeof(g.seed));
+                h.update(&ordinal,sizeof(ordinal));
+                h.digest(seed,sizeof(seed),"",0);
+            }
+        }
+        if(!seeded) Entropy(seed);
+        own.Rekey(seed);
+        deterministic = seeded;
+        memset(seed,0,sizeof(seed));
+    }
+
+    Generator& Get() {
+        if(installed) return *installed;
+        if(epoch != Shared().epoch.load(std::memory_order_relaxed) ||
+            (!deterministic && own.Blocks() >= RESEED_BLOCKS)) Key();
+        return own;
+    }
+};
+
+Local& Mine()
+{
+    static thread_local Local l;
+    return l;
+}
+
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Sampling
+ *-------------------------------------------------------------------------------------*/
+
+void philips::rng::Bytes(void* out, size_t n)
+{
+    Mine().Get().Fill(out,n);
+}
+
+void philips::rng::Rand(Fr& x)
+{
+    Rand(&x,1);
+}
+
+// candidates are masked to the bit length of r and rejected when not below it, as mcl
+// does for setRand, so there is no modulo bias
+void philips::rng::Rand(Fr* x, size_t n)
+{
+    static const size_t bytes = Fr::getByteSize();
+    static const uint8_t top = (uint8_t) (0xff >> (8 * bytes - Fr::getBitSize()));
+    Generator& g = Mine().Get();
+    uint8_t buf[512];
+    size_t avail = 0, at = 0;
+    for(size_t i = 0; i < n; ) {
+        // about half the candidates are accepted, draw for twice what is left
+        if(at == avail) {
+            avail = std::min(2 * (n - i),sizeof(buf) / bytes) * bytes;
+            g.Fill(buf,avail);
+            at = 0;
+        }
+        uint8_t* cand = buf + at;
+        at += bytes;
+        cand[bytes - 1] &= top;
+        bool ok;
+        x[i].setArray(&ok,cand,bytes);
+        if(ok) i++;
+    }
+    memset(buf,0,sizeof(buf));
+}
+
+void philips::rng::Seed(const std::string& seed)
+{
+    Global& g = Shared();
+    std::lock_guard<std::mutex> lk(g.m);
+    cybozu::Sha256 h;
+    h.digest(g.seed,sizeof(g.seed),seed.data(),seed.size());
+    g.seeded = true;
+    g.threads = 0;
+    g.epoch.fetch_add(1);
+}
+
+void philips::rng::Unseed()
+{
+    Global& g = Shared();
+    std::lock_guard<std::mutex> lk(g.m);
+    memset(g.seed,0,sizeof(g.seed));
+    g.seeded = false;
+    g.epoch.fetch_add(1);
+}
+
+bool philips::rng::Seeded()
+{
+    Global& g = Shared();
+    std::lock_guard<std::mutex> lk(g.m);
+    return g.seeded;
+}
+
+ScopedGenerator::ScopedGenerator(Generator& gen) : previous(Mine().installed)
+{
+    Mine().installed = &gen;
+}
+
+ScopedGenerator::~ScopedGenerator()
+{
+    Mine().installed = previous;
+}
+
+static const uint8_t* HashSeed(const void* seed, size_t n, uint8_t out[32])
+{
+    cybozu::Sha256 h;
+    h.digest(out,32,seed,n);
+    return out;
+}
+
+ScopedSeed::ScopedSeed(const std::string& seed) : ScopedSeed(seed.data(),seed.size()) {}
+
+ScopedSeed::ScopedSeed(const void* seed, size_t n) : gen(HashSeed(seed,n,key)),
+    scope(gen)
+{
+    memset(key,0,sizeof(key));
+}
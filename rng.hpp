@@ -0,0 +1,108 @@
+#pragma once
+/**
+ * Per thread random generation for the proof secrets
+ * a ChaCha20 DRBG per thread, keyed from the OS or from an explicit seed
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <mcl/bn256.hpp>
+
+namespace philips { namespace rng {
+
+using namespace mcl::bn256;
+
+/**
+ * The ChaCha20 block function of RFC 7539
+ * ------------------------------------------
+ */
+void ChaCha20Block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3],
+    uint8_t out[64]);
+
+// a source of random bytes, install one per thread with ScopedGenerator
+class Generator {
+public:
+    virtual ~Generator() {}
+    virtual void Fill(void* out, size_t n) = 0;
+};
+
+// ChaCha20 keystream with fast key erasure, the key is replaced on every refill
+class ChaCha20Rng : public Generator {
+public:
+    explicit ChaCha20Rng(const uint8_t seed[32]) { Rekey(seed); }
+    ~ChaCha20Rng();
+    void Rekey(const uint8_t seed[32]);
+    void Fill(void* out, size_t n);
+
+    uint64_t Blocks() const { return blocks; } // keystream blocks since the last key
+private:
+    void Refill();
+    uint32_t key[8];
+    uint8_t buf[256];
+    size_t pos;
+    uint64_t blocks;
+};
+
+/**
+ * Random bytes from the generator of the calling thread
+ * ------------------------------------------
+ */
+void Bytes(void* out, size_t n);
+
+/**
+ * Uniform Fr by rejection sampling, one at a time or in batches
+ * ------------------------------------------
+ */
+void Rand(Fr& x);
+void Rand(Fr* x, size_t n);
+
+template <size_t N>
+void Rand(std::array<Fr,N>& x)
+{
+    Rand(x.data(),N);
+}
+
+/**
+ * Deterministic mode for benchmarks & regression tests
+ * every thread is keyed from the seed and the order in which it first draws, so a run
+ * with the same seed & the same thread structure reproduces its proofs exactly
+ * ------------------------------------------
+ */
+void Seed(const std::string& seed);
+
+/**
+ * Back to generators keyed by the OS
+ * ------------------------------------------
+ */
+void Unseed();
+
+bool Seeded();
+
+// installs a generator for the calling thread until it goes out of scope
+class ScopedGenerator {
+public:
+    explicit ScopedGenerator(Generator& g);
+    ~ScopedGenerator();
+    ScopedGenerator(const ScopedGenerator&) = delete;
+    ScopedGenerator& operator=(const ScopedGenerator&) = delete;
+private:
+    Generator* previous;
+};
+
+// a ChaCha20 stream keyed by the hash of seed for the calling thread only
+class ScopedSeed {
+public:
+    explicit ScopedSeed(const std::string& seed);
+    ScopedSeed(const void* seed, size_t n);
+private:
+    uint8_t key[32];
+    ChaCha20Rng gen;
+    ScopedGenerator scope;
+};
+
+}}
@@ -9,20 +9,24 @@
 #include <memory>
 #include <mcl/bn256.hpp>
 
+#include "fixedbase.hpp"
+#include "stats.hpp"
+
 using namespace mcl::bn256;
 
 namespace philips {
 
 /**
- * Verify Schnorr over fixed array sizes
+ * Recompute the commitment of a Schnorr proof over fixed array sizes
+ * cmt^challenge * prod generators^response
  * ------------------------------------------
  */
 template <size_t N, size_t M>
-bool VerifySchnorrProofG1(const G1& cmt, const G1& left, const Fr& challenge, 
+void SchnorrCommitmentG1(const G1& cmt, const Fr& challenge, 
     const typename std::array<Fr,N>::const_iterator& response, 
-    const typename std::array<G1,M>::const_iterator& generators) 
+    const typename std::array<G1,M>::const_iterator& generators, G1& right) 
 {
-    G1 right; 
+    STAT_COUNT(G1_MUL,M + 1);
     G1::mul(right,cmt,challenge);
     auto resp = response;  
     auto gen = generators;  
@@ -31,33 +35,113 @@ bool VerifySchnorrProofG1(const G1& cmt, const G1& left, const Fr& challenge,
         G1::mul(mult,*gen++,*resp++);
         G1::add(right,right,mult);
     }
+}
 
+
+/**
+ * Verify Schnorr over fixed array sizes
+ * ------------------------------------------
+ */
+template <size_t N, size_t M>
+bool VerifySchnorrProofG1(const G1& cmt, const G1& left, const Fr& challenge, 
+    const typename std::array<Fr,N>::const_iterator& response, 
+    const typename std::array<G1,M>::const_iterator& generators) 
+{
+    G1 right; 
+    SchnorrCommitmentG1<N,M>(cmt,challenge,response,generators,right);
     return (left == right);
 }
 
 
+// a power of a plain or of a tabled Gt base
+inline void GtPow(Fp12& out, const Fp12& base, const Fr& x)
+{
+    STAT_COUNT(GT_POW,1);
+    Fp12::pow(out,base,x);
+}
+
+inline void GtPow(Fp12& out, const GtFixedBase& base, const Fr& x)
+{
+    base.Pow(out,x);
+}
+
+
+/**
+ * Recompute the commitment of a Schnorr proof over fixed array sizes of Gt, the 
+ * generators are Fp12 or GtFixedBase
+ */
+template <size_t N, size_t M, typename B = Fp12>
+void SchnorrCommitmentGt(const Fp12& cmt, const Fr& challenge, 
+    const typename std::array<Fr,N>::const_iterator& response, 
+    const typename std::array<B,M>::const_iterator& generators, Fp12& right) 
+{
+    STAT_COUNT(GT_POW,1);
+    Fp12::pow(right,cmt,challenge);
+    auto resp = response;  
+    auto gen = generators;  
+    for(size_t i = 0; i < M ; i++) {
+        if(*resp != (Fr) 0) { // security risk?
+            Fp12 exp;
+            GtPow(exp,*gen,*resp);
+            Fp12::mul(right,right,exp);
+        }
+        gen++;
+        resp++;
+    }
+}
+
+
 /**
  * Verify Schnorr over fixed array sizes of Gt
  */
-template <size_t N, size_t M>
+template <size_t N, size_t M, typename B = Fp12>
 bool VerifySchnorrProofGt(const Fp12& cmt, const Fp12& left, const Fr& challenge, 
     const typename std::array<Fr,N>::const_iterator& response, 
-    const typename std::array<Fp12,M>::const_iterator& generators) 
+    const typename std::array<B,M>::const_iterator& generators) 
 {
     Fp12 right; 
+    SchnorrCommitmentGt<N,M,B>(cmt,challenge,response,generators,right);
+    return (left == right);
+}
+
+
+/**
+ * As SchnorrCommitmentGt with the first L generators apart from the others, per proof
+ * or per key bases in front of shared ones, generators points at generator L
+ */
+template <size_t N, size_t M, size_t L>
+void SchnorrCommitmentGt(const Fp12& cmt, const Fr& challenge, 
+    const typename std::array<Fr,N>::const_iterator& response, 
+    const std::array<const GtFixedBase*,L>& leads,
+    const typename std::array<GtFixedBase,M>::const_iterator& generators, Fp12& right) 
+{
+    STAT_COUNT(GT_POW,1);
     Fp12::pow(right,cmt,challenge);
     auto resp = response;  
     auto gen = generators;  
     for(size_t i = 0; i < M ; i++) {
-        if(*resp != (Fr) 0) { // security risk?
+        if(*resp != (Fr) 0) {
             Fp12 exp;
-            Fp12::pow(exp,*gen,*resp);
+            GtPow(exp,i < L ? *leads[i] : *gen,*resp);
             Fp12::mul(right,right,exp);
         }
-        gen++;
+        if(i >= L) gen++;
         resp++;
     }
+}
 
+
+/**
+ * Verify Schnorr over Gt with the first L generators apart from the others
+ */
+template <size_t N, size_t M, size_t L>
+bool VerifySchnorrProofGt(const Fp12& cmt, const Fp12& left, const Fr& challenge, 
+    const typename std::array<Fr,N>::const_iterator& response, 
+    const std::array<const GtFixedBase*,L>& leads,
+    const typename std::array<GtFixedBase,M>::const_iterator& generators) 
+{
+    Fp12 right; 
+    SchnorrCommitmentGt<N,M,L>(cmt,challenge,response,leads,generators,right);
     return (left == right);
 }
 
@@ -0,0 +1,292 @@
+/**
+ * Sharded table verification
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "shard.hpp"
+#include "codec.hpp"
+#include "transcript.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PRECOMPUTE_MAGIC "zkdeid-precompute-2\n"
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Workers
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * Verify the rows [first,first+count) of an encoded table indexed by IndexTable
+ * ------------------------------------------
+ */
+void philips::VerifyShard(const Verifier& v, const std::string& table,
+    const G2& tablekey, const std::vector<size_t>& offsets, size_t first, size_t count,
+    size_t partitions, ShardResult& result)
+{
+    TableContext context(*v.protocol,tablekey,TableContext::Window(count));
+    context.AddTrustKeys(v);
+    VerifyShard(v,table,context,offsets,first,count,partitions,result);
+}
+
+void philips::VerifyShard(const Verifier& v, const std::string& table,
+    const TableContext& context, const std::vector<size_t>& offsets, size_t first,
+    size_t count, size_t partitions, ShardResult& result)
+{
+    result.valid = false;
+    result.partitions.assign(std::max<size_t>(partitions,1),std::vector<Digest>());
+    Row row; // decoded into again, its strings & vectors keep their capacity
+    for(size_t i = first; i < first + count; i++) {
+        const char* cur = table.data() + offsets[i];
+        if(!DecodeRow(cur,table.data() + offsets[i+1],row)) return;
+        if(!VerifyProof(row.proof,context,row.snips,row.disclosed,v)) return;
+        const Digest d = RowFingerprint(row.proof.rowId);
+        result.partitions[d[0] * result.partitions.size() / 256].push_back(d);
+    }
+    for(std::vector<Digest>& part : result.partitions) {
+        std::sort(part.begin(),part.end());
+    }
+    result.valid = true;
+}
+
+/**
+ * Append a shard result to a buffer
+ * ------------------------------------------
+ */
+void philips::EncodeShardResult(std::string& out, const ShardResult& result)
+{
+    PutU32(out,result.valid);
+    PutU32(out,result.partitions.size());
+    for(const std::vector<Digest>& part : result.partitions) {
+        PutU32(out,part.size());
+        for(const Digest& d : part) {
+            out.append(reinterpret_cast<const char*>(d.data()),d.size());
+        }
+    }
+}
+
+/**
+ * Read a shard result from [cur,end), partitions have to be sorted
+ * ------------------------------------------
+ */
+bool philips::DecodeShardResult(const char*& cur, const char* end, ShardResult& result)
+{
+    size_t valid, parts, n;
+    if(!GetU32(cur,end,valid) || valid > 1 || !GetU32(cur,end,parts) ||
+        parts > (size_t) (end - cur) / 4) {
+        return false;
+    }
+    result.valid = valid == 1;
+    result.partitions.resize(parts);
+    for(std::vector<Digest>& part : result.partitions) {
+        if(!GetU32(cur,end,n) || n > (size_t) (end - cur) / 32) return false;
+        part.resize(n);
+        for(Digest& d : part) {
+            memcpy(d.data(),cur,d.size());
+            cur += d.size();
+        }
+        if(!std::is_sorted(part.begin(),part.end())) return false;
+    }
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Precomputation file
+ *-------------------------------------------------------------------------------------*/
+
+// the digest binding the pairings of a file to the protocol & trust layer they are for
+static Digest PrecomputeDigest(const Protocol& p, const TrustLayer& trust,
+    const std::array<Fp12,PAIRING_COUNT>& pairings)
+{
+    Transcript t("zkdeid precompute");
+    AbsorbSetup(t,p,trust);
+    for(const Fp12& e : pairings) {
+        t.Absorb("pairing",e);
+    }
+    Fr c;
+    Digest d;
+    t.Challenge("digest",c);
+    c.serialize(d.data(),d.size());
+    return d;
+}
+
+/**
+ * Write the verifier precomputation & its digest, atomically through a rename
+ * ------------------------------------------
+ */
+bool philips::WritePrecompute(const std::string& path, const Verifier& v)
+{
+    std::string out(PRECOMPUTE_MAGIC);
+    char buf[Fp12_size];
+    for(const Fp12& e : v.pairings) {
+        e.serialize(buf,sizeof(buf));
+        out.append(buf,sizeof(buf));
+    }
+    const Digest d = PrecomputeDigest(*v.protocol,v.trust,v.pairings);
+    out.append(reinterpret_cast<const char*>(d.data()),d.size());
+    const std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(),"wb");
+    if(!f) return false;
+    const bool written = fwrite(out.data(),1,out.size(),f) == out.size();
+    if(fclose(f) != 0 || !written) return false;
+    return rename(tmp.c_str(),path.c_str()) == 0;
+}
+
+/**
+ * Read a precomputation file into a new verifier, the pairings are deserialized into
+ * the verifier so the file is read once & closed
+ * ------------------------------------------
+ */
+bool philips::ReadPrecompute(const std::string& path, const TrustLayer& trust,
+    std::shared_ptr<const Protocol> p, std::unique_ptr<Verifier>& v)
+{
+    const size_t header = sizeof(PRECOMPUTE_MAGIC) - 1;
+    const size_t size = header + PAIRING_COUNT * Fp12_size + sizeof(Digest);
+    std::string in(size + 1,'\0');
+    FILE* f = fopen(path.c_str(),"rb");
+    if(!f) return false;
+    const size_t got = fread(&in[0],1,in.size(),f);
+    fclose(f);
+    if(got != size || memcmp(in.data(),PRECOMPUTE_MAGIC,header) != 0) return false;
+
+    std::array<Fp12,PAIRING_COUNT> pre;
+    for(size_t i = 0; i < PAIRING_COUNT; i++) {
+        const char* el = in.data() + header + i * Fp12_size;
+        if(pre[i].deserialize(el,Fp12_size) != Fp12_size) return false;
+    }
+
+    // the file has to be the one written for this protocol & trust layer
+    const Digest d = PrecomputeDigest(*p,trust,pre);
+    if(memcmp(in.data() + header + PAIRING_COUNT * Fp12_size,d.data(),d.size()) != 0) {
+        return false;
+    }
+    STAT_COUNT(PAIRING,1);
+    Fp12 check;
+    pairing(check,p->iH,trust.pub);
+    if(check != pre[1]) return false;
+    v.reset(new Verifier(trust,p,pre));
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Coordinator
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * All shards valid & no fingerprint twice across them
+ * ------------------------------------------
+ */
+bool philips::MergeShards(const std::vector<ShardResult>& shards)
+{
+    if(shards.empty()) return true;
+    const size_t parts = shards[0].partitions.size();
+    for(const ShardResult& r : shards) {
+        if(!r.valid || r.partitions.size() != parts) return false;
+    }
+    std::vector<Digest> merged;
+    for(size_t p = 0; p < parts; p++) {
+        merged.clear();
+        for(const ShardResult& r : shards) {
+            const size_t mid = merged.size();
+            merged.insert(merged.end(),r.partitions[p].begin(),r.partitions[p].end());
+            std::inplace_merge(merged.begin(),merged.begin() + mid,merged.end());
+        }
+        if(std::adjacent_find(merged.begin(),merged.end()) != merged.end()) return false;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const std::string& data)
+{
+    size_t done = 0;
+    while(done < data.size()) {
+        ssize_t w = write(fd,data.data() + done,data.size() - done);
+        if(w <= 0) return false;
+        done += w;
+    }
+    return true;
+}
+
+static void ReadAll(int fd, std::string& data)
+{
+    char buf[1 << 16];
+    ssize_t r;
+    while((r = read(fd,buf,sizeof(buf))) > 0) data.append(buf,r);
+}
+
+/**
+ * Check an encoded table with forked worker processes
+ * ------------------------------------------
+ */
+bool philips::ShardedCheckTable(const Verifier& v, const std::string& table,
+    size_t workers)
+{
+    G2 tablekey;
+    std::vector<size_t> offsets;
+    const char* cur = table.data();
+    if(!IndexTable(cur,table.data() + table.size(),tablekey,offsets)) return false;
+    const size_t rows = offsets.size() - 1;
+    workers = std::max<size_t>(1,std::min(workers,rows));
+    std::vector<ShardResult> shards(workers);
+    TableContext context(*v.protocol,tablekey,TableContext::Window(rows));
+    context.AddTrustKeys(v);
+    if(workers == 1) {
+        VerifyShard(v,table,context,offsets,0,rows,1,shards[0]);
+        return MergeShards(shards);
+    }
+
+    // the children share the table, the verifier & the context copy on write; the
+    // context holds every key so a child never takes the KeyCache lock, which another
+    // thread of the parent may have held at the fork
+    std::vector<std::pair<pid_t,int>> children;
+    bool ok = true;
+    for(size_t w = 0; w < workers && ok; w++) {
+        const size_t first = rows * w / workers;
+        const size_t next = rows * (w + 1) / workers;
+        int fd[2];
+        if(pipe(fd) != 0) {
+            ok = false;
+            break;
+        }
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(fd[0]);
+            ShardResult r;
+            std::string out;
+            VerifyShard(v,table,context,offsets,first,next - first,workers,r);
+            EncodeShardResult(out,r);
+            _exit(WriteAll(fd[1],out) ? 0 : 1);
+        }
+        close(fd[1]);
+        if(pid < 0) {
+            close(fd[0]);
+            ok = false;
+            break;
+        }
+        children.push_back(std::make_pair(pid,fd[0]));
+    }
+
+    for(size_t w = 0; w < children.size(); w++) {
+        std::string in;
+        int status;
+        ReadAll(children[w].second,in);
+        close(children[w].second);
+        const char* c = in.data();
+        ok = waitpid(children[w].first,&status,0) == children[w].first &&
+            WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            DecodeShardResult(c,in.data() + in.size(),shards[w]) && ok;
+    }
+    return ok && MergeShards(shards);
+}
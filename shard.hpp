@@ -0,0 +1,84 @@
+#pragma once
+/**
+ * Sharded table verification
+ * workers verify row ranges of an encoded table & emit their rowId fingerprints split
+ * into partitions, a merge of the sorted partitions proves global uniqueness
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <string>
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+//philips
+#include "checkpoint.hpp"
+#include "deid.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+// what a worker reports for its shard
+struct ShardResult {
+    bool valid;                                 // every row of the shard verified
+    std::vector<std::vector<Digest>> partitions; // sorted fingerprints by leading byte
+};
+
+/*--------------------------------------------------------------------------------------
+ * Workers
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * Verify the rows [first,first+count) of an encoded table indexed by IndexTable
+ * ------------------------------------------
+ */
+void VerifyShard(const Verifier& v, const std::string& table, const G2& tablekey,
+    const std::vector<size_t>& offsets, size_t first, size_t count, size_t partitions,
+    ShardResult& result);
+
+// as above under a context of the tablekey, with every key added by AddTrustKeys the
+// rows never look a key up in the KeyCache of the verifier
+void VerifyShard(const Verifier& v, const std::string& table, const TableContext& context,
+    const std::vector<size_t>& offsets, size_t first, size_t count, size_t partitions,
+    ShardResult& result);
+
+/**
+ * Marshalling of shard results, for workers on other boxes
+ * ------------------------------------------
+ */
+void EncodeShardResult(std::string& out, const ShardResult& result);
+bool DecodeShardResult(const char*& cur, const char* end, ShardResult& result);
+
+/**
+ * The verifier precomputation as a file, workers read it instead of redoing the
+ * pairings. A digest binds the pairings to the protocol & the whole trust layer, reading
+ * rejects a file written for another setup or damaged since & checks the trust key
+ * against one fresh pairing
+ * ------------------------------------------
+ */
+bool WritePrecompute(const std::string& path, const Verifier& v);
+bool ReadPrecompute(const std::string& path, const TrustLayer& trust,
+    std::shared_ptr<const Protocol> p, std::unique_ptr<Verifier>& v);
+
+
+/*--------------------------------------------------------------------------------------
+ * Coordinator
+ *-------------------------------------------------------------------------------------*/
+
+/**
+ * All shards valid & no fingerprint twice across them, partitions are merged one by one
+ * ------------------------------------------
+ */
+bool MergeShards(const std::vector<ShardResult>& shards);
+
+/**
+ * Check an encoded table with forked worker processes, they inherit the verifier & its
+ * precomputation from the caller
+ * ------------------------------------------
+ */
+bool ShardedCheckTable(const Verifier& v, const std::string& table, size_t workers);
+
+}
@@ -0,0 +1,230 @@
+/**
+ * Hot path instrumentation
+ * every thread counts into its own block, snapshots sum the blocks
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "stats.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+using namespace philips::stats;
+
+static const char* counter_names[COUNTER_COUNT] = {
+    "pairing", "g1_mul", "g2_mul", "gt_pow", "gt_fixed_pow", "gt_table", "hash"
+};
+
+static const char* phase_names[PHASE_COUNT] = {
+    "prove", "prove_commit", "prove_pf3", "prove_row", "prove_snips", "prove_response",
+    "verify", "verify_g1", "verify_pf3", "verify_row", "verify_snips", "fiatshamir"
+};
+
+/*--------------------------------------------------------------------------------------
+ * Per thread storage
+ * only the owning thread writes, relaxed atomics keep the snapshot reads defined
+ *-------------------------------------------------------------------------------------*/
+
+namespace {
+
+struct Cell {
+    std::atomic<uint64_t> v;
+    Cell() : v(0) {}
+    void Add(uint64_t n) { v.store(v.load(std::memory_order_relaxed) + n,
+        std::memory_order_relaxed); }
+    uint64_t Get() const { return v.load(std::memory_order_relaxed); }
+};
+
+struct PhaseBlock {
+    Cell count;
+    Cell total;
+    Cell histogram[STATS_BUCKETS];
+};
+
+struct Block {
+    Cell counters[COUNTER_COUNT];
+    PhaseBlock phases[PHASE_COUNT];
+
+    void Clear() {
+        for(Cell& c : counters) c.v.store(0,std::memory_order_relaxed);
+        for(PhaseBlock& p : phases) {
+            p.count.v.store(0,std::memory_order_relaxed);
+            p.total.v.store(0,std::memory_order_relaxed);
+            for(Cell& c : p.histogram) c.v.store(0,std::memory_order_relaxed);
+        }
+    }
+
+    void AddTo(Snapshot& s) const {
+        for(size_t i = 0; i < COUNTER_COUNT; i++) s.counters[i] += counters[i].Get();
+        for(size_t i = 0; i < PHASE_COUNT; i++) {
+            s.phases[i].count += phases[i].count.Get();
+            s.phases[i].total_ns += phases[i].total.Get();
+            for(size_t b = 0; b < STATS_BUCKETS; b++) {
+                s.phases[i].histogram[b] += phases[i].histogram[b].Get();
+            }
+        }
+    }
+};
+
+struct Registry {
+    std::mutex m;
+    std::vector<const Block*> live;
+    Snapshot retired; // blocks of finished threads
+};
+
+Registry& Global()
+{
+    static Registry r;
+    return r;
+}
+
+struct Local {
+    Block block;
+    Local() {
+        Registry& r = Global();
+        std::lock_guard<std::mutex> lk(r.m);
+        r.live.push_back(&block);
+    }
+    ~Local() {
+        Registry& r = Global();
+        std::lock_guard<std::mutex> lk(r.m);
+        block.AddTo(r.retired);
+        for(size_t i = 0; i < r.live.size(); i++) {
+            if(r.live[i] == &block) {
+                r.live[i] = r.live.back();
+                r.live.pop_back();
+                break;
+            }
+        }
+    }
+};
+
+Block& Mine()
+{
+    static thread_local Local l;
+    return l.block;
+}
+
+}
+
+/*--------------------------------------------------------------------------------------
+ * Recording
+ *-------------------------------------------------------------------------------------*/
+
+bool philips::stats::Enabled()
+{
+#ifdef ZKDEID_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void philips::stats::Count(Counter c, uint64_t n)
+{
+    Mine().counters[c].Add(n);
+}
+
+void philips::stats::Record(PhaseId ph, uint64_t ns)
+{
+    size_t bucket = 0;
+    while(bucket + 1 < STATS_BUCKETS && (1ull << bucket) < ns) bucket++;
+    PhaseBlock& p = Mine().phases[ph];
+    p.count.Add(1);
+    p.total.Add(ns);
+    p.histogram[bucket].Add(1);
+}
+
+Snapshot philips::stats::Take()
+{
+    Registry& r = Global();
+    std::lock_guard<std::mutex> lk(r.m);
+    Snapshot s = r.retired;
+    for(const Block* b : r.live) b->AddTo(s);
+    return s;
+}
+
+void philips::stats::Reset()
+{
+    Registry& r = Global();
+    std::lock_guard<std::mutex> lk(r.m);
+    r.retired = Snapshot();
+    for(const Block* b : r.live) const_cast<Block*>(b)->Clear();
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Reporting
+ *-------------------------------------------------------------------------------------*/
+
+double PhaseStats::Percentile(double q) const
+{
+    uint64_t total = 0;
+    for(uint64_t c : histogram) total += c;
+    if(total == 0) return 0;
+    const uint64_t rank = (uint64_t) std::ceil(q * total);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram[i];
+        if(seen >= rank) return (double) (1ull << i);
+    }
+    return (double) (1ull << (STATS_BUCKETS - 1));
+}
+
+Snapshot Snapshot::Since(const Snapshot& before) const
+{
+    Snapshot d = *this;
+    for(size_t i = 0; i < COUNTER_COUNT; i++) d.counters[i] -= before.counters[i];
+    for(size_t i = 0; i < PHASE_COUNT; i++) {
+        d.phases[i].count -= before.phases[i].count;
+        d.phases[i].total_ns -= before.phases[i].total_ns;
+        for(size_t b = 0; b < STATS_BUCKETS; b++) {
+            d.phases[i].histogram[b] -= before.phases[i].histogram[b];
+        }
+    }
+    return d;
+}
+
+std::string Snapshot::Text() const
+{
+    std::ostringstream os;
+    for(size_t i = 0; i < COUNTER_COUNT; i++) {
+        os << counter_names[i] << " " << counters[i] << "\n";
+    }
+    for(size_t i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats& p = phases[i];
+        if(p.count == 0) continue;
+        os << phase_names[i] << " count " << p.count
+           << " mean_ns " << p.total_ns / p.count
+           << " p50_ns " << p.Percentile(0.5)
+           << " p99_ns " << p.Percentile(0.99) << "\n";
+    }
+    return os.str();
+}
+
+std::string Snapshot::Json() const
+{
+    std::ostringstream os;
+    os << "{\"counters\":{";
+    for(size_t i = 0; i < COUNTER_COUNT; i++) {
+        os << (i ? "," : "") << "\"" << counter_names[i] << "\":" << counters[i];
+    }
+    os << "},\"phases\":{";
+    for(size_t i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats& p = phases[i];
+        os << (i ? "," : "") << "\"" << phase_names[i] << "\":{\"count\":" << p.count
+           << ",\"total_ns\":" << p.total_ns << ",\"histogram\":[";
+        for(size_t b = 0; b < STATS_BUCKETS; b++) {
+            os << (b ? "," : "") << p.histogram[b];
+        }
+        os << "]}";
+    }
+    os << "}}";
+    return os.str();
+}
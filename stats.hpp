@@ -0,0 +1,150 @@
+#pragma once
+/**
+ * Hot path instrumentation: crypto operation counters & per phase timers
+ * compiled in with -DZKDEID_STATS (cmake -DSTATS=ON), otherwise the macros vanish
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#define STATS_BUCKETS 40 // log2 nanosecond latency buckets
+
+#ifdef ZKDEID_STATS
+#define STAT_COUNT(c,n) philips::stats::Count(philips::stats::c,(n))
+#define STAT_PHASE(var,ph) philips::stats::Phase var(philips::stats::ph)
+#define STAT_TIMER(var,ph) philips::stats::Timer var(philips::stats::ph)
+#define STAT_NEXT(var,ph) var.Next(philips::stats::ph)
+#else
+#define STAT_COUNT(c,n) ((void) 0)
+#define STAT_PHASE(var,ph) ((void) 0)
+#define STAT_TIMER(var,ph) ((void) 0)
+#define STAT_NEXT(var,ph) ((void) 0)
+#endif
+
+namespace philips { namespace stats {
+
+enum Counter {
+    PAIRING,      // full pairings, including the final exponentiation
+    G1_MUL,       // G1 scalar multiplications
+    G2_MUL,       // G2 scalar multiplications
+    GT_POW,       // Fp12 exponentiations of a base without a table
+    GT_FIXED_POW, // GtFixedBase powers from its table
+    GT_TABLE,     // GtFixedBase tables built
+    HASH,         // hashes to Fr, including fiat shamir challenges
+    COUNTER_COUNT
+};
+
+enum PhaseId {
+    PROVE,          // NewZkProof
+    PROVE_COMMIT,   // G1 commitments & blinding
+    PROVE_PF3,      // signature proof pairings & Gt commitment
+    PROVE_ROW,      // rowId & uniqueness proof
+    PROVE_SNIPS,    // snip commitments
+    PROVE_RESPONSE, // responses to the challenges
+    VERIFY,         // VerifyProof
+    VERIFY_G1,      // G1 schnorr equations
+    VERIFY_PF3,     // signature proof pairings & Gt equation
+    VERIFY_ROW,     // uniqueness proof
+    VERIFY_SNIPS,   // snip proofs
+    FIATSHAMIR,     // challenge derivation, prover & verifier
+    PHASE_COUNT
+};
+
+struct PhaseStats {
+    uint64_t count;
+    uint64_t total_ns;
+    std::array<uint64_t,STATS_BUCKETS> histogram;
+
+    PhaseStats() : count(0), total_ns(0) { histogram.fill(0); }
+
+    // upper bound in nanoseconds of the q-th latency quantile
+    double Percentile(double q) const;
+};
+
+struct Snapshot {
+    std::array<uint64_t,COUNTER_COUNT> counters;
+    std::array<PhaseStats,PHASE_COUNT> phases;
+
+    Snapshot() { counters.fill(0); }
+
+    // the activity between before and this snapshot
+    Snapshot Since(const Snapshot& before) const;
+    std::string Text() const;
+    std::string Json() const;
+};
+
+/**
+ * Whether the library was compiled with ZKDEID_STATS
+ * ------------------------------------------
+ */
+bool Enabled();
+
+/**
+ * Add to a counter of the calling thread
+ * ------------------------------------------
+ */
+void Count(Counter c, uint64_t n);
+
+/**
+ * Add a latency sample to a phase of the calling thread
+ * ------------------------------------------
+ */
+void Record(PhaseId ph, uint64_t ns);
+
+/**
+ * Sum the counters of all threads, past and present
+ * ------------------------------------------
+ */
+Snapshot Take();
+
+/**
+ * Zero all counters
+ * ------------------------------------------
+ */
+void Reset();
+
+// times its own lifetime as one phase
+class Phase {
+public:
+    explicit Phase(PhaseId ph) : id(ph), start(std::chrono::steady_clock::now()) {}
+    ~Phase() {
+        Record(id,std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+private:
+    PhaseId id;
+    std::chrono::steady_clock::time_point start;
+};
+
+// times consecutive phases of one call, a phase entered twice is recorded once
+class Timer {
+public:
+    explicit Timer(PhaseId first) : current(first), touched(0),
+        mark(std::chrono::steady_clock::now()) { spent.fill(0); }
+    ~Timer() {
+        Next(current);
+        for(size_t i = 0; i < PHASE_COUNT; i++) {
+            if(touched & (1u << i)) Record((PhaseId) i,spent[i]);
+        }
+    }
+    void Next(PhaseId ph) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        spent[current] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now - mark).count();
+        touched |= 1u << current;
+        mark = now;
+        current = ph;
+    }
+private:
+    PhaseId current;
+    uint32_t touched;
+    std::array<uint64_t,PHASE_COUNT> spent;
+    std::chrono::steady_clock::time_point mark;
+};
+
+}}
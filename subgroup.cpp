@@ -0,0 +1,203 @@
+/**
+ * Group membership of untrusted elements
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <cstdint>
+#include <string>
+
+// philips
+#include "subgroup.hpp"
+#include "stats.hpp"
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Helpers
+ *-------------------------------------------------------------------------------------*/
+
+// a nonnegative integer as 32 bit limbs, least significant first
+typedef std::vector<uint32_t> Limbs;
+
+static Limbs Parse(const std::string& dec)
+{
+    Limbs out;
+    for(char c : dec) {
+        uint64_t carry = (uint64_t) (c - '0');
+        for(uint32_t& limb : out) {
+            carry += (uint64_t) limb * 10;
+            limb = (uint32_t) carry;
+            carry >>= 32;
+        }
+        if(carry) out.push_back((uint32_t) carry);
+    }
+    return out;
+}
+
+// a -= b, for a >= b
+static void Sub(Limbs& a, const Limbs& b)
+{
+    int64_t borrow = 0;
+    for(size_t i = 0; i < a.size(); i++) {
+        const int64_t cur = (int64_t) a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = cur < 0 ? 1 : 0;
+        a[i] = (uint32_t) (cur + (borrow << 32));
+    }
+}
+
+// a /= d, rounding down
+static void Div(Limbs& a, uint32_t d)
+{
+    uint64_t rem = 0;
+    for(size_t i = a.size(); i-- > 0; ) {
+        const uint64_t cur = (rem << 32) | a[i];
+        a[i] = (uint32_t) (cur / d);
+        rem = cur % d;
+    }
+}
+
+// the bits, most significant first & without leading zeros
+static std::vector<bool> Bits(const Limbs& a)
+{
+    std::vector<bool> bits;
+    for(size_t i = 32 * a.size(); i-- > 0; ) {
+        const bool bit = ((a[i / 32] >> (i % 32)) & 1) != 0;
+        if(bit || !bits.empty()) bits.push_back(bit);
+    }
+    return bits;
+}
+
+// g^e by square & multiply over the bits of e, out must not be g
+template<typename T>
+static void Pow(T& out, const T& g, const std::vector<bool>& bits)
+{
+    out = g;
+    for(size_t i = 1; i < bits.size(); i++) {
+        T::sqr(out,out);
+        if(bits[i]) T::mul(out,out,g);
+    }
+}
+
+// p - r, the trace of Frobenius less one (6u^2 on bn curves, half the bits of r)
+static std::vector<bool> TraceBits()
+{
+    std::string p, r;
+    Fp::getModulo(p);
+    Fr::getModulo(r);
+    Limbs e = Parse(p);
+    Sub(e,Parse(r));
+    return Bits(e);
+}
+
+/**
+ * xi^(k(p-1)/6) for k = 0..5
+ * Fp12 = Fp6[w]/(w^2 - v) & Fp6 = Fp2[v]/(v^3 - xi), so xi = w^6 is read off the tower
+ * itself; p = 1 mod 6 so (p-1)/6 is p/6 rounded down
+ * ------------------------------------------
+ */
+static std::vector<Fp2> FrobeniusGammas()
+{
+    Fp12 w, w2, w3, w6;
+    w.clear();
+    w.b.a = 1;
+    Fp12::sqr(w2,w);
+    Fp12::mul(w3,w2,w);
+    Fp12::sqr(w6,w3);
+    std::string dec;
+    Fp::getModulo(dec);
+    Limbs e = Parse(dec);
+    Div(e,6);
+    std::vector<Fp2> gammas(6);
+    gammas[0] = 1;
+    Pow(gammas[1],w6.a.a,Bits(e));
+    for(size_t k = 2; k < gammas.size(); k++) Fp2::mul(gammas[k],gammas[k-1],gammas[1]);
+    return gammas;
+}
+
+// (c w^k)^p = conj(c) xi^(k(p-1)/6) w^k
+static void Conjugate(Fp2& out, const Fp2& c, const Fp2& gamma)
+{
+    Fp2 conj;
+    conj.a = c.a;
+    Fp::neg(conj.b,c.b);
+    Fp2::mul(out,conj,gamma);
+}
+
+/**
+ * x^p, coefficient by coefficient: a = a.a + a.b w^2 + a.c w^4 & b = b.a w + b.b w^3 +
+ * b.c w^5
+ * ------------------------------------------
+ */
+static void Frobenius(Fp12& out, const Fp12& x)
+{
+    static const std::vector<Fp2> gamma = FrobeniusGammas();
+    Conjugate(out.a.a,x.a.a,gamma[0]);
+    Conjugate(out.a.b,x.a.b,gamma[2]);
+    Conjugate(out.a.c,x.a.c,gamma[4]);
+    Conjugate(out.b.a,x.b.a,gamma[1]);
+    Conjugate(out.b.b,x.b.b,gamma[3]);
+    Conjugate(out.b.c,x.b.c,gamma[5]);
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * SubgroupCheck
+ *-------------------------------------------------------------------------------------*/
+
+void SubgroupCheck::Clear()
+{
+    g1.clear();
+    g2.clear();
+    gt.clear();
+}
+
+bool SubgroupCheck::CheckG1() const
+{
+    for(const G1* el : g1) {
+        if(!el->isValid()) return false;
+    }
+    return true;
+}
+
+// the curve check & then the order check of mcl, which for G2 uses the endomorphism
+bool SubgroupCheck::CheckG2() const
+{
+    for(const G2* el : g2) {
+        if(!el->isValid() || !el->isValidOrder()) return false;
+    }
+    return true;
+}
+
+/**
+ * g^p = g^(p-r) holds exactly when g^r = 1: x^p is the Frobenius, a handful of Fp2
+ * products, & p - r has half the bits of r, so each element is checked exactly at about
+ * half the cost of raising it to r
+ * ------------------------------------------
+ */
+bool SubgroupCheck::CheckGt() const
+{
+    static const std::vector<bool> bits = TraceBits();
+    Fp12 frob, power;
+    for(const Fp12* el : gt) {
+        if(el->isZero()) return false;
+        STAT_COUNT(GT_POW,1);
+        Frobenius(frob,*el);
+        Pow(power,*el,bits);
+        if(frob != power) return false;
+    }
+    return true;
+}
+
+/**
+ * Check the queued elements one by one, G1 then G2 then Gt, stopping at the first
+ * element outside its group
+ * ------------------------------------------
+ */
+bool SubgroupCheck::Check()
+{
+    const bool ok = CheckG1() && CheckG2() && CheckGt();
+    Clear();
+    return ok;
+}
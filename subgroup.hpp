@@ -0,0 +1,54 @@
+#pragma once
+/**
+ * Group membership of untrusted elements
+ * decoding only puts points on their curve & Gt values on the torus, the checks here
+ * put them in the order r subgroups
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <vector>
+
+#include <mcl/bn256.hpp>
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * SubgroupCheck
+ * the queue only collects elements by address, Check then tests them one at a time:
+ * G1 of bn256 has cofactor 1 so a point on the curve is in the group, a G2 point has
+ * to pass isValid & isValidOrder of mcl & a Gt value g has to satisfy
+ * Frobenius(g) == g^(p-r). Every check is exact, an element outside its group is always
+ * rejected; random weights over a batch would let elements of small order through (2
+ * divides the torus order, 13 the G2 cofactor)
+ *-------------------------------------------------------------------------------------*/
+
+class SubgroupCheck {
+public:
+    void Add(const G1& el) { g1.push_back(&el); }
+    void Add(const G2& el) { g2.push_back(&el); }
+    void Add(const Fp12& el) { gt.push_back(&el); }
+
+    template<typename T>
+    void Add(const std::vector<T>& els) {
+        for(const T& el : els) Add(el);
+    }
+
+    // checks the queued elements one at a time, true when each is in its group; the
+    // queue is emptied either way
+    bool Check();
+    void Clear();
+private:
+    bool CheckG1() const;
+    bool CheckG2() const;
+    bool CheckGt() const;
+
+    std::vector<const G1*> g1;
+    std::vector<const G2*> g2;
+    std::vector<const Fp12*> gt;
+};
+
+}
@@ -45,4 +45,40 @@ TEST(BbTest,SigninG1)
     ASSERT_EQ(r,0); 
 }
 
+// Test batch verification
+TEST(BbTest,Batch) 
+{
+    Curve crv;
+    KeyPair<G2,G1> kp(crv.g2,crv.g1);
+    Fr sec;
+    sec.setRand();
+
+    std::vector<std::string> messages = {"one","two","three","four","five"};
+    std::vector<G1> sigs(messages.size()), doubles(messages.size());
+    for(size_t i = 0; i < messages.size(); i++) {
+        Sign(kp,messages[i],sigs[i]);
+        DoubleSign(kp,messages[i],sec,doubles[i]);
+    }
+
+    BatchVerifier<G2,G1> batch(crv.g2,crv.g1,kp.pub);
+    ASSERT_TRUE(batch.Verify());
+    for(size_t i = 0; i < messages.size(); i++) {
+        batch.Add(sigs[i],messages[i]);
+        batch.AddDouble(doubles[i],messages[i],sec);
+    }
+    ASSERT_EQ(batch.Size(),2 * messages.size());
+    ASSERT_TRUE(batch.Verify());
+
+    // one wrong message or secret fails the batch
+    BatchVerifier<G2,G1> bad(crv.g2,crv.g1,kp.pub);
+    for(size_t i = 0; i < messages.size(); i++) {
+        bad.Add(sigs[i],i == 2 ? "guilty" : messages[i]);
+    }
+    ASSERT_FALSE(bad.Verify());
+    BatchVerifier<G2,G1> nosec(crv.g2,crv.g1,kp.pub);
+    nosec.Add(sigs[0],messages[0]);
+    nosec.Add(doubles[1],messages[1]);
+    ASSERT_FALSE(nosec.Verify());
+}
+
 
@@ -5,12 +5,19 @@
  * written to be C++11 compliant, columnwidth = 90
  */
 
+#include <cstring>
 #include <iostream>
 #include <gtest/gtest.h>
 
 #include <mcl/bn256.hpp>
 
 #include <crypto.hpp>
+#include <fixedbase.hpp>
+#include <protocol.hpp>
+#include <rng.hpp>
+#include <subgroup.hpp>
+#include <torus.hpp>
+#include <transcript.hpp>
 
 using namespace philips;
 using namespace mcl::bn256;
@@ -53,3 +60,193 @@ TEST(Crypto,FiatShamir)
     ASSERT_NE(fsc,fsc3);
 }
 
+
+
+TEST(Crypto,ChaCha20) 
+{
+    // RFC 7539 2.3.2
+    const uint8_t keybytes[32] = {
+        0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31
+    };
+    uint32_t key[8];
+    for(size_t i = 0; i < 8; i++) {
+        key[i] = keybytes[4*i] | keybytes[4*i+1] << 8 | keybytes[4*i+2] << 16 | 
+            (uint32_t) keybytes[4*i+3] << 24;
+    }
+    const uint32_t nonce[3] = {0x09000000, 0x4a000000, 0};
+    const uint8_t expect[16] = {0x10,0xf1,0xe7,0xe4,0xd1,0x3b,0x59,0x15,0x50,0x0f,0xdd,0x1f,
+        0xa3,0x20,0x71,0xc4};
+    uint8_t out[64];
+    rng::ChaCha20Block(key,1,nonce,out);
+    ASSERT_EQ(memcmp(out,expect,16),0);
+}
+
+TEST(Crypto,Rng) 
+{
+    std::array<Fr,16> a, b;
+
+    // the OS keyed generator does not repeat
+    rng::Rand(a);
+    rng::Rand(b);
+    ASSERT_NE(a,b);
+
+    // a seeded run reproduces
+    rng::Seed("regression");
+    rng::Rand(a);
+    rng::Seed("regression");
+    rng::Rand(b);
+    ASSERT_EQ(a,b);
+    rng::Unseed();
+    ASSERT_FALSE(rng::Seeded());
+
+    // scoped seeds only affect the calling thread & restore the previous generator
+    {
+        rng::ScopedSeed seed("scope");
+        rng::Rand(a);
+    }
+    {
+        rng::ScopedSeed seed("scope");
+        rng::Rand(b);
+    }
+    ASSERT_EQ(a,b);
+    rng::Rand(b);
+    ASSERT_NE(a,b);
+}
+
+TEST(Crypto,Transcript) 
+{
+    G1 g1;
+    Fp12 e;
+    Fr c1, c2, d1, d2, x;
+    hashAndMapToG1(g1,"abc");
+    pairing(e,g1,Curve().g2);
+
+    Transcript t("test"), u("test"), w("test");
+    t.Absorb("g1",g1);
+    t.Absorb("e",e);
+    t.Challenge("first",c1);
+    t.Challenge("second",c2);
+    u.Absorb("g1",g1);
+    u.Absorb("e",e);
+    u.Challenge("first",d1);
+    u.Challenge("second",d2);
+    ASSERT_EQ(c1,d1);
+    ASSERT_EQ(c2,d2);
+    ASSERT_NE(c1,c2);
+
+    // labels separate otherwise equal input
+    w.Absorb("h1",g1);
+    w.Absorb("e",e);
+    w.Challenge("first",x);
+    ASSERT_NE(x,c1);
+}
+
+TEST(Crypto,Torus) 
+{
+    G1 g1;
+    Fp12 e, x, back;
+    Fr r;
+    char buf[Gt_compressed_size];
+    hashAndMapToG1(g1,"abc");
+    pairing(e,g1,Curve().g2);
+
+    for(size_t i = 0; i < 8; i++) {
+        rng::Rand(r);
+        Fp12::pow(x,e,r);
+        CompressGt(x,buf);
+        ASSERT_TRUE(DecompressGt(back,buf));
+        ASSERT_EQ(back,x);
+    }
+
+    // the identity is the zero coordinate
+    CompressGt(Fp12(1),buf);
+    ASSERT_TRUE(DecompressGt(back,buf));
+    ASSERT_TRUE(back.isOne());
+
+    // coefficients must be below p
+    memset(buf,0xff,sizeof(buf));
+    ASSERT_FALSE(DecompressGt(back,buf));
+}
+
+TEST(Crypto,Subgroup)
+{
+    G1 g1;
+    G2 g2;
+    Fr r;
+    hashAndMapToG1(g1,"abc");
+    hashAndMapToG2(g2,"abc");
+    std::vector<Fp12> gt(5);
+    std::vector<G2> keys(3);
+    for(size_t i = 0; i < gt.size(); i++) {
+        rng::Rand(r);
+        pairing(gt[i],g1,g2);
+        Fp12::pow(gt[i],gt[i],r);
+    }
+    for(G2& k : keys) {
+        rng::Rand(r);
+        G2::mul(k,g2,r);
+    }
+
+    SubgroupCheck check;
+    check.Add(g1);
+    check.Add(keys);
+    check.Add(gt);
+    ASSERT_TRUE(check.Check());
+    ASSERT_TRUE(check.Check()); // emptied
+
+    // a miller loop before its final exponentiation is not in Gt
+    Fp12 loop;
+    millerLoop(loop,g1,g2);
+    check.Add(gt);
+    check.Add(loop);
+    ASSERT_FALSE(check.Check());
+
+    // -g is on the torus with order 2r, alone or in pairs it is always rejected
+    Fp12 minus = 1;
+    Fp6::neg(minus.a,minus.a);
+    std::vector<Fp12> neg(2);
+    Fp12::mul(neg[0],gt[0],minus);
+    Fp12::mul(neg[1],gt[1],minus);
+    for(size_t i = 0; i < 16; i++) {
+        check.Add(gt);
+        check.Add(neg[0]);
+        ASSERT_FALSE(check.Check());
+        check.Add(neg);
+        ASSERT_FALSE(check.Check());
+    }
+    check.Add(minus);
+    ASSERT_FALSE(check.Check());
+}
+
+TEST(Crypto,FixedBase) 
+{
+    G1 g1;
+    Fp12 e, x, y;
+    Fr r;
+    hashAndMapToG1(g1,"abc");
+    pairing(e,g1,Curve().g2);
+
+    // every window size against the plain power, on random & edge exponents
+    for(size_t window : {0, 1, 3, 4, 5}) {
+        const GtFixedBase fixed(e,window);
+        ASSERT_EQ(fixed.Base(),e);
+        std::vector<Fr> exps = { Fr(0), Fr(1), Fr(8), Fr(9), Fr(255) };
+        Fr::neg(r,Fr(1));
+        exps.push_back(r);
+        for(size_t i = 0; i < 4; i++) {
+            rng::Rand(r);
+            exps.push_back(r);
+        }
+        for(const Fr& exp : exps) {
+            fixed.Pow(x,exp);
+            Fp12::pow(y,e,exp);
+            ASSERT_EQ(x,y);
+        }
+    }
+
+    // the default holds the identity
+    GtFixedBase one;
+    rng::Rand(r);
+    one.Pow(x,r);
+    ASSERT_TRUE(x.isOne());
+}
@@ -0,0 +1,196 @@
+/**
+ * Test the table codec & the local verification daemon
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <crypto.hpp>
+#include <protocol.hpp>
+#include <deid.hpp>
+#include <codec.hpp>
+#include <daemon.hpp>
+
+using namespace philips;
+
+static const std::vector<std::string> snips = {
+    "1       15850   .       G       T       .       .       .",
+    "1       396781  .       T       A       .       .       .",
+    "1       447872  .       A       T       .       .       .",
+    "1       539230  .       T       A       .       .       .",
+    "1       660507  .       A       C       .       .       .",
+    "1       666172  .       A       G       .       .       .",
+    "1       701549  .       G       A       .       .       ."
+};
+
+// issuer & sequencing lab shared by all tables of a test
+struct Issuers {
+    KeyPair kp;
+    BBKey bbk;
+    TrustLayer trust;
+
+    explicit Issuers(std::shared_ptr<const Protocol> p) : bbk(p->crv.g2,p->crv.g1) {
+        KeyGen(p->crv.g2,kp);
+        trust.pub = kp.pub;
+        trust.bbkeys = {bbk.pub};
+    }
+};
+
+// a prover holding a 2 row table, or 3 rows where the last duplicates the first
+static void SetupTable(std::shared_ptr<const Protocol> p, const Issuers& is,
+    std::unique_ptr<Prover>& prover, bool dup)
+{
+    std::array<std::string,MESSAGE_COUNT> record = {"a","b","c","d","e"};
+    std::vector<DeidRecord> records = { DeidRecord(is.kp,is.bbk,record,p,snips),
+        DeidRecord(is.kp,is.bbk,record,p,snips) };
+    prover.reset(new Prover(records,is.trust,p));
+
+    std::array<std::pair<size_t,std::vector<size_t>>,3> disclose;
+    disclose[0] = std::make_pair(0, std::vector<size_t>{1});
+    disclose[1] = std::make_pair(1, std::vector<size_t>{2});
+    disclose[2] = std::make_pair(0, std::vector<size_t>{3});
+    std::array<std::pair<size_t,std::vector<size_t>>,3> discsnips;
+    discsnips[0] = std::make_pair(0, std::vector<size_t>{3,6});
+    discsnips[1] = std::make_pair(1, std::vector<size_t>{4});
+    discsnips[2] = std::make_pair(0, std::vector<size_t>{});
+
+    NewTable("daemon phrase", *prover, disclose.data(), discsnips.data(), dup ? 3 : 2);
+}
+
+TEST(Codec,RoundTrip) {
+    auto p = std::make_shared<const Protocol>();
+    Issuers is(p);
+    std::unique_ptr<Prover> prover;
+    SetupTable(p,is,prover,false);
+
+    std::string bytes;
+    EncodeTable(bytes,prover->table->tablekey,prover->table->deidrows.data(),
+        prover->table->deidrows.size());
+
+    Table table;
+    const char* cur = bytes.data();
+    ASSERT_TRUE(DecodeTable(cur,bytes.data()+bytes.size(),table));
+    ASSERT_EQ(cur,bytes.data()+bytes.size());
+    ASSERT_EQ(table.deidrows.size(),2u);
+    ASSERT_EQ(table.deidrows[0].snips,prover->table->deidrows[0].snips);
+
+    Verifier verifier(is.trust,p);
+    ASSERT_TRUE(CheckTable(verifier,table.tablekey,table.deidrows.data(),2));
+
+    // the index slices the encoding at every row
+    G2 tablekey;
+    std::vector<size_t> offsets;
+    cur = bytes.data();
+    ASSERT_TRUE(IndexTable(cur,bytes.data()+bytes.size(),tablekey,offsets));
+    ASSERT_EQ(cur,bytes.data()+bytes.size());
+    ASSERT_EQ(offsets.size(),3u);
+    ASSERT_EQ(tablekey,prover->table->tablekey);
+    for(size_t i = 0; i < 2; i++) {
+        Row row;
+        cur = bytes.data() + offsets[i];
+        ASSERT_TRUE(DecodeRow(cur,bytes.data() + offsets[i+1],row));
+        ASSERT_EQ(cur,bytes.data() + offsets[i+1]);
+        ASSERT_EQ(row.snips,prover->table->deidrows[i].snips);
+    }
+
+    // from outside the group elements are checked too
+    cur = bytes.data();
+    ASSERT_TRUE(DecodeUntrustedTable(cur,bytes.data()+bytes.size(),table));
+    millerLoop(table.deidrows[1].proof.rowId,p->crv.g1,p->crv.g2);
+    ASSERT_FALSE(ValidateRows(table.tablekey,table.deidrows.data(),2));
+
+    // truncated input never decodes
+    cur = bytes.data();
+    ASSERT_FALSE(DecodeTable(cur,bytes.data()+bytes.size()-1,table));
+}
+
+TEST(Daemon,CheckTable) {
+    auto p = std::make_shared<const Protocol>();
+    Issuers is(p);
+    std::unique_ptr<Prover> good, bad;
+    SetupTable(p,is,good,false);
+
+    DaemonConfig cfg("/tmp/zkdeid_test_" + std::to_string(getpid()) + ".sock");
+    cfg.window_us = 500;
+    Daemon daemon(is.trust,p,cfg);
+    ASSERT_TRUE(daemon.Start());
+
+    DaemonClient client;
+    ASSERT_TRUE(client.Connect(cfg.path));
+    uint8_t status;
+    ASSERT_TRUE(client.CheckTable(good->table->tablekey,good->table->deidrows.data(),
+        good->table->deidrows.size(),status));
+    ASSERT_EQ(status,DAEMON_ACCEPT);
+
+    // duplicate rows are refused
+    SetupTable(p,is,bad,true);
+    ASSERT_TRUE(client.CheckTable(bad->table->tablekey,bad->table->deidrows.data(),
+        bad->table->deidrows.size(),status));
+    ASSERT_EQ(status,DAEMON_REJECT);
+
+    std::string stats;
+    ASSERT_TRUE(client.Stats(stats));
+    std::cout << stats;
+    ASSERT_NE(stats.find("requests 2"),std::string::npos);
+    ASSERT_EQ(daemon.Stats().rows,5u);
+
+    daemon.Stop();
+    ASSERT_FALSE(client.CheckTable(good->table->tablekey,good->table->deidrows.data(),
+        good->table->deidrows.size(),status) && status == DAEMON_ACCEPT);
+}
+
+TEST(Daemon,Batch) {
+    auto p = std::make_shared<const Protocol>();
+    Issuers is(p);
+    const size_t n = 8;
+    std::vector<std::unique_ptr<Prover>> tables(n + 1);
+    for(size_t i = 0; i < n; i++) SetupTable(p,is,tables[i],false);
+    SetupTable(p,is,tables[n],true);
+
+    DaemonConfig cfg("/tmp/zkdeid_test_" + std::to_string(getpid()) + ".sock");
+    cfg.window_us = 1000;
+    Daemon daemon(is.trust,p,cfg);
+    ASSERT_TRUE(daemon.Start());
+    std::vector<DaemonClient> clients(n + 1);
+    for(DaemonClient& c : clients) ASSERT_TRUE(c.Connect(cfg.path));
+    std::vector<uint8_t> status(n + 1,DAEMON_UNAVAILABLE);
+    auto check = [&](size_t i) {
+        const Table& t = *tables[i]->table;
+        if(!clients[i].CheckTable(t.tablekey,t.deidrows.data(),t.deidrows.size(),
+            status[i])) status[i] = DAEMON_UNAVAILABLE;
+    };
+
+    // one after another every table is a batch of its own
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < n; i++) check(i);
+    const double sequential = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for(size_t i = 0; i < n; i++) ASSERT_EQ(status[i],DAEMON_ACCEPT);
+
+    // all at once they share the window, one TableContext & the workers
+    std::fill(status.begin(),status.end(),DAEMON_UNAVAILABLE);
+    start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < n; i++) threads.push_back(std::thread(check,i));
+    for(std::thread& t : threads) t.join();
+    const double batched = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for(size_t i = 0; i < n; i++) ASSERT_EQ(status[i],DAEMON_ACCEPT);
+    std::cout << "sequential " << sequential << "s, batched " << batched << "s\n";
+    ASSERT_LT(batched,sequential);
+    ASSERT_LT(daemon.Stats().batches,2 * n);
+
+    // a bad table in a batch is rejected alone
+    threads.clear();
+    for(size_t i : {(size_t) 0,n}) threads.push_back(std::thread(check,i));
+    for(std::thread& t : threads) t.join();
+    ASSERT_EQ(status[0],DAEMON_ACCEPT);
+    ASSERT_EQ(status[n],DAEMON_REJECT);
+}
@@ -5,15 +5,112 @@
  * written to be C++11 compliant, columnwidth = 90
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <new>
+#include <thread>
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
 #include <crypto.hpp>
 #include <protocol.hpp>
 #include <deid.hpp>
+#include <stats.hpp>
+#include <cost.hpp>
+#include <codec.hpp>
+#include <checkpoint.hpp>
+#include <cache.hpp>
+#include <shard.hpp>
 
 using namespace philips;
 
+// every allocation of the test binary is counted, so a test can check a path makes none
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t n)
+{
+    allocations++;
+    void* p = malloc(n > 0 ? n : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// the allocations f makes
+static size_t Allocations(const std::function<void()>& f)
+{
+    const size_t before = allocations.load();
+    f();
+    return allocations.load() - before;
+}
+
+// the snips records are signed on, tests take the first few
+static const std::vector<std::string> SNIPS = {
+    "1       15850   .       G       T       .       .       .",
+    "1       396781  .       T       A       .       .       .",
+    "1       447872  .       A       T       .       .       .",
+    "1       539230  .       T       A       .       .       .",
+    "1       660507  .       A       C       .       .       .",
+    "1       666172  .       A       G       .       .       .",
+    "1       701549  .       G       A       .       .       .",
+    "1       708702  .       T       G       .       .       .",
+    "1       943484  .       T       C       .       .       ."
+};
+
+/**
+ * The setup most tests share: issuer kp & snip key bbk as the trust layer, records all
+ * signed on the same messages & the first snipcount SNIPS, a prover & a verifier over
+ * them; kp2 is a spare key whose pub serves as a tablekey
+ * ------------------------------------------
+ */
+struct Cohort {
+    std::shared_ptr<const Protocol> p;
+    KeyPair kp, kp2;
+    BBKey bbk;
+    TrustLayer trust;
+    std::vector<std::string> snips;
+    std::vector<DeidRecord> records;
+    Prover prover;
+    Verifier verifier;
+
+    Cohort(size_t recordcount, size_t snipcount) : p(std::make_shared<const Protocol>()),
+        kp(NewKey(*p)), kp2(NewKey(*p)), bbk(p->crv.g2,p->crv.g1), trust(NewTrust()),
+        snips(SNIPS.begin(),SNIPS.begin() + snipcount), records(SignRecords(recordcount)),
+        prover(records,trust,p), verifier(trust,p) {}
+
+    static KeyPair NewKey(const Protocol& p) {
+        KeyPair kp;
+        KeyGen(p.crv.g2,kp);
+        return kp;
+    }
+
+    TrustLayer NewTrust() const {
+        TrustLayer t;
+        t.pub = kp.pub;
+        t.bbkeys = {bbk.pub};
+        return t;
+    }
+
+    std::vector<DeidRecord> SignRecords(size_t n) const {
+        const std::array<std::string,MESSAGE_COUNT> record = {"a","b","c","d","e"};
+        std::vector<DeidRecord> out;
+        for(size_t i = 0; i < n; i++) out.push_back(DeidRecord(kp,bbk,record,p,snips));
+        return out;
+    }
+};
+
 // Test signatures
 TEST(DeidTest,Sign) {
 
@@ -39,6 +136,43 @@ TEST(DeidTest,Sign) {
 }
 
 
+// Test batch verification of the signatures of a cohort
+TEST(DeidTest,BatchRecords) {
+    Cohort c(0,2);
+    const KeyPair other = Cohort::NewKey(*c.p);
+    std::vector<DeidRecord> records;
+    for(size_t i = 0; i < 6; i++) {
+        std::array<std::string,MESSAGE_COUNT> record = {"a","b","c","d",std::to_string(i)};
+        records.push_back(DeidRecord(c.kp,c.bbk,record,c.p,c.snips));
+    }
+    stats::Snapshot before = stats::Take();
+    ASSERT_TRUE(VerifyRecords(c.trust,c.p,records.data(),records.size()));
+    if(stats::Enabled()) {
+        ASSERT_EQ(stats::Take().Since(before).counters[stats::PAIRING],4u);
+    }
+    ASSERT_TRUE(VerifyRecords(c.trust,c.p,records.data(),0));
+
+    // any bad signature fails the batch
+    std::vector<DeidRecord> bad = records;
+    bad[3].record[2] = "x";
+    ASSERT_FALSE(VerifyRecords(c.trust,c.p,bad.data(),bad.size()));
+    bad = records;
+    bad[5].snips[1].second = bad[5].snips[0].second;
+    ASSERT_FALSE(VerifyRecords(c.trust,c.p,bad.data(),bad.size()));
+    bad = records;
+    std::swap(bad[0].sig,bad[1].sig);
+    ASSERT_FALSE(VerifyRecords(c.trust,c.p,bad.data(),bad.size()));
+    bad = records;
+    bad[2] = DeidRecord(other,c.bbk,bad[2].record,c.p,c.snips);
+    ASSERT_FALSE(VerifyRecords(c.trust,c.p,bad.data(),bad.size()));
+
+    // snips need a bb key
+    TrustLayer nobb;
+    nobb.pub = c.kp.pub;
+    ASSERT_FALSE(VerifyRecords(nobb,c.p,records.data(),records.size()));
+}
+
+
 // Test Proofs
 TEST(DeidTest,Prove) {
 
@@ -86,6 +220,23 @@ TEST(DeidTest,Prove) {
         { "1       396781  .       T       A       .       .       ." };
     result = VerifyProof(zkp,kp2.pub,disclsnip,disclose,verifier);
     ASSERT_EQ(result,1);
+
+    // rows are verified straight from views, once the thread & the keys of the table
+    // context are warm nothing is copied or looked up: a check allocates nothing
+    TableContext table(*p,kp2.pub);
+    table.AddKeys(verifier,zkp.issuer,zkp.bbkey,true);
+    ASSERT_TRUE(VerifyProof(zkp,table,disclsnip,disclose,verifier));
+    ASSERT_EQ(Allocations([&]{
+        EXPECT_TRUE(VerifyProof(zkp,table,disclsnip,disclose,verifier));
+    }),0u);
+
+    // disclosed values in any order, from a plain array
+    NewZkProof({3,1},{},kp2.pub,drec,deserial,prover);
+    const ZkProof reordered = (ZkProof) deserial;
+    const std::pair<std::string,size_t> values[2] = {{"d",3},{"b",1}};
+    ASSERT_EQ(Allocations([&]{
+        EXPECT_TRUE(VerifyProof(reordered,table,{},DisclosedView(values,2),verifier));
+    }),0u);
 }
 
 TEST(DeidTest,Table) {
@@ -114,7 +265,8 @@ TEST(DeidTest,Table) {
     DeidRecord drec = DeidRecord(kp,bbk,record,p,snips); // Signed by trusted source
     DeidRecord drec2 = DeidRecord(kp,bbk,record,p,snips); // Signed by trusted source
     DeidRecord drec3 = DeidRecord(kp,bbk,record,p,snips); // Signed by trusted source
-    std::vector<DeidRecord> records = { drec, drec2, drec3 };
+    DeidRecord drec4 = DeidRecord(kp,bbk,record,p,snips); // Signed by trusted source
+    std::vector<DeidRecord> records = { drec, drec2, drec3, drec4 };
 
     // Create a prover  & Verifier
     Prover prover = Prover(records,trust,p); 
@@ -141,6 +293,52 @@ TEST(DeidTest,Table) {
     result = CheckTable(verifier,prover.table->tablekey,prover.table->deidrows.data(),3);
     ASSERT_EQ(result,true);
 
+    // a new table is proved into the rows & knowledge of the last one
+    const Row* rows = prover.table->deidrows.data();
+    const G1* siv = prover.table->deidrows[2].proof.SiV.data();
+    const Fr* blinds = (*prover.knowledge)[2].second.snipblinds.data();
+    NewTable("rebuilt phrase", prover, disclose.data(), discsnips.data(), 3);
+    ASSERT_EQ(prover.table->deidrows.data(),rows);
+    ASSERT_EQ(prover.table->deidrows[2].proof.SiV.data(),siv);
+    ASSERT_EQ((*prover.knowledge)[2].second.snipblinds.data(),blinds);
+    result = CheckTable(verifier,prover.table->tablekey,prover.table->deidrows.data(),3);
+    ASSERT_EQ(result,true);
+
+    // the table context & its keys are per call, the rows then allocate nothing, when
+    // proving or when checking them; both tables are big enough for a rowbase table
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose4, discsnips4;
+    std::copy(disclose.begin(),disclose.end(),disclose4.begin());
+    std::copy(discsnips.begin(),discsnips.end(),discsnips4.begin());
+    disclose4[3] = std::make_pair(3, discl2);
+    discsnips4[3] = std::make_pair(3, sdiscl2);
+    NewTable("counted phrase", prover, disclose4.data(), discsnips4.data(), 4);
+    const size_t four = Allocations([&]{
+        NewTable("counted phrase", prover, disclose4.data(), discsnips4.data(), 4);
+    });
+    const Row* counted = prover.table->deidrows.data();
+    ASSERT_TRUE(CheckTable(verifier,prover.table->tablekey,counted,4));
+    const size_t checkfour = Allocations([&]{
+        EXPECT_TRUE(CheckTable(verifier,prover.table->tablekey,counted,4));
+    });
+    const size_t checkthree = Allocations([&]{
+        EXPECT_TRUE(CheckTable(verifier,prover.table->tablekey,counted,3));
+    });
+    const size_t three = Allocations([&]{
+        NewTable("counted phrase", prover, disclose.data(), discsnips.data(), 3);
+    });
+    ASSERT_EQ(three,four);
+    ASSERT_EQ(checkthree,checkfour);
+    ASSERT_EQ(prover.table->deidrows.size(),3u);
+
+    // requests out of range prove nothing
+    std::array<std::pair<size_t,std::vector<size_t>>,3> bad = disclose;
+    bad[1].second = {MESSAGE_COUNT};
+    NewTable("bad phrase", prover, bad.data(), discsnips.data(), 3);
+    ASSERT_TRUE(prover.table->deidrows.empty());
+    bad = discsnips;
+    bad[1].second = {snips.size()};
+    ASSERT_FALSE(AppendRows(prover, disclose.data(), bad.data(), 3));
+
     // refuse duplicates
     disclose[2] = disclose[1];
     NewTable("another phrase", prover, disclose.data(), discsnips.data(), 3);
@@ -148,3 +346,648 @@ TEST(DeidTest,Table) {
     ASSERT_EQ(result,false);
 }
 
+
+// Test that each kind of bad row is rejected by the check meant for it
+TEST(DeidTest,RejectReasons) {
+    Cohort c(3,2);
+    std::array<std::pair<size_t,std::vector<size_t>>,3> disclose, discsnips;
+    for(size_t i = 0; i < 3; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{1});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0,1});
+    }
+    NewTable("reasons phrase", c.prover, disclose.data(), discsnips.data(), 3);
+    const G2& tablekey = c.prover.table->tablekey;
+
+    TableStatus status;
+    ASSERT_TRUE(CheckTable(c.verifier,tablekey,c.prover.table->deidrows.data(),3,nullptr,
+        &status));
+    ASSERT_EQ(status.status,VERIFY_OK);
+
+    // the reason & the row of a table with one bad last row
+    auto reject = [&](std::function<void(Row&)> spoil) {
+        std::vector<Row> rows = c.prover.table->deidrows;
+        spoil(rows[2]);
+        TableStatus s;
+        EXPECT_FALSE(CheckTable(c.verifier,tablekey,rows.data(),3,nullptr,&s));
+        EXPECT_EQ(s.row,2u);
+        return s.status;
+    };
+    const std::vector<Row>& good = c.prover.table->deidrows;
+    auto bump = [](Fr& x) { Fr::add(x,x,Fr(1)); };
+    stats::Snapshot before = stats::Take();
+    ASSERT_EQ(reject([](Row& r){ r.snips.pop_back(); }),VERIFY_SHAPE);
+    ASSERT_EQ(reject([](Row& r){ r.proof.snip_response.pop_back(); }),VERIFY_SHAPE);
+    ASSERT_EQ(reject([](Row& r){ r.disclosed[0].second = MESSAGE_COUNT; }),
+        VERIFY_DISCLOSED);
+    ASSERT_EQ(reject([](Row& r){ r.disclosed.push_back(r.disclosed[0]); }),
+        VERIFY_DISCLOSED);
+    ASSERT_EQ(reject([&](Row& r){ r.proof.rowId = good[0].proof.rowId; }),
+        VERIFY_DUPLICATE_ROW);
+    if(stats::Enabled()) {
+        ASSERT_EQ(stats::Take().Since(before).counters[stats::PAIRING],0u);
+    }
+    ASSERT_EQ(reject([&](Row& r){ bump(r.proof.response[0]); }),VERIFY_COMMITMENT);
+    ASSERT_EQ(reject([&](Row& r){ bump(r.proof.snip_response[1]); }),VERIFY_SNIP_SECRET);
+    ASSERT_EQ(reject([&](Row& r){ bump(r.proof.row_response[0]); }),VERIFY_ROW);
+    ASSERT_EQ(reject([&](Row& r){ bump(r.proof.response[6]); }),VERIFY_SIGNATURE);
+    ASSERT_EQ(reject([&](Row& r){ bump(r.proof.snip_response[3]); }),VERIFY_SNIPS);
+
+    // the challenge form can only tell at the end
+    CompactRow compact;
+    compact.disclosed = good[0].disclosed;
+    compact.snips = good[0].snips;
+    ZkProofKnowledge knowledge;
+    NewZkProof({1},{0,1},tablekey,c.records[0],knowledge,c.prover);
+    CompactProof(knowledge,compact.proof);
+    bump(compact.proof.response[6]);
+    ASSERT_FALSE(CheckTable(c.verifier,tablekey,&compact,1,&status));
+    ASSERT_EQ(status.status,VERIFY_CHALLENGE);
+    ASSERT_STREQ(StatusName(VERIFY_CHALLENGE),"challenge");
+}
+
+
+// Test one verifier & one table context serving several threads
+TEST(DeidTest,SharedVerifier) {
+    Cohort c(4,2);
+    const Verifier& verifier = c.verifier;
+
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose, discsnips;
+    for(size_t i = 0; i < 4; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{0});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{1});
+    }
+    NewTable("shared phrase", c.prover, disclose.data(), discsnips.data(), 4);
+    const std::vector<Row>& rows = c.prover.table->deidrows;
+    const TableContext context(*c.p,c.prover.table->tablekey);
+
+    // every thread checks every row, then a tampered one
+    std::vector<char> ok(4,0);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&,t]{
+            bool all = true;
+            for(size_t n = 0; n < rows.size(); n++) {
+                const Row& r = rows[(n + t) % rows.size()];
+                std::vector<std::pair<std::string,size_t>> disclosed = r.disclosed;
+                all = all && VerifyProof(r.proof,context,r.snips,disclosed,verifier);
+            }
+            ZkProof bad = rows[t].proof;
+            bad.rowId = rows[(t + 1) % rows.size()].proof.rowId;
+            std::vector<std::pair<std::string,size_t>> disclosed = rows[t].disclosed;
+            ok[t] = all && !VerifyProof(bad,context,rows[t].snips,disclosed,verifier);
+        }));
+    }
+    for(std::thread& t : threads) t.join();
+    for(char o : ok) ASSERT_TRUE(o);
+}
+
+
+// Test one table with rows from two issuers under two snip keys
+TEST(DeidTest,MultiIssuer) {
+    Cohort c(0,2);
+    BBKey bbk2(c.p->crv.g2,c.p->crv.g1);
+    c.trust.issuers = {c.kp2.pub};
+    c.trust.bbkeys.push_back(bbk2.pub);
+
+    std::array<std::string,MESSAGE_COUNT> record = {"a","b","c","d","e"};
+    std::vector<DeidRecord> records;
+    for(size_t i = 0; i < 4; i++) {
+        const bool second = i % 2 == 1;
+        records.push_back(DeidRecord(second ? c.kp2 : c.kp,second ? bbk2 : c.bbk,record,
+            c.p,c.snips));
+        records.back().issuer = second ? 1 : 0;
+        records.back().bbkey = second ? 1 : 0;
+    }
+    ASSERT_TRUE(VerifyRecords(c.trust,c.p,records.data(),records.size()));
+
+    Prover prover = Prover(records,c.trust,c.p);
+    Verifier verifier = Verifier(c.trust,c.p);
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose, discsnips;
+    for(size_t i = 0; i < 4; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{1});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0,1});
+    }
+    NewTable("issuers phrase", prover, disclose.data(), discsnips.data(), 4);
+    const G2 tablekey = prover.table->tablekey;
+    std::vector<Row> rows = prover.table->deidrows;
+    ASSERT_EQ(rows.size(),4u);
+    ASSERT_EQ(rows[1].proof.issuer,1u);
+    ASSERT_TRUE(CheckTable(verifier,tablekey,rows.data(),4));
+    ASSERT_EQ(verifier.keys->Size(),2u);
+
+    // in challenge form the rows keep their keys
+    std::vector<CompactRow> compact(4);
+    for(size_t i = 0; i < 4; i++) {
+        compact[i].disclosed = rows[i].disclosed;
+        compact[i].snips = rows[i].snips;
+        CompactProof((*prover.knowledge)[i].second,compact[i].proof);
+    }
+    ASSERT_EQ(compact[1].proof.issuer,1u);
+    ASSERT_EQ(compact[1].proof.bbkey,1u);
+    ASSERT_TRUE(VerifyChallengeProof(compact[1].proof,tablekey,compact[1].snips,
+        compact[1].disclosed,verifier));
+    ASSERT_TRUE(CheckTable(verifier,tablekey,compact.data(),4));
+
+    // a row claiming the other issuer or an unknown key
+    std::vector<Row> bad = rows;
+    bad[3].proof.issuer = 0;
+    ASSERT_FALSE(CheckTable(verifier,tablekey,bad.data(),4));
+    bad = rows;
+    bad[3].proof.bbkey = 2;
+    TableStatus status;
+    ASSERT_FALSE(CheckTable(verifier,tablekey,bad.data(),4,nullptr,&status));
+    ASSERT_EQ(status.status,VERIFY_KEY);
+    ASSERT_EQ(status.row,3u);
+
+    // a verifier or prover without the second issuer
+    TrustLayer one = c.trust;
+    one.issuers.clear();
+    ASSERT_FALSE(CheckTable(Verifier(one,c.p),tablekey,rows.data(),4));
+    ASSERT_FALSE(VerifyRecords(one,c.p,records.data(),records.size()));
+    Prover lone = Prover(records,one,c.p);
+    lone.table.reset(new Table(0,"lone phrase"));
+    ASSERT_FALSE(AppendRows(lone,disclose.data(),discsnips.data(),4));
+    ASSERT_TRUE(lone.table->deidrows.empty());
+
+    // aggregated snips go through the line tables of each snip key
+    prover.aggregate_snips = true;
+    NewTable("aggregated phrase", prover, disclose.data(), discsnips.data(), 4);
+    ASSERT_TRUE(CheckTable(verifier,prover.table->tablekey,
+        prover.table->deidrows.data(),4));
+    ASSERT_EQ(verifier.keys->Size(),4u);
+}
+
+
+// Test a table whose proof randomness is derived instead of kept
+TEST(DeidTest,DerivedNonces) {
+    Cohort c(2,3);
+    c.prover.nonce_secret = "prover secret";
+
+    std::array<std::pair<size_t,std::vector<size_t>>,2> disclose = {{ 
+        std::make_pair(0,std::vector<size_t>{1}), 
+        std::make_pair(1,std::vector<size_t>{0,2}) }};
+    std::array<std::pair<size_t,std::vector<size_t>>,2> discsnips = {{ 
+        std::make_pair(0,std::vector<size_t>{0,2}), 
+        std::make_pair(1,std::vector<size_t>{1}) }};
+    NewTable("derived phrase", c.prover, disclose.data(), discsnips.data(), 2);
+    ASSERT_FALSE(c.prover.knowledge);
+    ASSERT_TRUE(CheckTable(c.verifier,c.prover.table->tablekey,
+        c.prover.table->deidrows.data(),2));
+    const Row first = c.prover.table->deidrows[1];
+
+    // the knowledge of a row comes back on demand
+    ZkProofKnowledge knowledge;
+    ASSERT_TRUE(RowKnowledge(c.prover,1,disclose[1],discsnips[1],knowledge));
+    CompactRow compact;
+    compact.disclosed = first.disclosed;
+    compact.snips = first.snips;
+    CompactProof(knowledge,compact.proof);
+    ASSERT_TRUE(VerifyChallengeProof(compact.proof,c.prover.table->tablekey,compact.snips,
+        compact.disclosed,c.verifier));
+    ASSERT_FALSE(RowKnowledge(c.prover,1,disclose[0],discsnips[1],knowledge));
+    ASSERT_FALSE(RowKnowledge(c.prover,2,disclose[1],discsnips[1],knowledge));
+
+    // every public field has to match, not just the leading commitments
+    Row& emitted = c.prover.table->deidrows[1];
+    emitted.proof.rowId = c.prover.table->deidrows[0].proof.rowId;
+    ASSERT_FALSE(RowKnowledge(c.prover,1,disclose[1],discsnips[1],knowledge));
+    emitted = first;
+    Fr::add(emitted.proof.snip_response[2],emitted.proof.snip_response[2],Fr(1));
+    ASSERT_FALSE(RowKnowledge(c.prover,1,disclose[1],discsnips[1],knowledge));
+    emitted = first;
+    ASSERT_TRUE(RowKnowledge(c.prover,1,disclose[1],discsnips[1],knowledge));
+
+    // same secret & table, same rows, another secret changes every nonce
+    NewTable("derived phrase", c.prover, disclose.data(), discsnips.data(), 2);
+    ASSERT_EQ(c.prover.table->deidrows[1].proof.cmtA,first.proof.cmtA);
+    ASSERT_EQ(c.prover.table->deidrows[1].proof.cmtPf3,first.proof.cmtPf3);
+    c.prover.nonce_secret = "another secret";
+    NewTable("derived phrase", c.prover, disclose.data(), discsnips.data(), 2);
+    ASSERT_NE(c.prover.table->deidrows[1].proof.cmtA,first.proof.cmtA);
+
+    // so does another disclosed snip under the same sigma
+    c.prover.nonce_secret = "prover secret";
+    c.prover.drecords[1].snips[1].first = SNIPS[8];
+    NewTable("derived phrase", c.prover, disclose.data(), discsnips.data(), 2);
+    const ZkProof& moved = c.prover.table->deidrows[1].proof;
+    ASSERT_NE(moved.cmtSnip[0],first.proof.cmtSnip[0]);
+    ASSERT_NE(moved.SiV[0],first.proof.SiV[0]);
+}
+
+// Test verifying only the rows appended since a checkpoint
+TEST(DeidTest,AppendCheckpoint) {
+    Cohort c(4,2);
+
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose, discsnips;
+    for(size_t i = 0; i < 4; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{1});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0});
+    }
+    NewTable("growing phrase", c.prover, disclose.data(), discsnips.data(), 2);
+    TableCheckpoint cp(c.prover.table->tablekey);
+    ASSERT_TRUE(CheckAppend(c.verifier,cp,c.prover.table->deidrows.data(),2));
+
+    // a persisted checkpoint takes the next rows only
+    ASSERT_TRUE(AppendRows(c.prover,disclose.data() + 2,discsnips.data() + 2,1));
+    ASSERT_EQ(c.prover.table->deidrows.size(),3u);
+    std::string bytes;
+    EncodeCheckpoint(bytes,cp);
+    const char* cur = bytes.data();
+    TableCheckpoint back;
+    ASSERT_TRUE(DecodeCheckpoint(cur,bytes.data() + bytes.size(),back));
+    ASSERT_EQ(back.rows.Root(),cp.rows.Root());
+    ASSERT_TRUE(CheckAppend(c.verifier,back,c.prover.table->deidrows.data() + 2,1));
+    ASSERT_EQ(back.rows.Count(),3u);
+
+    // the root is the RFC 6962 tree hash of the rows
+    const std::vector<Row>& rows = c.prover.table->deidrows;
+    Digest expect = MerkleFrontier::Node(MerkleFrontier::Node(RowLeaf(rows[0]),
+        RowLeaf(rows[1])),RowLeaf(rows[2]));
+    ASSERT_EQ(back.rows.Root(),expect);
+
+    // a rowId already in the checkpoint is refused & leaves it untouched
+    ASSERT_TRUE(AppendRows(c.prover,disclose.data() + 1,discsnips.data() + 1,1));
+    ASSERT_FALSE(CheckAppend(c.verifier,back,c.prover.table->deidrows.data() + 3,1));
+    ASSERT_EQ(back.rows.Root(),expect);
+    ASSERT_EQ(back.ids.size(),3u);
+}
+
+// Test the sampling audit against its reported guarantee
+TEST(DeidTest,SampleAudit) {
+    Cohort c(4,1);
+
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose, discsnips;
+    for(size_t i = 0; i < 4; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{0});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0});
+    }
+    NewTable("audit phrase", c.prover, disclose.data(), discsnips.data(), 4);
+    Row* rows = c.prover.table->deidrows.data();
+    const G2& tablekey = c.prover.table->tablekey;
+
+    // half the rows bad is caught by one row with probability 1/2, by two with 5/6
+    SampleReport report;
+    ASSERT_TRUE(SampleCheckTable(c.verifier,tablekey,rows,4,"seed",0.8,0.5,report));
+    ASSERT_EQ(report.sampled,2u);
+    ASSERT_TRUE(report.unique);
+    ASSERT_NEAR(report.confidence,5.0 / 6,1e-9);
+    ASSERT_TRUE(SampleCheckTable(c.verifier,tablekey,rows,4,"seed",0.99,0.01,report));
+    ASSERT_EQ(report.sampled,4u);
+    ASSERT_EQ(report.confidence,1.0);
+
+    // the seed is committed under a fresh nonce & the report names the rows audited
+    const SampleReport first = report;
+    ASSERT_TRUE(SampleCheckTable(c.verifier,tablekey,rows,4,"seed",0.99,0.01,report));
+    ASSERT_NE(report.nonce,first.nonce);
+    ASSERT_NE(report.commitment,first.commitment);
+    std::array<uint8_t,32> opened;
+    CommitSeed("seed",report.nonce,opened);
+    ASSERT_EQ(opened,report.commitment);
+    MerkleFrontier leaves;
+    for(size_t i = 0; i < 4; i++) leaves.Append(RowLeaf(rows[i]));
+    ASSERT_EQ(report.rows,leaves.Root());
+
+    // a bad row is found once the sample covers everything
+    rows[2].disclosed[0].first = "z";
+    ASSERT_FALSE(SampleCheckTable(c.verifier,tablekey,rows,4,"seed",1,0.25,report));
+    ASSERT_TRUE(report.unique);
+    ASSERT_FALSE(report.passed);
+    ASSERT_NE(report.rows,first.rows);
+
+    // duplicates fail before any row is verified
+    rows[3] = rows[1];
+    ASSERT_FALSE(SampleCheckTable(c.verifier,tablekey,rows,4,"seed",0.5,0.5,report));
+    ASSERT_FALSE(report.unique);
+    ASSERT_EQ(report.sampled,0u);
+}
+
+// Test skipping rows that were verified before under the same parameters
+TEST(DeidTest,VerifyCache) {
+    Cohort c(3,1);
+
+    std::array<std::pair<size_t,std::vector<size_t>>,3> disclose, discsnips;
+    for(size_t i = 0; i < 3; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{0});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0});
+    }
+    NewTable("cached phrase", c.prover, disclose.data(), discsnips.data(), 3);
+    Row* rows = c.prover.table->deidrows.data();
+    const G2& tablekey = c.prover.table->tablekey;
+
+    VerifyCache cache(8);
+    ASSERT_TRUE(CheckTable(c.verifier,tablekey,rows,3,&cache));
+    ASSERT_EQ(cache.Size(),3u);
+    stats::Snapshot before = stats::Take();
+    ASSERT_TRUE(CheckTable(c.verifier,tablekey,rows,3,&cache));
+    ASSERT_EQ(stats::Take().Since(before).counters[stats::PAIRING],0u);
+
+    // other parameters or another row are misses
+    const Digest context = CacheContext(c.verifier,tablekey);
+    ASSERT_TRUE(cache.Contains(CacheKey(context,rows[1])));
+    G2 other;
+    hashAndMapToG2(other,"other phrase");
+    ASSERT_FALSE(cache.Contains(CacheKey(CacheContext(c.verifier,other),rows[1])));
+    Row changed = rows[1];
+    changed.disclosed[0].first = "z";
+    ASSERT_FALSE(cache.Contains(CacheKey(context,changed)));
+    ASSERT_FALSE(CheckTable(c.verifier,tablekey,&changed,1,&cache));
+
+    // persisted, bounded by the least recently used
+    const std::string path = "/tmp/zkdeid_cache_" + std::to_string(getpid()) + ".bin";
+    ASSERT_TRUE(cache.Contains(CacheKey(context,rows[0])));
+    ASSERT_TRUE(cache.Save(path));
+    VerifyCache small(2);
+    ASSERT_TRUE(small.Load(path));
+    ASSERT_EQ(small.Size(),2u);
+    ASSERT_TRUE(small.Contains(CacheKey(context,rows[0])));
+    ASSERT_FALSE(small.Contains(CacheKey(context,rows[2])));
+
+    // a truncated file adds nothing
+    std::string bytes;
+    {
+        std::ifstream in(path,std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in),std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream out(path,std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(),bytes.size() - 1);
+    }
+    VerifyCache cut(8);
+    ASSERT_FALSE(cut.Load(path));
+    ASSERT_EQ(cut.Size(),0u);
+    std::remove(path.c_str());
+}
+
+// Test verifying an encoded table with worker processes
+TEST(DeidTest,ShardedCheck) {
+    Cohort c(4,1);
+    TrustLayer other = c.trust;
+    other.pub = c.kp2.pub;
+
+    std::array<std::pair<size_t,std::vector<size_t>>,4> disclose, discsnips;
+    for(size_t i = 0; i < 4; i++) {
+        disclose[i] = std::make_pair(i,std::vector<size_t>{0});
+        discsnips[i] = std::make_pair(i,std::vector<size_t>{0});
+    }
+    NewTable("sharded phrase", c.prover, disclose.data(), discsnips.data(), 4);
+    std::vector<Row>& rows = c.prover.table->deidrows;
+    std::string bytes;
+    EncodeTable(bytes,c.prover.table->tablekey,rows.data(),4);
+    ASSERT_TRUE(ShardedCheckTable(c.verifier,bytes,1));
+    ASSERT_TRUE(ShardedCheckTable(c.verifier,bytes,3));
+
+    // a duplicate across shards & a bad row are found
+    std::string dup;
+    rows[3] = rows[0];
+    EncodeTable(dup,c.prover.table->tablekey,rows.data(),4);
+    ASSERT_FALSE(ShardedCheckTable(c.verifier,dup,2));
+    std::string bad;
+    rows[3].disclosed[0].first = "z";
+    EncodeTable(bad,c.prover.table->tablekey,rows.data() + 1,3);
+    ASSERT_FALSE(ShardedCheckTable(c.verifier,bad,3));
+
+    // shards by hand, with the precomputation from a file
+    std::unique_ptr<Verifier> mapped;
+    const std::string path = "/tmp/zkdeid_pre_" + std::to_string(getpid()) + ".bin";
+    ASSERT_TRUE(WritePrecompute(path,c.verifier));
+    ASSERT_FALSE(ReadPrecompute(path,other,c.p,mapped));
+    ASSERT_TRUE(ReadPrecompute(path,c.trust,c.p,mapped));
+
+    // the digest covers every pairing & the whole c.trust layer, not just the c.trust key
+    TrustLayer more = c.trust;
+    more.bbkeys.push_back(c.bbk.pub);
+    ASSERT_FALSE(ReadPrecompute(path,more,c.p,mapped));
+    std::string file;
+    {
+        std::ifstream in(path,std::ios::binary);
+        file.assign(std::istreambuf_iterator<char>(in),std::istreambuf_iterator<char>());
+    }
+    const size_t pairing2 = file.find('\n') + 1 + 2 * Fp12_size;
+    std::swap_ranges(file.begin() + pairing2,file.begin() + pairing2 + Fp12_size,
+        file.begin() + pairing2 + Fp12_size);
+    {
+        std::ofstream out(path,std::ios::binary);
+        out << file;
+    }
+    ASSERT_FALSE(ReadPrecompute(path,c.trust,c.p,mapped));
+    ASSERT_TRUE(WritePrecompute(path,c.verifier));
+    ASSERT_TRUE(ReadPrecompute(path,c.trust,c.p,mapped));
+    std::remove(path.c_str());
+    G2 tablekey;
+    std::vector<size_t> offsets;
+    const char* cur = bytes.data();
+    ASSERT_TRUE(IndexTable(cur,bytes.data() + bytes.size(),tablekey,offsets));
+    ASSERT_EQ(offsets.size(),5u);
+    ASSERT_EQ(offsets.back(),bytes.size());
+    std::vector<ShardResult> shards(2);
+    VerifyShard(*mapped,bytes,tablekey,offsets,0,2,4,shards[0]);
+    VerifyShard(*mapped,bytes,tablekey,offsets,2,2,4,shards[1]);
+    std::string wire;
+    EncodeShardResult(wire,shards[1]);
+    cur = wire.data();
+    ASSERT_TRUE(DecodeShardResult(cur,wire.data() + wire.size(),shards[1]));
+    ASSERT_TRUE(MergeShards(shards));
+    shards[1] = shards[0];
+    ASSERT_FALSE(MergeShards(shards));
+}
+
+// Test proofs that ship challenges instead of commitments
+TEST(DeidTest,ChallengeForm) {
+    Cohort c(1,2);
+
+    ZkProofKnowledge knowledge;
+    NewZkProof({1},{0,1},c.kp2.pub,c.records[0],knowledge,c.prover);
+    CompactRow row;
+    row.disclosed = {{"b",1}};
+    row.snips = c.snips;
+    CompactProof(knowledge,row.proof);
+    ASSERT_TRUE(VerifyChallengeProof(row.proof,c.kp2.pub,row.snips,row.disclosed,
+        c.verifier));
+
+    // over the wire
+    std::string bytes;
+    EncodeCompactRow(bytes,row);
+    ASSERT_LT(EncodedChallengeProofSize(2),EncodedProofSize(2));
+    const char* cur = bytes.data();
+    CompactRow back;
+    ASSERT_TRUE(DecodeCompactRow(cur,bytes.data() + bytes.size(),back));
+    ASSERT_EQ(cur,bytes.data() + bytes.size());
+    ASSERT_TRUE(CheckTable(c.verifier,c.kp2.pub,&back,1));
+
+    // any response or challenge that does not belong fails
+    back.proof.row_response[1] = back.proof.row_response[0];
+    ASSERT_FALSE(VerifyChallengeProof(back.proof,c.kp2.pub,back.snips,back.disclosed,
+        c.verifier));
+    row.proof.snip_challenge = row.proof.challenge;
+    ASSERT_FALSE(VerifyChallengeProof(row.proof,c.kp2.pub,row.snips,row.disclosed,
+        c.verifier));
+    CompactProof(knowledge,row.proof);
+    row.disclosed = {{"c",1}};
+    ASSERT_FALSE(VerifyChallengeProof(row.proof,c.kp2.pub,row.snips,row.disclosed,
+        c.verifier));
+}
+
+// Test one snip proof for all snips of a row
+TEST(DeidTest,AggregatedSnips) {
+    Cohort c(1,3);
+    c.prover.aggregate_snips = true;
+
+    ZkProofKnowledge knowledge;
+    const TableContext context(*c.p,c.kp2.pub);
+    stats::Snapshot before = stats::Take();
+    NewZkProof({1},{0,1,2},context,c.records[0],knowledge,c.prover);
+    stats::Snapshot proved = stats::Take();
+    ASSERT_TRUE(knowledge.aggregated);
+    ASSERT_EQ(knowledge.cmtSnip.size(),1u);
+    ASSERT_EQ(knowledge.snip_response.size(),3u);
+    std::vector<std::pair<std::string,size_t>> disclose = {{"b",1}};
+    ASSERT_TRUE(VerifyProof((ZkProof) knowledge,context,c.snips,disclose,c.verifier));
+    stats::Snapshot verified = stats::Take();
+
+    Row row;
+    row.disclosed = disclose;
+    row.snips = c.snips;
+    row.proof = knowledge;
+    std::string bytes;
+    EncodeRow(bytes,row);
+    ASSERT_LT(EncodedProofSize(3,MESSAGE_COUNT,true),EncodedProofSize(3));
+    const char* cur = bytes.data();
+    Row back;
+    ASSERT_TRUE(DecodeRow(cur,bytes.data() + bytes.size(),back));
+    ASSERT_TRUE(back.proof.aggregated);
+    ASSERT_TRUE(VerifyProof(back.proof,c.kp2.pub,back.snips,back.disclosed,c.verifier));
+
+    CompactRow compact;
+    compact.disclosed = disclose;
+    compact.snips = c.snips;
+    CompactProof(knowledge,compact.proof);
+    ASSERT_TRUE(VerifyChallengeProof(compact.proof,c.kp2.pub,compact.snips,
+        compact.disclosed,c.verifier));
+
+    // a swapped or foreign snip breaks the combination, so does dropping the flag
+    std::swap(back.snips[0],back.snips[1]);
+    ASSERT_FALSE(VerifyProof(back.proof,c.kp2.pub,back.snips,back.disclosed,c.verifier));
+    compact.snips[2] = c.snips[0];
+    ASSERT_FALSE(VerifyChallengeProof(compact.proof,c.kp2.pub,compact.snips,
+        compact.disclosed,c.verifier));
+    ZkProof plain = knowledge;
+    plain.aggregated = false;
+    ASSERT_FALSE(VerifyProof(plain,c.kp2.pub,c.snips,disclose,c.verifier));
+
+    if(stats::Enabled()) {
+        TableSpec spec(1,1,3);
+        spec.aggregate_snips = true;
+        Calibration calib = {};
+        CostEstimate cost;
+        EstimateCost(spec,calib,cost);
+        stats::Snapshot prove = proved.Since(before);
+        stats::Snapshot verify = verified.Since(proved);
+        ASSERT_EQ(prove.counters[stats::PAIRING],cost.prove.pairings);
+        ASSERT_EQ(prove.counters[stats::G1_MUL],cost.prove.g1_muls);
+        ASSERT_EQ(prove.counters[stats::GT_POW],cost.prove.gt_pows);
+        ASSERT_EQ(prove.counters[stats::GT_FIXED_POW],cost.prove.gt_fixed_pows);
+        ASSERT_EQ(prove.counters[stats::HASH],cost.prove.hashes);
+        ASSERT_EQ(verify.counters[stats::PAIRING],cost.verify.pairings);
+        ASSERT_EQ(verify.counters[stats::G1_MUL],cost.verify.g1_muls);
+        ASSERT_EQ(verify.counters[stats::G2_MUL],0u);
+        ASSERT_EQ(verify.counters[stats::GT_POW],cost.verify.gt_pows);
+        ASSERT_EQ(verify.counters[stats::GT_FIXED_POW],cost.verify.gt_fixed_pows);
+        ASSERT_EQ(verify.counters[stats::HASH],cost.verify.hashes);
+    }
+}
+
+// Test the instrumentation against the known operation structure of a proof
+TEST(DeidTest,Stats) {
+    Cohort c(1,2);
+
+    ZkProofKnowledge knowledge;
+    const TableContext context(*c.p,c.kp2.pub);
+    stats::Snapshot before = stats::Take();
+    NewZkProof({0},{0,1},context,c.records[0],knowledge,c.prover);
+    stats::Snapshot proved = stats::Take();
+    std::vector<std::pair<std::string,size_t>> disclose = {{"a",0}};
+    ASSERT_TRUE(VerifyProof((ZkProof) knowledge,context,c.snips,disclose,c.verifier));
+    stats::Snapshot verified = stats::Take();
+
+    stats::Snapshot prove = proved.Since(before);
+    stats::Snapshot verify = verified.Since(proved);
+    if(!stats::Enabled()) {
+        ASSERT_EQ(verify.counters[stats::PAIRING],0u);
+        return;
+    }
+    ASSERT_EQ(prove.counters[stats::PAIRING],2u + 2);
+    ASSERT_EQ(prove.phases[stats::PROVE].count,1u);
+    ASSERT_EQ(verify.counters[stats::PAIRING],4u + 2 * 2);
+    ASSERT_EQ(verify.counters[stats::G2_MUL],2u);
+    ASSERT_EQ(verify.phases[stats::VERIFY].count,1u);
+    ASSERT_EQ(verify.phases[stats::VERIFY_SNIPS].count,1u);
+    ASSERT_EQ(verify.phases[stats::FIATSHAMIR].count,3u);
+}
+
+// Test the cost model against a real proof
+TEST(DeidTest,CostModel) {
+    Cohort c(1,3);
+
+    ZkProofKnowledge knowledge;
+    const TableContext context(*c.p,c.kp2.pub);
+    stats::Snapshot before = stats::Take();
+    NewZkProof({0,2},{0,1,2},context,c.records[0],knowledge,c.prover);
+    stats::Snapshot proved = stats::Take();
+    std::vector<std::pair<std::string,size_t>> disclose = {{"a",0},{"c",2}};
+    ASSERT_TRUE(VerifyProof((ZkProof) knowledge,context,c.snips,disclose,c.verifier));
+    stats::Snapshot verified = stats::Take();
+
+    // the encoded size of the proof is predicted exactly
+    Row row;
+    row.proof = knowledge;
+    std::string bytes;
+    EncodeRow(bytes,row);
+    ASSERT_EQ(bytes.size(),8 + EncodedProofSize(3));
+
+    Calibration calib;
+    Calibrate(calib,16);
+    CostEstimate cost;
+    EstimateCost(TableSpec(1000,2,3),calib,cost);
+    ASSERT_EQ(cost.proof_bytes,1000 * EncodedProofSize(3));
+    ASSERT_GT(cost.verify_seconds,0);
+    ASSERT_LT(calib.gt_fixed_pow_ns,calib.gt_pow_ns);
+
+    // a small table checked from scratch, setup included, takes about the estimate
+    const size_t rows = 4;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stats::Snapshot setup = stats::Take();
+    {
+        const Verifier verifier(c.trust,c.p);
+        const TableContext table(*c.p,c.kp2.pub);
+        setup = stats::Take().Since(setup);
+        for(size_t i = 0; i < rows; i++) {
+            ASSERT_TRUE(VerifyProof((ZkProof) knowledge,table,c.snips,disclose,verifier));
+        }
+    }
+    const double measured = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    CostEstimate small;
+    EstimateCost(TableSpec(rows,2,3),calib,small);
+    ASSERT_GT(measured,small.verify_seconds / 3);
+    ASSERT_LT(measured,small.verify_seconds * 3);
+
+    if(stats::Enabled()) {
+        stats::Snapshot prove = proved.Since(before);
+        stats::Snapshot verify = verified.Since(proved);
+        ASSERT_EQ(prove.counters[stats::PAIRING],cost.prove.pairings);
+        ASSERT_EQ(prove.counters[stats::G1_MUL],cost.prove.g1_muls);
+        ASSERT_EQ(prove.counters[stats::GT_POW],cost.prove.gt_pows);
+        ASSERT_EQ(prove.counters[stats::GT_FIXED_POW],cost.prove.gt_fixed_pows);
+        ASSERT_EQ(prove.counters[stats::GT_TABLE],0u);
+        ASSERT_EQ(prove.counters[stats::HASH],cost.prove.hashes);
+        ASSERT_EQ(verify.counters[stats::PAIRING],cost.verify.pairings);
+        ASSERT_EQ(verify.counters[stats::G1_MUL],cost.verify.g1_muls);
+        ASSERT_EQ(verify.counters[stats::G2_MUL],cost.verify.g2_muls);
+        ASSERT_EQ(verify.counters[stats::GT_POW],cost.verify.gt_pows);
+        ASSERT_EQ(verify.counters[stats::GT_FIXED_POW],cost.verify.gt_fixed_pows);
+        ASSERT_EQ(verify.counters[stats::GT_TABLE],0u);
+        ASSERT_EQ(verify.counters[stats::HASH],cost.verify.hashes);
+        ASSERT_EQ(setup.counters[stats::PAIRING],cost.setup.pairings);
+        ASSERT_EQ(setup.counters[stats::GT_TABLE],cost.setup.gt_tables);
+    }
+}
@@ -6,12 +6,14 @@
  */
 
 #include <iostream>
+#include <sstream>
 #include <gtest/gtest.h>
 
 #include <crypto.hpp>
 #include <protocol.hpp>
 #include <deid.hpp>
 #include <base.hpp>
+#include <json.hpp>
 
 using namespace philips;
 
@@ -164,3 +166,114 @@ TEST(Demo,log) {
     }
 
 }
+
+// Test the base64 codec against every tail length & every bad character
+TEST(Base64,Codec) {
+    std::vector<uint8_t> raw, back;
+    std::string enc;
+    for(size_t n = 0; n < 200; n++) {
+        raw.push_back((uint8_t) (n * 131 + 7));
+        base64_encode(enc,raw);
+        ASSERT_EQ(enc.size(),base64_encoded_size(raw.size()));
+        ASSERT_EQ(base64_decoded_size(enc.data(),enc.size()),raw.size());
+        ASSERT_TRUE(base64_decode_strict(back,enc));
+        ASSERT_EQ(back,raw);
+
+        std::string bad = enc;
+        bad[n % (enc.size() - 2)] = '*';
+        ASSERT_FALSE(base64_decode_strict(back,bad));
+    }
+
+    std::string buf(base64_encoded_size(3),' ');
+    base64_encode(&buf[0],(const uint8_t*) "ABC",3);
+    ASSERT_EQ(buf,"QUJD");
+    ASSERT_FALSE(base64_decode_strict(back,"QUJ"));   // unpadded
+    ASSERT_FALSE(base64_decode_strict(back,"QU=D"));  // padding inside
+    ASSERT_FALSE(base64_decode_strict(back,"QUJ=="));
+    ASSERT_FALSE(base64_decode_strict(back,"QR=="));  // non canonical
+
+    // the tolerant decoder still takes what it used to
+    std::string s;
+    base64_decode(s,"QUI");
+    ASSERT_EQ(s,"AB");
+}
+
+// Test a table survives the trip through json, streamed & in memory
+TEST(Json,Table) {
+    auto p = std::make_shared<const Protocol>();
+    KeyPair kp;
+    BBKey bbk(p->crv.g2,p->crv.g1);
+    TrustLayer trust;
+    KeyGen(p->crv.g2,kp);
+    trust.pub = kp.pub;
+    trust.bbkeys = {bbk.pub};
+
+    std::vector<std::string> snips = {
+        "1       15850   .       G       T       .       .       .",
+        "1       396781  .       T       A       .       .       .",
+        "1       447872  .       A       T       \"tab\there\"  \\ .",
+    };
+    std::array<std::string,MESSAGE_COUNT> record = {"AGE=64","CANCER=LIVER","BMI=25","MALE","USA"};
+    std::array<std::string,MESSAGE_COUNT> record2 = {"AGE=52","CANCER=LIVER","BMI=19","FEMALE","USA"};
+    std::vector<DeidRecord> records = { DeidRecord(kp,bbk,record,p,snips),
+        DeidRecord(kp,bbk,record2,p,snips) };
+    Prover prover = Prover(records,trust,p);
+    Verifier verifier = Verifier(trust,p);
+
+    std::vector<size_t> discl = {1,3};
+    std::vector<size_t> sdiscl = {2};
+    std::array<std::pair<size_t,std::vector<size_t>>,2> disclose, discsnips;
+    for(size_t i = 0; i < 2; i++) {
+        disclose[i] = std::make_pair(i, discl);
+        discsnips[i] = std::make_pair(i, sdiscl);
+    }
+    NewTable("random phrase", prover, disclose.data(), discsnips.data(), 2);
+    const Table& table = *prover.table;
+
+    std::string json;
+    WriteTableJson(json,table.tablekey,table.deidrows.data(),table.deidrows.size());
+    std::ostringstream out;
+    WriteTableJson(out,table.tablekey,table.deidrows.data(),table.deidrows.size());
+    ASSERT_EQ(out.str(),json);
+
+    // in memory, the export of the import is the same document
+    G2 tablekey;
+    std::vector<Row> rows;
+    ASSERT_TRUE(ReadTableJson(json.data(),json.size(),tablekey,rows));
+    ASSERT_EQ(tablekey,table.tablekey);
+    ASSERT_EQ(rows.size(),table.deidrows.size());
+    ASSERT_EQ(rows[0].snips,table.deidrows[0].snips);
+    ASSERT_TRUE(CheckTable(verifier,tablekey,rows.data(),rows.size()));
+    std::string again;
+    WriteTableJson(again,tablekey,rows.data(),rows.size());
+    ASSERT_EQ(again,json);
+
+    // streamed, one row at a time into the same row
+    std::istringstream in(json);
+    JsonTableReader reader(in);
+    ASSERT_TRUE(reader.Begin(tablekey));
+    Row row;
+    size_t count = 0;
+    while(reader.Next(row)) {
+        ASSERT_TRUE(CheckTable(verifier,tablekey,&row,1));
+        count++;
+    }
+    ASSERT_TRUE(reader.Done());
+    ASSERT_EQ(count,table.deidrows.size());
+
+    // unknown keys are skipped
+    std::string extra = "{\"note\":[1,{\"a\":null}]," + json.substr(1);
+    ASSERT_TRUE(ReadTableJson(extra.data(),extra.size(),tablekey,rows));
+
+    // malformed documents are refused
+    ASSERT_FALSE(ReadTableJson(json.data(),json.size() / 2,tablekey,rows));
+    const size_t key = json.find("\"tablekey\":\"") + 12;
+    std::string bad = json;
+    bad[key] = '*';
+    ASSERT_FALSE(ReadTableJson(bad.data(),bad.size(),tablekey,rows));
+    bad = json;
+    bad.erase(json.find("\"cmtY\""),json.find("\"response\"") - json.find("\"cmtY\""));
+    ASSERT_FALSE(ReadTableJson(bad.data(),bad.size(),tablekey,rows));
+    std::string order = "{\"rows\":[]," + json.substr(1);
+    ASSERT_FALSE(ReadTableJson(order.data(),order.size(),tablekey,rows));
+}
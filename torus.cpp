@@ -0,0 +1,86 @@
+/**
+ * Compressed encoding of Gt
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+// philips
+#include "torus.hpp"
+
+#define FP_BYTES (Gt_compressed_size / 6)
+
+using namespace philips;
+
+/*--------------------------------------------------------------------------------------
+ * Fp6 serialization, the six Fp coefficients in order
+ *-------------------------------------------------------------------------------------*/
+
+static void Coefficients(Fp6& x, Fp* c[6])
+{
+    c[0] = &x.a.a; c[1] = &x.a.b;
+    c[2] = &x.b.a; c[3] = &x.b.b;
+    c[4] = &x.c.a; c[5] = &x.c.b;
+}
+
+static void PutFp6(Fp6 x, char* out)
+{
+    Fp* c[6];
+    Coefficients(x,c);
+    for(size_t i = 0; i < 6; i++) {
+        c[i]->serialize(out + i * FP_BYTES,FP_BYTES);
+    }
+}
+
+static bool GetFp6(Fp6& x, const char* in)
+{
+    Fp* c[6];
+    Coefficients(x,c);
+    for(size_t i = 0; i < 6; i++) {
+        if(c[i]->deserialize(in + i * FP_BYTES,FP_BYTES) != FP_BYTES) return false;
+    }
+    return true;
+}
+
+
+/*--------------------------------------------------------------------------------------
+ * Torus
+ * a + b w with a^2 - b^2 v = 1 has c = (1 + a) / b, then c^2 - v = 2 (1 + a) / b^2
+ * and a = (c^2 + v) / (c^2 - v), b = 2 c / (c^2 - v)
+ *-------------------------------------------------------------------------------------*/
+
+void philips::CompressGt(const Fp12& g, char out[Gt_compressed_size])
+{
+    Fp6 c;
+    c.clear();
+    // b = 0 leaves a = +-1 and -1 is not in Gt
+    if(!g.b.isZero()) {
+        Fp6 inv;
+        Fp6::add(c,g.a,Fp6(1));
+        Fp6::inv(inv,g.b);
+        Fp6::mul(c,c,inv);
+    }
+    PutFp6(c,out);
+}
+
+bool philips::DecompressGt(Fp12& g, const char in[Gt_compressed_size])
+{
+    Fp6 c;
+    if(!GetFp6(c,in)) return false;
+    if(c.isZero()) {
+        g = Fp12(1);
+        return true;
+    }
+    Fp6 v, c2, num, den;
+    v.clear();
+    v.b = Fp2(1);
+    Fp6::sqr(c2,c);
+    Fp6::add(num,c2,v);
+    Fp6::sub(den,c2,v);
+    if(den.isZero()) return false;
+    Fp6::inv(den,den);
+    Fp6::mul(g.a,num,den);
+    Fp6::add(c,c,c);
+    Fp6::mul(g.b,c,den);
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+/**
+ * Compressed encoding of Gt
+ * pairing values have norm 1 over Fp6, so g = (c + w) / (c - w) for a single c in Fp6
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <mcl/bn256.hpp>
+
+using namespace mcl::bn256;
+
+// half of Fp12_size, one Fp6
+const size_t Gt_compressed_size = 192;
+
+namespace philips {
+
+/**
+ * Write the torus coordinate c = (1 + a) / b of g = a + b w, the identity is all zero
+ * g has to be in Gt, any other Fp12 does not round trip
+ * ------------------------------------------
+ */
+void CompressGt(const Fp12& g, char out[Gt_compressed_size]);
+
+/**
+ * Recover g from its torus coordinate, false on a malformed coordinate
+ * ------------------------------------------
+ */
+bool DecompressGt(Fp12& g, const char in[Gt_compressed_size]);
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+/**
+ * Fiat shamir transcript
+ * absorbs labelled elements into one running hash, challenges are squeezed in order
+ * by AJHL
+ * for philips
+ * written to be C++11 compliant, columnwidth = 90
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <mcl/bn256.hpp>
+#include <cybozu/sha2.hpp>
+
+#include "crypto.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+
+namespace philips {
+
+using namespace mcl::bn256;
+
+/*--------------------------------------------------------------------------------------
+ * Transcript
+ *-------------------------------------------------------------------------------------*/
+
+class Transcript {
+public:
+    // the domain separates transcripts of different proof systems
+    explicit Transcript(const char* domain) { Label(domain); }
+
+    template<typename G>
+    void Absorb(const char* label, const G& el) {
+        char buf[Fp12_size]; // the largest element
+        Label(label);
+        const size_t n = el.serialize(buf,sizeof(buf));
+        Length(n);
+        state.update(buf,n);
+    }
+
+    void Absorb(const char* label, uint64_t v) {
+        Label(label);
+        Length(v);
+    }
+
+    void Absorb(const char* label, const std::string& s) {
+        Label(label);
+        Length(s.size());
+        state.update(s.data(),s.size());
+    }
+
+    /**
+     * Squeeze a challenge, it is absorbed back so later challenges depend on it
+     * ------------------------------------------
+     */
+    void Challenge(const char* label, Fr& c) {
+        STAT_PHASE(phase,FIATSHAMIR);
+        STAT_COUNT(HASH,1);
+        Label(label);
+        uint8_t md[32];
+        cybozu::Sha256 h = state;
+        h.digest(md,sizeof(md),"",0);
+        c.setArrayMask(md,sizeof(md));
+        state.update(md,sizeof(md));
+    }
+
+private:
+    void Length(uint64_t n) {
+        uint8_t le[8];
+        for(size_t i = 0; i < 8; i++) le[i] = (uint8_t) (n >> (8 * i));
+        state.update(le,sizeof(le));
+    }
+
+    void Label(const char* label) {
+        const size_t n = strlen(label);
+        Length(n);
+        state.update(label,n);
+    }
+
+    cybozu::Sha256 state;
+};
+
+// the protocol & the trust layer, for digests that only hold under one setup
+inline void AbsorbSetup(Transcript& t, const Protocol& p, const TrustLayer& trust)
+{
+    t.Absorb("messages",(uint64_t) MESSAGE_COUNT);
+    t.Absorb("g1",p.crv.g1);
+    t.Absorb("g2",p.crv.g2);
+    t.Absorb("uH",p.uH);
+    t.Absorb("lH",p.lH);
+    t.Absorb("iH",p.iH);
+    for(const G1& g : p.generators) {
+        t.Absorb("generator",g);
+    }
+    t.Absorb("pub",trust.pub);
+    for(const G2& k : trust.bbkeys) {
+        t.Absorb("bbkey",k);
+    }
+    for(const G2& k : trust.issuers) {
+        t.Absorb("issuer",k);
+    }
+}
+
+}